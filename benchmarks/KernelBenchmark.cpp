@@ -0,0 +1,337 @@
+/*
+ * KernelBenchmark.cpp is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+/*
+ * Times the sample kernels and the FFT plans against plain reference
+ * implementations of the same operations (the loops they replaced) and
+ * checks that both give the same results. The best of a number of runs is
+ * reported. The program returns non zero if any result differs.
+ */
+
+#include "SampleKernels.h"
+#include "FFTPlan.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+
+// One minute of stereo 48 kHz audio for the conversions
+static const unsigned CONVERSION_FRAMES = 48000 * 60;
+static const int CONVERSION_CHANNELS = 2;
+// Loop points compared by the loop quality benchmark
+static const unsigned LOOP_QUALITY_PAIRS = 1000000;
+static const unsigned LOOP_QUALITY_FRAMES_IN_TRACK = 48000 * 6;
+// Largest relative error of a loop quality that is accepted, the five
+// frames may be summed in another order with -ffast-math
+static const double LOOP_QUALITY_TOLERANCE = 1e-12;
+// Largest relative error of a power spectrum bin that is accepted
+static const double SPECTRUM_TOLERANCE = 1e-6;
+
+static int failures = 0;
+
+template <typename F>
+static double BestTime(unsigned runs, F function) {
+  double best = 0;
+  for (unsigned i = 0; i < runs; i++) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    function();
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (i == 0 || elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+static void Report(const char *name, double referenceTime, double kernelTime, bool isSame) {
+  printf("  %-42s %10.3f ms %10.3f ms %6.2fx %s\n", name, referenceTime, kernelTime, referenceTime / kernelTime, isSame ? "" : "DIFFERS");
+  if (!isSame)
+    failures++;
+}
+
+// Reference conversions, one sample at a time in interleaved order
+
+template <typename T, typename U>
+static void ReferenceDeinterleave(const T *in, unsigned nbrFrames, int channels, U *out, unsigned long outStride, double factor) {
+  for (unsigned i = 0; i < nbrFrames; i++) {
+    for (int ch = 0; ch < channels; ch++)
+      out[ch * outStride + i] = (U) (in[i * channels + ch] * factor);
+  }
+}
+
+static void ReferenceStore(double value, double scale, short &out) {
+  value *= scale;
+  if (value > scale - 1.0)
+    value = scale - 1.0;
+  else if (value < -scale)
+    value = -scale;
+  out = (short) lrint(value);
+}
+
+static void ReferenceStore(double value, double scale, int &out) {
+  value *= scale;
+  if (value > scale - 1.0)
+    value = scale - 1.0;
+  else if (value < -scale)
+    value = -scale;
+  out = (int) lrint(value);
+}
+
+static void ReferenceStore(double value, double, float &out) {
+  out = (float) value;
+}
+
+template <typename U, typename T>
+static void ReferenceInterleave(const U *in, unsigned long inStride, unsigned nbrFrames, int channels, T *out, double scale) {
+  for (unsigned i = 0; i < nbrFrames; i++) {
+    for (int ch = 0; ch < channels; ch++)
+      ReferenceStore(in[ch * inStride + i], scale, out[i * channels + ch]);
+  }
+}
+
+template <typename T>
+static void BenchmarkDeinterleave(const char *name, const std::vector<T> &in, double factor) {
+  std::vector<float> reference(in.size());
+  std::vector<float> kernel(in.size());
+  double referenceTime = BestTime(7, [&]() {
+    ReferenceDeinterleave(&in[0], CONVERSION_FRAMES, CONVERSION_CHANNELS, &reference[0], CONVERSION_FRAMES, factor);
+  });
+  double kernelTime = BestTime(7, [&]() {
+    DeinterleaveSamples(&in[0], CONVERSION_FRAMES, CONVERSION_CHANNELS, &kernel[0], CONVERSION_FRAMES, factor);
+  });
+  Report(name, referenceTime, kernelTime, reference == kernel);
+}
+
+template <typename T>
+static void BenchmarkInterleave(const char *name, const std::vector<float> &in, double scale) {
+  std::vector<T> reference(in.size());
+  std::vector<T> kernel(in.size());
+  double referenceTime = BestTime(7, [&]() {
+    ReferenceInterleave(&in[0], CONVERSION_FRAMES, CONVERSION_FRAMES, CONVERSION_CHANNELS, &reference[0], scale);
+  });
+  double kernelTime = BestTime(7, [&]() {
+    InterleaveSamples(&in[0], CONVERSION_FRAMES, CONVERSION_FRAMES, CONVERSION_CHANNELS, &kernel[0], scale);
+  });
+  Report(name, referenceTime, kernelTime, reference == kernel);
+}
+
+static void BenchmarkConversions() {
+  printf("Conversions, one minute of stereo 48 kHz audio (reference, kernel):\n");
+  std::vector<short> shorts(CONVERSION_FRAMES * CONVERSION_CHANNELS);
+  std::vector<int> ints(shorts.size());
+  std::vector<float> floats(shorts.size());
+  for (unsigned i = 0; i < shorts.size(); i++) {
+    ints[i] = (rand() % (1 << 24)) - (1 << 23);
+    shorts[i] = (short) (ints[i] >> 8);
+    floats[i] = (float) ints[i] / (1 << 23);
+  }
+  BenchmarkDeinterleave("deinterleave short -> float tracks", shorts, 1.0 / 32768);
+  BenchmarkDeinterleave("deinterleave int (24 bit) -> float tracks", ints, 1.0 / (1 << 23));
+  BenchmarkDeinterleave("deinterleave float -> float tracks", floats, 1.0);
+  // the planar tracks for the interleaving are the same floats
+  BenchmarkInterleave<float>("interleave float tracks -> float", floats, 1.0);
+  BenchmarkInterleave<short>("interleave float tracks -> short", floats, 32768);
+  BenchmarkInterleave<int>("interleave float tracks -> int", floats, 1 << 23);
+}
+
+// The loop quality as it was calculated before, channel by channel. It's
+// kept out of line like the kernel so that both are timed as calls
+__attribute__((noinline))
+static double ReferenceLoopQuality(const double *tracks, unsigned long trackStride, int channels, unsigned start, unsigned end) {
+  double worst = 0;
+  for (int c = 0; c < channels; c++) {
+    double sum = 0;
+    for (unsigned j = 0; j < LOOP_QUALITY_FRAMES; j++) {
+      double before = tracks[c * trackStride + start - LOOP_QUALITY_FRAMES + j];
+      double atEnd = tracks[c * trackStride + end + 1 - LOOP_QUALITY_FRAMES + j];
+      sum += fabs(before - atEnd);
+    }
+    if (sum > worst)
+      worst = sum;
+  }
+  return worst;
+}
+
+static void BenchmarkLoopQuality(int channels) {
+  std::vector<double> tracks((unsigned long) LOOP_QUALITY_FRAMES_IN_TRACK * channels);
+  for (unsigned long i = 0; i < tracks.size(); i++)
+    tracks[i] = sin(i * 0.01) + (rand() % 1000) / 100000.0;
+  std::vector<unsigned> starts(LOOP_QUALITY_PAIRS);
+  std::vector<unsigned> ends(LOOP_QUALITY_PAIRS);
+  for (unsigned i = 0; i < LOOP_QUALITY_PAIRS; i++) {
+    starts[i] = LOOP_QUALITY_FRAMES + rand() % (LOOP_QUALITY_FRAMES_IN_TRACK / 2);
+    ends[i] = starts[i] + rand() % (LOOP_QUALITY_FRAMES_IN_TRACK / 2 - LOOP_QUALITY_FRAMES);
+  }
+
+  std::vector<double> reference(LOOP_QUALITY_PAIRS);
+  std::vector<double> kernel(LOOP_QUALITY_PAIRS);
+  double referenceTime = BestTime(7, [&]() {
+    for (unsigned i = 0; i < LOOP_QUALITY_PAIRS; i++)
+      reference[i] = ReferenceLoopQuality(&tracks[0], LOOP_QUALITY_FRAMES_IN_TRACK, channels, starts[i], ends[i]);
+  });
+  double kernelTime = BestTime(7, [&]() {
+    for (unsigned i = 0; i < LOOP_QUALITY_PAIRS; i++)
+      kernel[i] = LoopQuality(&tracks[0], LOOP_QUALITY_FRAMES_IN_TRACK, channels, starts[i], ends[i], HUGE_VAL);
+  });
+  char name[64];
+  snprintf(name, sizeof(name), "%u loops, %d channel%s", LOOP_QUALITY_PAIRS, channels, channels > 1 ? "s" : "");
+  bool isSame = true;
+  for (unsigned i = 0; i < LOOP_QUALITY_PAIRS; i++) {
+    if (fabs(kernel[i] - reference[i]) > LOOP_QUALITY_TOLERANCE * reference[i])
+      isSame = false;
+  }
+  Report(name, referenceTime, kernelTime, isSame);
+}
+
+/*
+ * Reference power spectrum, the radix-2 transform with the twiddle
+ * recurrence and the real input split of the former FFT.cpp
+ */
+
+static void ReferenceFFT(unsigned size, const double *realIn, const double *imagIn, double *realOut, double *imagOut) {
+  unsigned bits = 0;
+  while ((1u << bits) < size)
+    bits++;
+  for (unsigned i = 0; i < size; i++) {
+    unsigned reversed = 0;
+    for (unsigned b = 0, index = i; b < bits; b++, index >>= 1)
+      reversed = (reversed << 1) | (index & 1);
+    realOut[reversed] = realIn[i];
+    imagOut[reversed] = imagIn[i];
+  }
+
+  unsigned blockEnd = 1;
+  for (unsigned blockSize = 2; blockSize <= size; blockSize <<= 1) {
+    double deltaAngle = -2.0 * M_PI / blockSize;
+    double sm2 = sin(-2 * deltaAngle);
+    double sm1 = sin(-deltaAngle);
+    double cm2 = cos(-2 * deltaAngle);
+    double cm1 = cos(-deltaAngle);
+    double w = 2 * cm1;
+    for (unsigned i = 0; i < size; i += blockSize) {
+      double ar2 = cm2;
+      double ar1 = cm1;
+      double ai2 = sm2;
+      double ai1 = sm1;
+      for (unsigned j = i, n = 0; n < blockEnd; j++, n++) {
+        double ar0 = w * ar1 - ar2;
+        ar2 = ar1;
+        ar1 = ar0;
+        double ai0 = w * ai1 - ai2;
+        ai2 = ai1;
+        ai1 = ai0;
+        unsigned k = j + blockEnd;
+        double tr = ar0 * realOut[k] - ai0 * imagOut[k];
+        double ti = ar0 * imagOut[k] + ai0 * realOut[k];
+        realOut[k] = realOut[j] - tr;
+        imagOut[k] = imagOut[j] - ti;
+        realOut[j] += tr;
+        imagOut[j] += ti;
+      }
+    }
+    blockEnd = blockSize;
+  }
+}
+
+// Only the bins 1 to size / 2 - 1 are written
+static void ReferencePowerSpectrum(unsigned size, const double *in, double *out) {
+  unsigned half = size / 2;
+  std::vector<double> tmpReal(half);
+  std::vector<double> tmpImag(half);
+  std::vector<double> realOut(half);
+  std::vector<double> imagOut(half);
+  for (unsigned i = 0; i < half; i++) {
+    tmpReal[i] = in[2 * i];
+    tmpImag[i] = in[2 * i + 1];
+  }
+  ReferenceFFT(half, &tmpReal[0], &tmpImag[0], &realOut[0], &imagOut[0]);
+
+  double theta = M_PI / half;
+  double wtemp = sin(0.5 * theta);
+  double wpr = -2.0 * wtemp * wtemp;
+  double wpi = -sin(theta);
+  double wr = 1.0 + wpr;
+  double wi = wpi;
+  for (unsigned i = 1; i < half / 2; i++) {
+    unsigned i3 = half - i;
+    double h1r = 0.5 * (realOut[i] + realOut[i3]);
+    double h1i = 0.5 * (imagOut[i] - imagOut[i3]);
+    double h2r = 0.5 * (imagOut[i] + imagOut[i3]);
+    double h2i = -0.5 * (realOut[i] - realOut[i3]);
+    double rt = h1r + wr * h2r - wi * h2i;
+    double it = h1i + wr * h2i + wi * h2r;
+    out[i] = rt * rt + it * it;
+    rt = h1r - wr * h2r + wi * h2i;
+    it = -h1i + wr * h2i + wi * h2r;
+    out[i3] = rt * rt + it * it;
+    wr = (wtemp = wr) * wpr - wi * wpi + wr;
+    wi = wi * wpr + wtemp * wpi + wi;
+  }
+  double rt = realOut[half / 2];
+  double it = imagOut[half / 2];
+  out[half / 2] = rt * rt + it * it;
+}
+
+static void BenchmarkPowerSpectrum(unsigned size) {
+  std::vector<double> in(size);
+  for (unsigned i = 0; i < size; i++)
+    in[i] = sin(i * 0.05) + (rand() % 1000) / 1000.0 - 0.5;
+  std::vector<double> reference(size / 2, 0.0);
+  std::vector<double> kernel(size / 2, 0.0);
+  const FFTPlan *plan = FFTPlan::GetPlan(size);
+  std::vector<double> work(plan->GetWorkSize());
+  unsigned runs = std::max(7u, (1u << 22) / size);
+  double referenceTime = BestTime(runs, [&]() {
+    ReferencePowerSpectrum(size, &in[0], &reference[0]);
+  });
+  double kernelTime = BestTime(runs, [&]() {
+    plan->PowerSpectrum(&in[0], &kernel[0], &work[0]);
+  });
+
+  // the greatest bin sets the scale of the errors
+  double greatest = 0;
+  for (unsigned k = 1; k < size / 2; k++)
+    greatest = std::max(greatest, reference[k]);
+  double worstError = 0;
+  for (unsigned k = 1; k < size / 2; k++)
+    worstError = std::max(worstError, fabs(kernel[k] - reference[k]) / greatest);
+  char name[64];
+  snprintf(name, sizeof(name), "%u points (error %.1e)", size, worstError);
+  Report(name, referenceTime, kernelTime, worstError < SPECTRUM_TOLERANCE);
+}
+
+int main() {
+  srand(1);
+  BenchmarkConversions();
+
+  printf("\nLoop quality (reference, kernel):\n");
+  BenchmarkLoopQuality(1);
+  BenchmarkLoopQuality(2);
+  BenchmarkLoopQuality(6);
+
+  printf("\nPower spectrum (reference, plan):\n");
+  for (unsigned size = 1024; size <= 131072; size *= 2)
+    BenchmarkPowerSpectrum(size);
+  FFTPlan::ReleasePlans();
+
+  if (failures)
+    printf("\n%d results differ from the reference\n", failures);
+  return failures ? 1 : 0;
+}
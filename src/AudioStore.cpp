@@ -0,0 +1,661 @@
+/*
+ * AudioStore.cpp is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+#include "AudioStore.h"
+#include "SampleKernels.h"
+#include <cmath>
+#include <algorithm>
+
+// Integer samples are scaled with a power of two so that the conversion to
+// and from the normalized range is exact in both directions
+static const double SHORT_SCALE = 32768.0;
+static const double INT_SCALE = 2147483648.0;
+
+// Pages hold 65536 frames
+static const unsigned PAGE_SHIFT = 16;
+static const unsigned PAGE_FRAMES = 1 << PAGE_SHIFT;
+static const unsigned PAGE_MASK = PAGE_FRAMES - 1;
+
+size_t AudioStore::s_memoryBudget = (size_t) 512 * 1024 * 1024;
+
+typedef std::lock_guard<std::recursive_mutex> StoreLock;
+
+AudioStore::AudioStore() : m_channels(0), m_frames(0), m_firstFrame(0), m_storedFrames(0), m_useDoubles(false), m_source(NULL), m_loadedBytes(0), m_useCounter(0), m_playbackPage(-1), m_isModified(false), m_changeCount(0) {
+}
+
+AudioStore::~AudioStore() {
+}
+
+void AudioStore::Allocate(int channels, unsigned frames, bool useDoubles) {
+  StoreLock lock(m_mutex);
+  Release();
+  m_channels = channels;
+  m_frames = m_storedFrames = frames;
+  m_useDoubles = useDoubles;
+  CreatePages(true);
+}
+
+void AudioStore::AttachSource(int channels, unsigned frames, bool useDoubles, AudioPageSource *source) {
+  StoreLock lock(m_mutex);
+  Release();
+  m_channels = channels;
+  m_frames = m_storedFrames = frames;
+  m_useDoubles = useDoubles;
+  m_source = source;
+  CreatePages(false);
+}
+
+void AudioStore::DetachSource() {
+  StoreLock lock(m_mutex);
+  if (m_source == NULL)
+    return;
+
+  // pages outside of the current view will never be used again
+  for (unsigned i = 0; i < m_pages.size(); i++) {
+    if (!m_pages[i].isLoaded && IsPageInView(i))
+      LoadPage(i);
+  }
+  m_source = NULL;
+}
+
+void AudioStore::ReplaceSource(AudioPageSource *source) {
+  StoreLock lock(m_mutex);
+  m_source = source;
+  m_isModified = false;
+  if (m_firstFrame != 0 || m_storedFrames != m_frames) {
+    // the frames are at other positions in the new source so the pages
+    // are simply read again from it when needed
+    m_firstFrame = 0;
+    m_storedFrames = m_frames;
+    m_loadedBytes = 0;
+    m_playbackPage = -1;
+    CreatePages(false);
+    InvalidateViews();
+    return;
+  }
+  for (unsigned i = 0; i < m_pages.size(); i++)
+    m_pages[i].isDirty = false;
+}
+
+void AudioStore::Release() {
+  StoreLock lock(m_mutex);
+  m_pages.clear();
+  m_playbackPage = -1;
+  m_source = NULL;
+  m_loadedBytes = 0;
+  m_channels = 0;
+  m_frames = 0;
+  m_firstFrame = 0;
+  m_storedFrames = 0;
+  m_isModified = false;
+  m_changeCount++;
+}
+
+int AudioStore::GetChannels() {
+  return m_channels;
+}
+
+unsigned AudioStore::GetFrames() {
+  return m_frames;
+}
+
+unsigned long AudioStore::GetLength() {
+  StoreLock lock(m_mutex);
+  return (unsigned long) m_frames * m_channels;
+}
+
+bool AudioStore::HasDoublePrecision() {
+  return m_useDoubles;
+}
+
+bool AudioStore::IsEmpty() {
+  return m_frames == 0 || m_channels == 0;
+}
+
+bool AudioStore::IsPaged() {
+  return m_source != NULL;
+}
+
+size_t AudioStore::GetLoadedBytes() {
+  return m_loadedBytes;
+}
+
+bool AudioStore::IsModified() {
+  return m_isModified;
+}
+
+void AudioStore::ClearModified() {
+  m_isModified = false;
+}
+
+unsigned long AudioStore::GetChangeCount() {
+  StoreLock lock(m_mutex);
+  return m_changeCount;
+}
+
+double AudioStore::GetSample(int channel, unsigned frame) {
+  StoreLock lock(m_mutex);
+  frame += m_firstFrame;
+  unsigned page = frame >> PAGE_SHIFT;
+  AudioPage &p = UsePage(page);
+  unsigned idx = channel * GetPageFrames(page) + (frame & PAGE_MASK);
+  if (m_useDoubles)
+    return p.doubles[idx];
+  return p.floats[idx];
+}
+
+void AudioStore::SetSample(int channel, unsigned frame, double value) {
+  StoreLock lock(m_mutex);
+  frame += m_firstFrame;
+  unsigned page = frame >> PAGE_SHIFT;
+  AudioPage &p = UsePage(page);
+  unsigned idx = channel * GetPageFrames(page) + (frame & PAGE_MASK);
+  if (m_useDoubles)
+    p.doubles[idx] = value;
+  else
+    p.floats[idx] = (float) value;
+  MarkPageChanged(p, frame & PAGE_MASK, 1);
+  MarkChanged();
+}
+
+void AudioStore::ReadTrack(int channel, unsigned firstFrame, unsigned nbrFrames, double *out) {
+  StoreLock lock(m_mutex);
+  ReadTrackLocked(channel, firstFrame, nbrFrames, out);
+}
+
+void AudioStore::ReadInterleaved(unsigned firstFrame, unsigned nbrFrames, double *out) {
+  ExportScaled(out, firstFrame, nbrFrames, 1.0);
+}
+
+void AudioStore::WriteInterleaved(unsigned firstFrame, unsigned nbrFrames, const double *in) {
+  ImportScaled(in, firstFrame, nbrFrames, 1.0);
+}
+
+void AudioStore::ImportInterleaved(const short *in, unsigned firstFrame, unsigned nbrFrames) {
+  ImportScaled(in, firstFrame, nbrFrames, SHORT_SCALE);
+}
+
+void AudioStore::ImportInterleaved(const int *in, unsigned firstFrame, unsigned nbrFrames) {
+  ImportScaled(in, firstFrame, nbrFrames, INT_SCALE);
+}
+
+void AudioStore::ImportInterleaved(const float *in, unsigned firstFrame, unsigned nbrFrames) {
+  ImportScaled(in, firstFrame, nbrFrames, 1.0);
+}
+
+void AudioStore::ImportInterleaved(const double *in, unsigned firstFrame, unsigned nbrFrames) {
+  ImportScaled(in, firstFrame, nbrFrames, 1.0);
+}
+
+void AudioStore::ExportInterleaved(short *out, unsigned firstFrame, unsigned nbrFrames) {
+  ExportScaled(out, firstFrame, nbrFrames, SHORT_SCALE);
+}
+
+void AudioStore::ExportInterleaved(int *out, unsigned firstFrame, unsigned nbrFrames) {
+  ExportScaled(out, firstFrame, nbrFrames, INT_SCALE);
+}
+
+void AudioStore::ExportInterleaved(float *out, unsigned firstFrame, unsigned nbrFrames) {
+  ExportScaled(out, firstFrame, nbrFrames, 1.0);
+}
+
+void AudioStore::ExportInterleaved(double *out, unsigned firstFrame, unsigned nbrFrames) {
+  ExportScaled(out, firstFrame, nbrFrames, 1.0);
+}
+
+void AudioStore::Normalize(const short *in, double *out, unsigned long count) {
+  for (unsigned long i = 0; i < count; i++)
+    out[i] = in[i] / SHORT_SCALE;
+}
+
+void AudioStore::Normalize(const int *in, double *out, unsigned long count) {
+  for (unsigned long i = 0; i < count; i++)
+    out[i] = in[i] / INT_SCALE;
+}
+
+void AudioStore::Normalize(const float *in, double *out, unsigned long count) {
+  for (unsigned long i = 0; i < count; i++)
+    out[i] = in[i];
+}
+
+void AudioStore::Normalize(const double *in, double *out, unsigned long count) {
+  for (unsigned long i = 0; i < count; i++)
+    out[i] = in[i];
+}
+
+void AudioStore::Trim(unsigned firstFrame, unsigned nbrFrames) {
+  StoreLock lock(m_mutex);
+  if (firstFrame + nbrFrames > m_frames)
+    return;
+
+  // Only the view of the stored frames changes, nothing is copied. Pages
+  // that end up completely outside of it are released right away
+  m_firstFrame += firstFrame;
+  m_frames = nbrFrames;
+  for (unsigned i = 0; i < m_pages.size(); i++) {
+    if (m_pages[i].isLoaded && !IsPageInView(i))
+      UnloadPage(i);
+  }
+  if (m_playbackPage >= 0 && !IsPageInView(m_playbackPage))
+    m_playbackPage = -1;
+  m_isModified = true;
+  m_changeCount++;
+}
+
+void AudioStore::Erase(unsigned firstFrame, unsigned nbrFrames) {
+  StoreLock lock(m_mutex);
+  if (firstFrame + nbrFrames > m_frames)
+    return;
+
+  if (firstFrame == 0)
+    Trim(nbrFrames, m_frames - nbrFrames);
+  else if (firstFrame + nbrFrames == m_frames)
+    Trim(0, firstFrame);
+  else
+    Rebuild(m_frames - nbrFrames, firstFrame, nbrFrames);
+}
+
+void AudioStore::ApplyGain(unsigned firstFrame, unsigned nbrFrames, const double *gain) {
+  StoreLock lock(m_mutex);
+  if (firstFrame + nbrFrames > m_frames)
+    return;
+
+  if (m_useDoubles)
+    ApplyGainTo<double>(firstFrame, nbrFrames, gain);
+  else
+    ApplyGainTo<float>(firstFrame, nbrFrames, gain);
+}
+
+void AudioStore::Crossfade(unsigned targetFrame, unsigned sourceFrame, unsigned nbrFrames, const double *targetGain, const double *sourceGain) {
+  StoreLock lock(m_mutex);
+  if (targetFrame + nbrFrames > m_frames || sourceFrame + nbrFrames > m_frames)
+    return;
+
+  if (m_useDoubles)
+    CrossfadeTo<double>(targetFrame, sourceFrame, nbrFrames, targetGain, sourceGain);
+  else
+    CrossfadeTo<float>(targetFrame, sourceFrame, nbrFrames, targetGain, sourceGain);
+}
+
+unsigned long AudioStore::ReadPlayback(unsigned long firstSample, unsigned long nbrSamples, float *out) {
+  StoreLock lock(m_mutex);
+  unsigned long length = GetLength();
+  if (firstSample >= length)
+    return 0;
+  nbrSamples = std::min(nbrSamples, length - firstSample);
+
+  unsigned long done = 0;
+  while (done < nbrSamples) {
+    unsigned long sample = (unsigned long) m_firstFrame * m_channels + firstSample + done;
+    unsigned page = (sample / m_channels) >> PAGE_SHIFT;
+    // the page currently played back is kept loaded so that the next block
+    // doesn't have to be read from the source again
+    m_playbackPage = page;
+    AudioPage &p = UsePage(page);
+    unsigned pageFrames = GetPageFrames(page);
+    size_t oldBytes = p.playback.size() * sizeof(float);
+    UpdatePagePlayback(p, pageFrames);
+    m_loadedBytes += p.playback.size() * sizeof(float) - oldBytes;
+
+    unsigned long offset = sample - ((unsigned long) page << PAGE_SHIFT) * m_channels;
+    unsigned long count = std::min(nbrSamples - done, (unsigned long) pageFrames * m_channels - offset);
+    std::copy(p.playback.begin() + offset, p.playback.begin() + offset + count, out + done);
+    done += count;
+  }
+  return nbrSamples;
+}
+
+void AudioStore::InvalidateViews() {
+  StoreLock lock(m_mutex);
+  for (unsigned i = 0; i < m_pages.size(); i++)
+    m_pages[i].playbackIsValid = false;
+}
+
+void AudioStore::SetMemoryBudget(unsigned megabytes) {
+  s_memoryBudget = (size_t) megabytes * 1024 * 1024;
+}
+
+unsigned AudioStore::GetMemoryBudget() {
+  return s_memoryBudget / (1024 * 1024);
+}
+
+size_t AudioStore::GetRequiredBytes(int channels, unsigned frames, bool useDoubles) {
+  return (size_t) frames * channels * (useDoubles ? sizeof(double) : sizeof(float));
+}
+
+unsigned AudioStore::GetPageFrames(unsigned page) {
+  if (page == (m_storedFrames - 1) >> PAGE_SHIFT)
+    return m_storedFrames - (page << PAGE_SHIFT);
+  return PAGE_FRAMES;
+}
+
+bool AudioStore::IsPageInView(unsigned page) {
+  unsigned pageStart = page << PAGE_SHIFT;
+  return m_frames > 0 && pageStart < m_firstFrame + m_frames && pageStart + GetPageFrames(page) > m_firstFrame;
+}
+
+size_t AudioStore::GetPageBytes(unsigned page) {
+  return GetRequiredBytes(m_channels, GetPageFrames(page), m_useDoubles);
+}
+
+AudioStore::AudioPage &AudioStore::UsePage(unsigned page) {
+  AudioPage &p = m_pages[page];
+  p.lastUse = ++m_useCounter;
+  if (!p.isLoaded) {
+    LoadPage(page);
+    EvictPages(page);
+  }
+  return p;
+}
+
+void AudioStore::LoadPage(unsigned page) {
+  AudioPage &p = m_pages[page];
+  unsigned pageFrames = GetPageFrames(page);
+  unsigned long pageLength = (unsigned long) pageFrames * m_channels;
+  if (m_useDoubles)
+    p.doubles.assign(pageLength, 0.0);
+  else
+    p.floats.assign(pageLength, 0.0f);
+
+  if (m_source) {
+    std::vector<double> frames(pageLength, 0.0);
+    m_source->ReadPage(page << PAGE_SHIFT, pageFrames, &frames[0]);
+    if (m_useDoubles)
+      DeinterleaveSamples(&frames[0], pageFrames, m_channels, &p.doubles[0], pageFrames, 1.0);
+    else
+      DeinterleaveSamples(&frames[0], pageFrames, m_channels, &p.floats[0], pageFrames, 1.0);
+  }
+  p.isLoaded = true;
+  p.isDirty = false;
+  p.playbackIsValid = false;
+  m_loadedBytes += GetPageBytes(page);
+}
+
+void AudioStore::UnloadPage(unsigned page) {
+  AudioPage &p = m_pages[page];
+  m_loadedBytes -= GetPageBytes(page) + p.playback.size() * sizeof(float);
+  std::vector<float>().swap(p.floats);
+  std::vector<double>().swap(p.doubles);
+  std::vector<float>().swap(p.playback);
+  p.isLoaded = false;
+  p.playbackIsValid = false;
+}
+
+void AudioStore::EvictPages(unsigned pageInUse) {
+  // pages can only be dropped if they can be read again from the source
+  if (m_source == NULL)
+    return;
+
+  while (m_loadedBytes > s_memoryBudget) {
+    long victim = -1;
+    for (unsigned i = 0; i < m_pages.size(); i++) {
+      const AudioPage &p = m_pages[i];
+      if (!p.isLoaded || p.isDirty || i == pageInUse || (long) i == m_playbackPage)
+        continue;
+      if (victim < 0 || p.lastUse < m_pages[victim].lastUse)
+        victim = i;
+    }
+    if (victim < 0)
+      break;
+    UnloadPage(victim);
+  }
+}
+
+void AudioStore::CreatePages(bool loaded) {
+  unsigned nbrPages = (m_storedFrames + PAGE_MASK) >> PAGE_SHIFT;
+  m_pages.assign(nbrPages, AudioPage());
+  if (loaded) {
+    for (unsigned i = 0; i < nbrPages; i++)
+      LoadPage(i);
+  }
+}
+
+void AudioStore::Rebuild(unsigned newFrames, unsigned gapAt, unsigned gapLength) {
+  // New frame f is taken from old frame f, or f + gapLength from gapAt and
+  // on. The result is always resident as the data no longer matches the
+  // source
+  std::vector<AudioPage> oldPages;
+  oldPages.swap(m_pages);
+  unsigned oldFrames = m_frames;
+  unsigned oldFirstFrame = m_firstFrame;
+  unsigned oldStoredFrames = m_storedFrames;
+  std::vector<AudioPage> newPages;
+
+  m_frames = m_storedFrames = newFrames;
+  m_firstFrame = 0;
+  unsigned nbrPages = (newFrames + PAGE_MASK) >> PAGE_SHIFT;
+  newPages.assign(nbrPages, AudioPage());
+  std::vector<double> track;
+  size_t newBytes = 0;
+  for (unsigned page = 0; page < nbrPages; page++) {
+    unsigned pageFrames = GetPageFrames(page);
+    unsigned pageStart = page << PAGE_SHIFT;
+    AudioPage &p = newPages[page];
+    if (m_useDoubles)
+      p.doubles.resize((unsigned long) pageFrames * m_channels);
+    else
+      p.floats.resize((unsigned long) pageFrames * m_channels);
+    p.isLoaded = true;
+    p.isDirty = true;
+    newBytes += GetPageBytes(page);
+
+    // read the old data with the old layout in place
+    m_pages.swap(oldPages);
+    m_frames = oldFrames;
+    m_firstFrame = oldFirstFrame;
+    m_storedFrames = oldStoredFrames;
+    track.resize(pageFrames);
+    for (int ch = 0; ch < m_channels; ch++) {
+      unsigned done = 0;
+      while (done < pageFrames) {
+        unsigned f = pageStart + done;
+        unsigned count = pageFrames - done;
+        unsigned oldFrame;
+        if (f < gapAt) {
+          oldFrame = f;
+          count = std::min(count, gapAt - f);
+        } else {
+          oldFrame = f + gapLength;
+        }
+        ReadTrackLocked(ch, oldFrame, count, &track[done]);
+        done += count;
+      }
+      unsigned long offset = (unsigned long) ch * pageFrames;
+      for (unsigned i = 0; i < pageFrames; i++) {
+        if (m_useDoubles)
+          p.doubles[offset + i] = track[i];
+        else
+          p.floats[offset + i] = (float) track[i];
+      }
+    }
+    m_pages.swap(oldPages);
+    m_frames = m_storedFrames = newFrames;
+    m_firstFrame = 0;
+  }
+
+  m_pages.swap(newPages);
+  m_source = NULL;
+  m_isModified = true;
+  m_changeCount++;
+  m_loadedBytes = newBytes;
+  m_playbackPage = -1;
+}
+
+void AudioStore::ReadTrackLocked(int channel, unsigned firstFrame, unsigned nbrFrames, double *out) {
+  unsigned done = 0;
+  while (done < nbrFrames) {
+    unsigned frame = m_firstFrame + firstFrame + done;
+    unsigned page = frame >> PAGE_SHIFT;
+    unsigned offset = frame & PAGE_MASK;
+    unsigned pageFrames = GetPageFrames(page);
+    unsigned count = std::min(nbrFrames - done, pageFrames - offset);
+    AudioPage &p = UsePage(page);
+    unsigned long start = (unsigned long) channel * pageFrames + offset;
+    if (m_useDoubles) {
+      const double *src = &p.doubles[start];
+      for (unsigned i = 0; i < count; i++)
+        out[done + i] = src[i];
+    } else {
+      const float *src = &p.floats[start];
+      for (unsigned i = 0; i < count; i++)
+        out[done + i] = src[i];
+    }
+    done += count;
+  }
+}
+
+void AudioStore::UpdatePagePlayback(AudioPage &page, unsigned pageFrames) {
+  if (!page.playbackIsValid) {
+    page.playback.resize((unsigned long) pageFrames * m_channels);
+    page.playbackDirtyStart = 0;
+    page.playbackDirtyEnd = pageFrames;
+  }
+  unsigned first = page.playbackDirtyStart;
+  if (first < page.playbackDirtyEnd) {
+    unsigned count = page.playbackDirtyEnd - first;
+    float *dst = &page.playback[(unsigned long) first * m_channels];
+    if (m_useDoubles)
+      InterleaveSamples(&page.doubles[first], pageFrames, count, m_channels, dst, 1.0);
+    else
+      InterleaveSamples(&page.floats[first], pageFrames, count, m_channels, dst, 1.0);
+  }
+  page.playbackDirtyStart = page.playbackDirtyEnd = 0;
+  page.playbackIsValid = true;
+}
+
+void AudioStore::MarkPageChanged(AudioPage &page, unsigned offset, unsigned nbrFrames) {
+  page.isDirty = true;
+  if (!page.playbackIsValid)
+    return;
+
+  if (page.playbackDirtyStart == page.playbackDirtyEnd) {
+    page.playbackDirtyStart = offset;
+    page.playbackDirtyEnd = offset + nbrFrames;
+  } else {
+    page.playbackDirtyStart = std::min(page.playbackDirtyStart, offset);
+    page.playbackDirtyEnd = std::max(page.playbackDirtyEnd, offset + nbrFrames);
+  }
+}
+
+void AudioStore::MarkChanged() {
+  m_isModified = true;
+  m_changeCount++;
+}
+
+template <>
+float *AudioStore::GetTrackData<float>(AudioPage &page) {
+  return &page.floats[0];
+}
+
+template <>
+double *AudioStore::GetTrackData<double>(AudioPage &page) {
+  return &page.doubles[0];
+}
+
+template <typename U>
+void AudioStore::ApplyGainTo(unsigned firstFrame, unsigned nbrFrames, const double *gain) {
+  unsigned done = 0;
+  while (done < nbrFrames) {
+    unsigned frame = m_firstFrame + firstFrame + done;
+    unsigned page = frame >> PAGE_SHIFT;
+    unsigned offset = frame & PAGE_MASK;
+    unsigned pageFrames = GetPageFrames(page);
+    unsigned count = std::min(nbrFrames - done, pageFrames - offset);
+    AudioPage &p = UsePage(page);
+    U *data = GetTrackData<U>(p) + offset;
+    for (int ch = 0; ch < m_channels; ch++)
+      ScaleTrack(data + (unsigned long) ch * pageFrames, gain + done, count);
+    MarkPageChanged(p, offset, count);
+    done += count;
+  }
+  MarkChanged();
+}
+
+template <typename U>
+void AudioStore::CrossfadeTo(unsigned targetFrame, unsigned sourceFrame, unsigned nbrFrames, const double *targetGain, const double *sourceGain) {
+  unsigned done = 0;
+  while (done < nbrFrames) {
+    unsigned target = m_firstFrame + targetFrame + done;
+    unsigned source = m_firstFrame + sourceFrame + done;
+    unsigned targetPage = target >> PAGE_SHIFT;
+    unsigned sourcePage = source >> PAGE_SHIFT;
+    unsigned targetOffset = target & PAGE_MASK;
+    unsigned sourceOffset = source & PAGE_MASK;
+    unsigned targetPageFrames = GetPageFrames(targetPage);
+    unsigned sourcePageFrames = GetPageFrames(sourcePage);
+    unsigned count = std::min(nbrFrames - done, std::min(targetPageFrames - targetOffset, sourcePageFrames - sourceOffset));
+    // a dirty target page can't be evicted when the source page is loaded
+    AudioPage &t = UsePage(targetPage);
+    t.isDirty = true;
+    AudioPage &s = UsePage(sourcePage);
+    U *targetData = GetTrackData<U>(t) + targetOffset;
+    const U *sourceData = GetTrackData<U>(s) + sourceOffset;
+    for (int ch = 0; ch < m_channels; ch++) {
+      MixTrack(targetData + (unsigned long) ch * targetPageFrames, sourceData + (unsigned long) ch * sourcePageFrames,
+               targetGain + done, sourceGain + done, count);
+    }
+    MarkPageChanged(t, targetOffset, count);
+    done += count;
+  }
+  MarkChanged();
+}
+
+template <typename T>
+void AudioStore::ImportScaled(const T *in, unsigned firstFrame, unsigned nbrFrames, double scale) {
+  StoreLock lock(m_mutex);
+  double factor = 1.0 / scale;
+  unsigned done = 0;
+  while (done < nbrFrames) {
+    unsigned frame = m_firstFrame + firstFrame + done;
+    unsigned page = frame >> PAGE_SHIFT;
+    unsigned offset = frame & PAGE_MASK;
+    unsigned pageFrames = GetPageFrames(page);
+    unsigned count = std::min(nbrFrames - done, pageFrames - offset);
+    AudioPage &p = UsePage(page);
+    const T *src = in + (unsigned long) done * m_channels;
+    if (m_useDoubles)
+      DeinterleaveSamples(src, count, m_channels, &p.doubles[offset], pageFrames, factor);
+    else
+      DeinterleaveSamples(src, count, m_channels, &p.floats[offset], pageFrames, factor);
+    MarkPageChanged(p, offset, count);
+    done += count;
+  }
+  MarkChanged();
+}
+
+template <typename T>
+void AudioStore::ExportScaled(T *out, unsigned firstFrame, unsigned nbrFrames, double scale) {
+  StoreLock lock(m_mutex);
+  unsigned done = 0;
+  while (done < nbrFrames) {
+    unsigned frame = m_firstFrame + firstFrame + done;
+    unsigned page = frame >> PAGE_SHIFT;
+    unsigned offset = frame & PAGE_MASK;
+    unsigned pageFrames = GetPageFrames(page);
+    unsigned count = std::min(nbrFrames - done, pageFrames - offset);
+    AudioPage &p = UsePage(page);
+    T *dst = out + (unsigned long) done * m_channels;
+    if (m_useDoubles)
+      InterleaveSamples(&p.doubles[offset], pageFrames, count, m_channels, dst, scale);
+    else
+      InterleaveSamples(&p.floats[offset], pageFrames, count, m_channels, dst, scale);
+    done += count;
+  }
+}
@@ -0,0 +1,192 @@
+/*
+ * AudioStore.h is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+#ifndef AUDIOSTORE_H
+#define AUDIOSTORE_H
+
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <cstddef>
+
+/*
+ * AudioPageSource is implemented by whatever can deliver the audio data of
+ * a file on demand. Frames are returned interleaved and normalized to the
+ * -1.0 to 1.0 range.
+ */
+class AudioPageSource {
+public:
+  virtual ~AudioPageSource() {}
+  virtual unsigned ReadPage(unsigned firstFrame, unsigned nbrFrames, double *out) = 0;
+};
+
+/*
+ * AudioStore holds the one canonical copy of the audio data of a file as
+ * de-interleaved (planar) tracks, normalized to the -1.0 to 1.0 range.
+ * Samples are kept as floats unless double precision is requested, which is
+ * needed to represent 32 bit integer and 64 bit float files losslessly.
+ * Everything else (interleaved floats for playback and the native sample
+ * format used when writing) is derived from these tracks when needed.
+ *
+ * The tracks are split into pages of a fixed number of frames. When a page
+ * source is attached the pages are only loaded when they are accessed and the
+ * least recently used ones are evicted again to stay within the memory
+ * budget. Modified pages are kept until the source is detached. All access
+ * is serialized so the playback feeder can read while the GUI thread works.
+ */
+class AudioStore {
+public:
+  AudioStore();
+  ~AudioStore();
+
+  // Resident store, all pages are allocated (and zeroed) at once
+  void Allocate(int channels, unsigned frames, bool useDoubles);
+  // Paged store, the pages are read from source when needed
+  void AttachSource(int channels, unsigned frames, bool useDoubles, AudioPageSource *source);
+  // Load everything that is still missing and stop using the source
+  void DetachSource();
+  // Continue paging from a new source with exactly the same content as the
+  // store (like a file it was just saved to)
+  void ReplaceSource(AudioPageSource *source);
+  void Release();
+
+  int GetChannels();
+  unsigned GetFrames();
+  unsigned long GetLength(); // number of samples in all channels together
+  bool HasDoublePrecision();
+  bool IsEmpty();
+  bool IsPaged();
+  size_t GetLoadedBytes();
+  // Whether the audio data has been changed since ClearModified was called
+  bool IsModified();
+  void ClearModified();
+  // Increases with every change of the audio data (including a new file or
+  // a trim), for caching results derived from it
+  unsigned long GetChangeCount();
+
+  double GetSample(int channel, unsigned frame);
+  void SetSample(int channel, unsigned frame, double value);
+  void ReadTrack(int channel, unsigned firstFrame, unsigned nbrFrames, double *out);
+  void ReadInterleaved(unsigned firstFrame, unsigned nbrFrames, double *out);
+  void WriteInterleaved(unsigned firstFrame, unsigned nbrFrames, const double *in);
+
+  // Conversion to/from the native (interleaved) sample formats of files
+  void ImportInterleaved(const short *in, unsigned firstFrame, unsigned nbrFrames);
+  void ImportInterleaved(const int *in, unsigned firstFrame, unsigned nbrFrames);
+  void ImportInterleaved(const float *in, unsigned firstFrame, unsigned nbrFrames);
+  void ImportInterleaved(const double *in, unsigned firstFrame, unsigned nbrFrames);
+  void ExportInterleaved(short *out, unsigned firstFrame, unsigned nbrFrames);
+  void ExportInterleaved(int *out, unsigned firstFrame, unsigned nbrFrames);
+  void ExportInterleaved(float *out, unsigned firstFrame, unsigned nbrFrames);
+  void ExportInterleaved(double *out, unsigned firstFrame, unsigned nbrFrames);
+
+  // Same scaling as used by the import functions, for page sources
+  static void Normalize(const short *in, double *out, unsigned long count);
+  static void Normalize(const int *in, double *out, unsigned long count);
+  static void Normalize(const float *in, double *out, unsigned long count);
+  static void Normalize(const double *in, double *out, unsigned long count);
+
+  // Multiply nbrFrames of all channels with gain (one value per frame)
+  void ApplyGain(unsigned firstFrame, unsigned nbrFrames, const double *gain);
+  // Replace nbrFrames of all channels from targetFrame on with the mix of
+  // themselves and the frames from sourceFrame on, frame by frame in order
+  void Crossfade(unsigned targetFrame, unsigned sourceFrame, unsigned nbrFrames, const double *targetGain, const double *sourceGain);
+
+  // Keep only nbrFrames starting at firstFrame, this just narrows the view
+  // of the stored frames without copying anything
+  void Trim(unsigned firstFrame, unsigned nbrFrames);
+  // Remove nbrFrames starting at firstFrame
+  void Erase(unsigned firstFrame, unsigned nbrFrames);
+
+  // Copy up to nbrSamples interleaved floats from firstSample on (counted as
+  // in the interleaved data) to out, returns the number copied. The floats
+  // are converted a page at a time and kept with the page, the caller only
+  // ever gets its own copy so that edits can't change what it's reading
+  unsigned long ReadPlayback(unsigned long firstSample, unsigned long nbrSamples, float *out);
+  // Changes made through this class only update the affected ranges of the
+  // playback floats, this is for forcing them to be converted again
+  void InvalidateViews();
+
+  // Memory that paged stores may use, in megabytes
+  static void SetMemoryBudget(unsigned megabytes);
+  static unsigned GetMemoryBudget();
+  // Bytes needed to keep a file of this size completely in memory
+  static size_t GetRequiredBytes(int channels, unsigned frames, bool useDoubles);
+
+private:
+  struct AudioPage {
+    AudioPage() : isLoaded(false), isDirty(false), playbackIsValid(false), playbackDirtyStart(0), playbackDirtyEnd(0), lastUse(0) {}
+    // planar, channel c starts at c * (frames in page)
+    std::vector<float> floats;
+    std::vector<double> doubles;
+    std::vector<float> playback;
+    bool isLoaded;
+    bool isDirty;
+    bool playbackIsValid;
+    // frames of a valid playback buffer that must be converted again
+    unsigned playbackDirtyStart;
+    unsigned playbackDirtyEnd;
+    unsigned long lastUse;
+  };
+
+  int m_channels;
+  unsigned m_frames;
+  // the frames in use start at m_firstFrame of the m_storedFrames in pages
+  unsigned m_firstFrame;
+  unsigned m_storedFrames;
+  bool m_useDoubles;
+  std::vector<AudioPage> m_pages;
+  AudioPageSource *m_source;
+  size_t m_loadedBytes;
+  unsigned long m_useCounter;
+  long m_playbackPage;
+  bool m_isModified;
+  unsigned long m_changeCount;
+  std::recursive_mutex m_mutex;
+
+  static size_t s_memoryBudget;
+
+  unsigned GetPageFrames(unsigned page);
+  bool IsPageInView(unsigned page);
+  size_t GetPageBytes(unsigned page);
+  AudioPage &UsePage(unsigned page);
+  void LoadPage(unsigned page);
+  void UnloadPage(unsigned page);
+  void EvictPages(unsigned pageInUse);
+  void CreatePages(bool loaded);
+  void Rebuild(unsigned newFrames, unsigned gapAt, unsigned gapLength);
+  void ReadTrackLocked(int channel, unsigned firstFrame, unsigned nbrFrames, double *out);
+  void UpdatePagePlayback(AudioPage &page, unsigned pageFrames);
+  void MarkPageChanged(AudioPage &page, unsigned offset, unsigned nbrFrames);
+  void MarkChanged();
+
+  template <typename U>
+  U *GetTrackData(AudioPage &page);
+  template <typename U>
+  void ApplyGainTo(unsigned firstFrame, unsigned nbrFrames, const double *gain);
+  template <typename U>
+  void CrossfadeTo(unsigned targetFrame, unsigned sourceFrame, unsigned nbrFrames, const double *targetGain, const double *sourceGain);
+  template <typename T>
+  void ImportScaled(const T *in, unsigned firstFrame, unsigned nbrFrames, double scale);
+  template <typename T>
+  void ExportScaled(T *out, unsigned firstFrame, unsigned nbrFrames, double scale);
+};
+
+#endif
@@ -26,12 +26,15 @@ IMPLEMENT_CLASS(AutoLoopDialog, wxDialog )
 BEGIN_EVENT_TABLE(AutoLoopDialog, wxDialog)
   EVT_CHECKBOX(ID_SEARCH_CHECK, AutoLoopDialog::OnAutosearchCheck)
   EVT_CHECKBOX(ID_BRUTE_FORCE_CHECK, AutoLoopDialog::OnBruteForceCheck)
+  EVT_CHECKBOX(ID_CORRELATION_CHECK, AutoLoopDialog::OnCorrelationCheck)
+  EVT_CHECKBOX(ID_COARSE_SEARCH_CHECK, AutoLoopDialog::OnCoarseSearchCheck)
   EVT_SLIDER(ID_SUSTAINSTART, AutoLoopDialog::OnStartSliderMove)
   EVT_SLIDER(ID_SUSTAINEND, AutoLoopDialog::OnEndSliderMove)
   EVT_SLIDER(ID_THRESHOLD, AutoLoopDialog::OnThresholdSlider)
   EVT_SLIDER(ID_DURATION, AutoLoopDialog::OnDurationSlider)
   EVT_SLIDER(ID_BETWEEN, AutoLoopDialog::OnBetweenSlider)
   EVT_SLIDER(ID_QUALITY, AutoLoopDialog::OnQuality)
+  EVT_SLIDER(ID_CORRELATION_WINDOW, AutoLoopDialog::OnCorrelationWindowSlider)
 END_EVENT_TABLE()
 
 AutoLoopDialog::AutoLoopDialog() {
@@ -62,6 +65,9 @@ void AutoLoopDialog::Init() {
   m_startPercentage = 200;
   m_endPercentage = 700;
   m_searchBruteForce = false;
+  m_scoreByCorrelation = false;
+  m_correlationWindow = 0.02;
+  m_coarseSearch = false;
 }
 
 bool AutoLoopDialog::Create( 
@@ -396,6 +402,66 @@ void AutoLoopDialog::CreateControls() {
   );
   eighthRow->Add(multipleSlider, 1, wxALIGN_CENTER_VERTICAL|wxALL, 0);
 
+  // Horizontal sizer for ninth row
+  wxBoxSizer *ninthRow = new wxBoxSizer(wxHORIZONTAL);
+  boxSizer->Add(ninthRow, 0, wxGROW|wxALL, 5);
+
+  // Checkbox for scoring loops by correlation over a window
+  wxCheckBox *correlationCheck = new wxCheckBox(
+    this,
+    ID_CORRELATION_CHECK,
+    wxT("Score loops by correlation over a window"),
+    wxDefaultPosition,
+    wxDefaultSize
+  );
+  correlationCheck->SetValue(false);
+  ninthRow->Add(correlationCheck, 1, wxGROW|wxALL, 2);
+
+  // Horizontal sizer for tenth row
+  wxBoxSizer *tenthRow = new wxBoxSizer(wxHORIZONTAL);
+  boxSizer->Add(tenthRow, 0, wxGROW|wxALL, 5);
+
+  // Label for the correlation window
+  m_windowLabel = new wxStaticText ( 
+    this, 
+    wxID_STATIC,
+    wxEmptyString, 
+    wxDefaultPosition, 
+    wxSize(220,-1), 
+    0 
+  );
+  m_windowLabel->SetLabel(wxString::Format(wxT("Correlation window: %.0f ms"), m_correlationWindow * 1000));
+  tenthRow->Add(m_windowLabel, 0, wxALIGN_CENTER_VERTICAL|wxALL, 0);
+
+  // A slider for the correlation window in ms
+  wxSlider *windowSlider = new wxSlider ( 
+    this, 
+    ID_CORRELATION_WINDOW,
+    20,
+    10,
+    50,
+    wxDefaultPosition, 
+    wxDefaultSize, 
+    wxSL_HORIZONTAL
+  );
+  tenthRow->Add(windowSlider, 1, wxALIGN_CENTER_VERTICAL|wxALL, 0);
+  windowSlider->Enable(false);
+
+  // Horizontal sizer for eleventh row
+  wxBoxSizer *eleventhRow = new wxBoxSizer(wxHORIZONTAL);
+  boxSizer->Add(eleventhRow, 0, wxGROW|wxALL, 5);
+
+  // Checkbox for searching a decimated copy of the sustain section first
+  wxCheckBox *coarseCheck = new wxCheckBox(
+    this,
+    ID_COARSE_SEARCH_CHECK,
+    wxT("Search a decimated copy first (coarse to fine)"),
+    wxDefaultPosition,
+    wxDefaultSize
+  );
+  coarseCheck->SetValue(false);
+  eleventhRow->Add(coarseCheck, 1, wxGROW|wxALL, 2);
+
   // A horizontal line before the OK and Cancel buttons
   wxStaticLine *line = new wxStaticLine(
     this, 
@@ -487,6 +553,15 @@ void AutoLoopDialog::SetBruteForce(bool b) {
   else
     m_searchBruteForce = false;
 }
+void AutoLoopDialog::SetCorrelation(bool c) {
+  m_scoreByCorrelation = c;
+}
+void AutoLoopDialog::SetCorrelationWindow(double w) {
+  m_correlationWindow = w;
+}
+void AutoLoopDialog::SetCoarseSearch(bool c) {
+  m_coarseSearch = c;
+}
 double AutoLoopDialog::GetThreshold() {
   return m_threshold;
 }
@@ -520,6 +595,15 @@ int AutoLoopDialog::GetEnd() {
 bool AutoLoopDialog::GetBruteForce() {
   return m_searchBruteForce;
 }
+bool AutoLoopDialog::GetCorrelation() {
+  return m_scoreByCorrelation;
+}
+double AutoLoopDialog::GetCorrelationWindow() {
+  return m_correlationWindow;
+}
+bool AutoLoopDialog::GetCoarseSearch() {
+  return m_coarseSearch;
+}
 
 // Override of transfer data to the window
 bool AutoLoopDialog::TransferDataToWindow() {
@@ -534,9 +618,15 @@ bool AutoLoopDialog::TransferDataToWindow() {
   wxSlider *candidatesSl = (wxSlider*) FindWindow(ID_CANDIDATES);
   wxSlider *loopsSl = (wxSlider*) FindWindow(ID_NR_LOOPS);
   wxSlider *multipleSl = (wxSlider*) FindWindow(ID_LOOP_MULTIPLE);
+  wxCheckBox *correlationCheck = (wxCheckBox*) FindWindow(ID_CORRELATION_CHECK);
+  wxSlider *windowSl = (wxSlider*) FindWindow(ID_CORRELATION_WINDOW);
+  wxCheckBox *coarseCheck = (wxCheckBox*) FindWindow(ID_COARSE_SEARCH_CHECK);
 
   autoCheck->SetValue(m_autoSearchSustain);
   bruteCheck->SetValue(m_searchBruteForce);
+  correlationCheck->SetValue(m_scoreByCorrelation);
+  windowSl->Enable(m_scoreByCorrelation);
+  coarseCheck->SetValue(m_coarseSearch);
   startSl->SetValue(m_startPercentage);
   m_startLabel->SetLabel(wxString::Format(wxT("Sustain start at: %.1f %%"), (float) m_startPercentage / 10.0));
   endSl->SetValue(m_endPercentage);
@@ -553,6 +643,8 @@ bool AutoLoopDialog::TransferDataToWindow() {
   betweenSl->SetValue(value);
   value = (m_quality * 10000);
   qualitySl->SetValue(value);
+  value = (m_correlationWindow * 1000 + 0.5);
+  windowSl->SetValue(value);
 
   return true;
 }
@@ -570,6 +662,9 @@ bool AutoLoopDialog::TransferDataFromWindow() {
   wxSlider *candidatesSl = (wxSlider*) FindWindow(ID_CANDIDATES);
   wxSlider *loopsSl = (wxSlider*) FindWindow(ID_NR_LOOPS);
   wxSlider *multipleSl = (wxSlider*) FindWindow(ID_LOOP_MULTIPLE);
+  wxCheckBox *correlationCheck = (wxCheckBox*) FindWindow(ID_CORRELATION_CHECK);
+  wxSlider *windowSl = (wxSlider*) FindWindow(ID_CORRELATION_WINDOW);
+  wxCheckBox *coarseCheck = (wxCheckBox*) FindWindow(ID_COARSE_SEARCH_CHECK);
 
   m_candidates = candidatesSl->GetValue();
   m_numberOfLoops = loopsSl->GetValue();
@@ -578,6 +673,8 @@ bool AutoLoopDialog::TransferDataFromWindow() {
   m_startPercentage = startSl->GetValue();
   m_endPercentage = endSl->GetValue();
   m_searchBruteForce = bruteCheck->GetValue();
+  m_scoreByCorrelation = correlationCheck->GetValue();
+  m_coarseSearch = coarseCheck->GetValue();
 
   double value = (double) thresholdSl->GetValue() / 1000.0;
   m_threshold = value;
@@ -587,6 +684,8 @@ bool AutoLoopDialog::TransferDataFromWindow() {
   m_betweenLoops = value;
   value = (double) qualitySl->GetValue() / 10000.0;
   m_quality = value;
+  value = (double) windowSl->GetValue() / 1000.0;
+  m_correlationWindow = value;
 
   return true;
 }
@@ -611,6 +710,18 @@ void AutoLoopDialog::OnBruteForceCheck(wxCommandEvent& WXUNUSED(event)) {
   m_searchBruteForce = bruteCheck->GetValue();
 }
 
+void AutoLoopDialog::OnCorrelationCheck(wxCommandEvent& WXUNUSED(event)) {
+  wxCheckBox *correlationCheck = (wxCheckBox*) FindWindow(ID_CORRELATION_CHECK);
+  wxSlider *windowSl = (wxSlider*) FindWindow(ID_CORRELATION_WINDOW);
+  m_scoreByCorrelation = correlationCheck->GetValue();
+  windowSl->Enable(m_scoreByCorrelation);
+}
+
+void AutoLoopDialog::OnCoarseSearchCheck(wxCommandEvent& WXUNUSED(event)) {
+  wxCheckBox *coarseCheck = (wxCheckBox*) FindWindow(ID_COARSE_SEARCH_CHECK);
+  m_coarseSearch = coarseCheck->GetValue();
+}
+
 void AutoLoopDialog::OnStartSliderMove(wxCommandEvent& WXUNUSED(event)) {
   wxSlider *startSl = (wxSlider*) FindWindow(ID_SUSTAINSTART);
   int value = startSl->GetValue();
@@ -669,6 +780,15 @@ void AutoLoopDialog::OnQuality(wxCommandEvent& WXUNUSED(event)) {
   m_qualityLabel->SetLabel(wxString::Format(wxT("Max difference allowed: %.4f"), m_quality));
 }
 
+void AutoLoopDialog::OnCorrelationWindowSlider(wxCommandEvent& WXUNUSED(event)) {
+  wxSlider *windowSl = (wxSlider*) FindWindow(ID_CORRELATION_WINDOW);
+
+  double value = (double) windowSl->GetValue() / 1000.0;
+  m_correlationWindow = value;
+
+  m_windowLabel->SetLabel(wxString::Format(wxT("Correlation window: %.0f ms"), m_correlationWindow * 1000));
+}
+
 void AutoLoopDialog::UpdateLabels() {
   m_startLabel->SetLabel(wxString::Format(wxT("Sustain start at: %.1f %%"), (float) m_startPercentage / 10.0));
   m_endLabel->SetLabel(wxString::Format(wxT("Sustain end at: %.1f %%"), (float) m_endPercentage / 10.0));
@@ -676,4 +796,5 @@ void AutoLoopDialog::UpdateLabels() {
   m_durationLabel->SetLabel(wxString::Format(wxT("Min. loop lenght: %.2f s"), m_minDuration));
   m_distanceLabel->SetLabel(wxString::Format(wxT("Min. time between loops: %.2f s"), m_betweenLoops));
   m_qualityLabel->SetLabel(wxString::Format(wxT("Max difference allowed: %.4f"), m_quality));
+  m_windowLabel->SetLabel(wxString::Format(wxT("Correlation window: %.0f ms"), m_correlationWindow * 1000));
 }
@@ -35,7 +35,10 @@ enum {
   ID_SEARCH_CHECK = wxID_HIGHEST + 307,
   ID_SUSTAINSTART = wxID_HIGHEST + 308,
   ID_SUSTAINEND = wxID_HIGHEST + 309,
-  ID_BRUTE_FORCE_CHECK = wxID_HIGHEST + 310
+  ID_BRUTE_FORCE_CHECK = wxID_HIGHEST + 310,
+  ID_CORRELATION_CHECK = wxID_HIGHEST + 311,
+  ID_CORRELATION_WINDOW = wxID_HIGHEST + 312,
+  ID_COARSE_SEARCH_CHECK = wxID_HIGHEST + 313
 };
 
 class AutoLoopDialog : public wxDialog {
@@ -82,6 +85,9 @@ public:
   void SetStart(int start);
   void SetEnd(int end);
   void SetBruteForce(bool b);
+  void SetCorrelation(bool c);
+  void SetCorrelationWindow(double w);
+  void SetCoarseSearch(bool c);
   double GetThreshold();
   double GetDuration();
   double GetBetween();
@@ -93,6 +99,9 @@ public:
   int GetStart();
   int GetEnd();
   bool GetBruteForce();
+  bool GetCorrelation();
+  double GetCorrelationWindow();
+  bool GetCoarseSearch();
 
   // Overrides
   bool TransferDataToWindow();
@@ -101,12 +110,15 @@ public:
   // Event processing methods (for label updates)
   void OnAutosearchCheck(wxCommandEvent& event);
   void OnBruteForceCheck(wxCommandEvent& event);
+  void OnCorrelationCheck(wxCommandEvent& event);
+  void OnCoarseSearchCheck(wxCommandEvent& event);
   void OnStartSliderMove(wxCommandEvent& event);
   void OnEndSliderMove(wxCommandEvent& event);
   void OnThresholdSlider(wxCommandEvent& event);
   void OnDurationSlider(wxCommandEvent& event);
   void OnBetweenSlider(wxCommandEvent& event);
   void OnQuality(wxCommandEvent& event);
+  void OnCorrelationWindowSlider(wxCommandEvent& event);
 
   // Update labels
   void UpdateLabels();
@@ -123,6 +135,9 @@ private:
   int m_startPercentage; // 20% but value at a factor of 10 to get higher precision
   int m_endPercentage; // 70% but value at a factor of 10 to get higher precision
   bool m_searchBruteForce;
+  bool m_scoreByCorrelation;
+  double m_correlationWindow; // 0.02 seconds
+  bool m_coarseSearch;
 
   // GUI controls
   wxStaticText *m_thresholdLabel;
@@ -131,6 +146,7 @@ private:
   wxStaticText *m_endLabel;
   wxStaticText *m_qualityLabel;
   wxStaticText *m_distanceLabel;
+  wxStaticText *m_windowLabel;
 };
 
 #endif
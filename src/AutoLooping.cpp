@@ -19,8 +19,40 @@
  */
 
 #include "AutoLooping.h"
+#include "SampleKernels.h"
+#include "ThreadPool.h"
+#include "LoopCorrelator.h"
+#include <algorithm>
 #include <cmath>
 
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Start point candidates searched at a time by each worker when not using
+// brute force
+static const unsigned STARTS_PER_WORKER = 4;
+
+// Margin for rounding when comparing frame sums with the quality factor
+static const double FRAME_SUM_MARGIN = 1e-9;
+
+// The decimated copy of the coarse search has at least this sample rate,
+// and its low pass filter has this many zero crossings on each side
+static const unsigned COARSE_SAMPLERATE = 11025;
+static const unsigned COARSE_FILTER_ZEROS = 4;
+// The coarse loops may differ this many times the quality factor, as the
+// loop points are only known to within the decimation factor there
+static const double COARSE_QUALITY_TOLERANCE = 4.0;
+
+// Sum of the frames that are compared by the loop quality when a loop ends
+// at frame (that is, frames up to and including it)
+static double FrameSum(const double *data, unsigned frame) {
+  double sum = 0;
+  for (unsigned j = 0; j < LOOP_QUALITY_FRAMES; j++)
+    sum += data[frame + 1 - LOOP_QUALITY_FRAMES + j];
+  return sum;
+}
+
 AutoLooping::AutoLooping(
     double threshold,
     double minLoopDuration,
@@ -37,6 +69,9 @@ AutoLooping::AutoLooping(
   m_loopsToReturn = loopsToReturn;
   m_maxLoopsMultiple = maxLoopsMultiple;
   m_useBruteForce = false;
+  m_useCorrelation = false;
+  m_correlationWindow = 0.02;
+  m_useCoarseSearch = false;
 }
 
 AutoLooping::~AutoLooping() {
@@ -69,8 +104,31 @@ bool AutoLooping::AutoFindLoops(
     }
   }
 
-  double *data = new double[audioFile->ArrayLength / audioFile->m_channels];
-  audioFile->SeparateStrongestChannel(data);
+  // Only the sustain section of the strongest channel is read, with a margin
+  // for the frames compared before the loop points and the coarse filter.
+  // All frame indexes of the search are relative to the first frame read
+  // and are converted back when the loops are compared and stored
+  unsigned nbrFrames = audioFile->ArrayLength / audioFile->m_channels;
+  if (nbrFrames == 0)
+    return false;
+  unsigned windowLength = samplerate * m_correlationWindow + 0.5;
+  unsigned margin = LOOP_QUALITY_FRAMES;
+  if (m_useCorrelation)
+    margin = std::max(margin, windowLength);
+  if (m_useCoarseSearch)
+    margin = std::max(margin, COARSE_FILTER_ZEROS * std::max(2u, samplerate / COARSE_SAMPLERATE));
+  unsigned firstFrame = sustainStartIdx > margin ? sustainStartIdx - margin : 0;
+  unsigned lastFrame = std::min(sustainEndIdx + margin, nbrFrames - 1);
+  if (sustainEndIdx > lastFrame)
+    sustainEndIdx = lastFrame;
+  if (sustainStartIdx >= sustainEndIdx)
+    return false;
+  std::vector<double> channel(lastFrame - firstFrame + 1);
+  audioFile->ReadStrongestChannel(firstFrame, channel.size(), &channel[0]);
+  const double *data = &channel[0];
+  sustainStartIdx -= firstFrame;
+  sustainEndIdx -= firstFrame;
+
   // we find maximum derivative in audio data which is where the
   // waveform will change the most (the opposite of what we're interested in)
   double maxDerivative = 0;
@@ -85,6 +143,12 @@ bool AutoLooping::AutoFindLoops(
       maxDerivative = currentDerivative;
   }
 
+  // with the coarse search only the frames close to the loops found in a
+  // decimated copy of the sustain section can be candidates
+  std::vector<char> isPromising;
+  if (m_useCoarseSearch)
+    FindCoarseRegions(data, channel.size(), sustainStartIdx, sustainEndIdx, samplerate, isPromising);
+
   // since we're interested in sections where the waveform doesn't change a lot
   // we now add all indexes with a derivative below the derivativeThreshold to 
   // the every candidate vector
@@ -95,15 +159,15 @@ bool AutoLooping::AutoFindLoops(
     i < sustainEndIdx - 1;
     i++) {
 
+    if (m_useCoarseSearch && !isPromising[i - sustainStartIdx])
+      continue;
+
     double currentDerivative = fabs( (data[i + 1] - data[i]) );
 
     if (currentDerivative < derivativeThreshold)
       everyLoopCandidates.push_back(i);
   }
 
-  // we're done with the single channel data
-  delete[] data;
-
   // first get all loops already in file
   std::vector<std::pair<unsigned, unsigned> > loopsAlreadyInFile;
   for (int i = 0; i < audioFile->m_loops->GetNumberOfLoops(); i++) {
@@ -143,36 +207,88 @@ bool AutoLooping::AutoFindLoops(
   if (loopCandidates.empty() == true) {
     return false;
   }
-  for (unsigned i = 0; i < loopCandidates.size() - 1; i++) {
-    // this is for the start point
-    unsigned loopStartIndex = loopCandidates[i];
-    if (loopStartIndex < 4)
-      continue;
-
-    // if loop start point is too close to already stored loop continue
-    if (!foundLoops.empty()) {
-      if (
-        (loopStartIndex - foundLoops.back().first.first) < 
-        (samplerate * m_distanceBetweenLoops) && !m_useBruteForce
-      ) {
-        continue;
-      }
+  // all compared frames are copied once instead of read for every pair
+  audioFile->PrepareLoopQualityWindow(
+    firstFrame + (loopCandidates.front() < LOOP_QUALITY_FRAMES ? 0 : loopCandidates.front() - LOOP_QUALITY_FRAMES),
+    firstFrame + loopCandidates.back()
+  );
+  // The quality of a loop can't be better than the difference between the
+  // sums of the compared frames of one channel. So only the end points with
+  // a sum within the quality factor of the start point's can make a good
+  // enough loop, and they are looked up by the sum instead of trying all
+  std::vector<std::pair<double, unsigned> > endPointIndex;
+  for (unsigned j = 0; j < loopCandidates.size(); j++) {
+    if (loopCandidates[j] + 1 >= LOOP_QUALITY_FRAMES)
+      endPointIndex.push_back(std::make_pair(FrameSum(data, loopCandidates[j]), j));
+  }
+  std::sort(endPointIndex.begin(), endPointIndex.end());
+  // When scoring by correlation the windows before all the end point
+  // candidates are prepared once for every start point
+  LoopCorrelator *correlator = NULL;
+  if (m_useCorrelation && windowLength > 0 && loopCandidates.back() + 1 >= windowLength) {
+    correlator = new LoopCorrelator(
+      data,
+      std::max(loopCandidates.front(), windowLength - 1),
+      loopCandidates.back(),
+      windowLength
+    );
+  }
+  // The end point that matches a start point doesn't depend on the loops
+  // found before it, only whether the start point is used at all does. So
+  // the matches of a chunk of start points are searched for in parallel and
+  // then taken in order with the same rules as when going one by one, which
+  // gives exactly the same loops. Without brute force only a few start points
+  // per worker are searched at a time as a found loop makes the following
+  // ones too close to be used
+  ThreadPool *pool = ThreadPool::GetShared();
+  unsigned nbrStarts = loopCandidates.size() - 1;
+  unsigned chunkSize = m_useBruteForce ? nbrStarts : pool->GetWorkerCount() * STARTS_PER_WORKER;
+  std::vector<std::pair<unsigned, double> > matches(chunkSize);
+  std::vector<char> isSkipped(chunkSize);
+  std::vector<CorrelationScratch> scratch(pool->GetWorkerCount());
+  if (correlator) {
+    for (unsigned i = 0; i < scratch.size(); i++)
+      scratch[i].work.resize(correlator->GetWorkSize());
+  }
+  bool enoughLoopsFound = false;
+  for (unsigned chunkStart = 0; chunkStart < nbrStarts && !enoughLoopsFound; chunkStart += chunkSize) {
+    unsigned chunkEnd = std::min(chunkStart + chunkSize, nbrStarts);
+
+    // start points that are too close to the last found loop already will
+    // be skipped anyway
+    for (unsigned i = chunkStart; i < chunkEnd; i++) {
+      isSkipped[i - chunkStart] = loopCandidates[i] < 4 || (
+        !foundLoops.empty() &&
+        (loopCandidates[i] + firstFrame - foundLoops.back().first.first) < (samplerate * m_distanceBetweenLoops) &&
+        !m_useBruteForce
+      );
     }
 
-    // and now compare to end point candidates and we go from back to get the
-    // longest possible loops first
-    for (unsigned j = loopCandidates.size() - 1; j > i + 1; j--) {
-      unsigned loopEndIndex = loopCandidates[j];
-      
-      // check if the endpoint is too close to startpoint
-      if (loopEndIndex - loopStartIndex < samplerate * m_minLoopDuration)
+    pool->Run(chunkEnd - chunkStart, [&](unsigned task, unsigned worker) {
+      if (!isSkipped[task])
+        matches[task] = FindLoopEnd(audioFile, data, firstFrame, loopCandidates, endPointIndex, chunkStart + task, samplerate, correlator, scratch[worker]);
+    });
+
+    for (unsigned i = chunkStart; i < chunkEnd; i++) {
+      // this is for the start point
+      unsigned loopStartIndex = loopCandidates[i] + firstFrame;
+      if (loopCandidates[i] < 4)
         continue;
 
-      // the end of a wave file loop should be compared against the sample just before start
-      // now comes the actual comparison of the candidates
-      double correlationValue = audioFile->GetLoopQuality(loopStartIndex, loopEndIndex);
-      // if the quality of the correlation is better (lower) than threshold add the loop
-      if (correlationValue <= m_qualityFactor) {
+      // if loop start point is too close to already stored loop continue
+      if (!foundLoops.empty()) {
+        if (
+          (loopStartIndex - foundLoops.back().first.first) < 
+          (samplerate * m_distanceBetweenLoops) && !m_useBruteForce
+        ) {
+          continue;
+        }
+      }
+
+      // the longest loop from this start point with good enough quality
+      if (matches[i - chunkStart].first) {
+        unsigned loopEndIndex = loopCandidates[matches[i - chunkStart].first] + firstFrame;
+        double correlationValue = matches[i - chunkStart].second;
         // make sure the loop doesn't already exist in file, or that it's too close to an existing!
         bool loopAlreadyExist = false;
         for (unsigned k = 0; k < loopsAlreadyInFile.size(); k++) {
@@ -202,13 +318,16 @@ bool AutoLooping::AutoFindLoops(
             )
           );
         }
+      }
+      // if enough loops to select from are found we abort
+      if ((foundLoops.size() > m_loopsToReturn * m_maxLoopsMultiple - 1) && !m_useBruteForce) {
+        enoughLoopsFound = true;
         break;
       }
     }
-    // if enough loops to select from are found we abort
-    if ((foundLoops.size() > m_loopsToReturn * m_maxLoopsMultiple - 1) && !m_useBruteForce)
-      break;
   }
+  audioFile->ReleaseLoopQualityWindow();
+  delete correlator;
 
   // for easy handling the found loops vector should be sorted by quality
   // which will be done by searching for the best and exchange places so that
@@ -322,6 +441,184 @@ bool AutoLooping::AutoFindLoops(
   }
 }
 
+void AutoLooping::FindCoarseRegions(
+  const double *data,
+  unsigned nbrFrames,
+  unsigned sustainStart,
+  unsigned sustainEnd,
+  unsigned samplerate,
+  std::vector<char> &isPromising) {
+
+  isPromising.assign(sustainEnd - sustainStart, 0);
+  unsigned factor = std::max(2u, samplerate / COARSE_SAMPLERATE);
+  unsigned nbrCoarse = (sustainEnd - sustainStart) / factor;
+  if (nbrCoarse <= LOOP_QUALITY_FRAMES + 2)
+    return;
+
+  // Hann windowed sinc low pass filter just below the Nyquist frequency of
+  // the decimated copy
+  int halfLength = COARSE_FILTER_ZEROS * factor;
+  std::vector<double> filter(2 * halfLength + 1);
+  double cutoff = 0.45 / factor;
+  double filterSum = 0;
+  for (int n = -halfLength; n <= halfLength; n++) {
+    double x = 2 * M_PI * cutoff * n;
+    double sinc = n == 0 ? 1.0 : sin(x) / x;
+    double window = 0.5 + 0.5 * cos(M_PI * n / (halfLength + 1));
+    filter[n + halfLength] = sinc * window;
+    filterSum += sinc * window;
+  }
+  for (unsigned n = 0; n < filter.size(); n++)
+    filter[n] /= filterSum;
+
+  // the coarse frame k is at frame sustainStart + k * factor
+  std::vector<double> coarse(nbrCoarse);
+  for (unsigned k = 0; k < nbrCoarse; k++) {
+    int center = sustainStart + k * factor;
+    double value = 0;
+    for (int n = -halfLength; n <= halfLength; n++) {
+      int frame = std::min(std::max(center + n, 0), (int) nbrFrames - 1);
+      value += data[frame] * filter[n + halfLength];
+    }
+    coarse[k] = value;
+  }
+
+  // the candidates are chosen the same way as at full sample rate
+  double maxDerivative = 0;
+  for (unsigned k = 0; k < nbrCoarse - 1; k++)
+    maxDerivative = std::max(maxDerivative, fabs(coarse[k + 1] - coarse[k]));
+  double derivativeThreshold = maxDerivative * m_derivativeThreshold;
+  std::vector<unsigned> everyCandidate;
+  for (unsigned k = LOOP_QUALITY_FRAMES; k < nbrCoarse - 1; k++) {
+    if (fabs(coarse[k + 1] - coarse[k]) < derivativeThreshold)
+      everyCandidate.push_back(k);
+  }
+  std::vector<unsigned> candidates;
+  if (everyCandidate.size() > m_maxCandidates) {
+    double increment = (double) everyCandidate.size() / (double) m_maxCandidates;
+    for (unsigned i = 0; i < m_maxCandidates; i++)
+      candidates.push_back(everyCandidate[(unsigned) (i * increment)]);
+  } else {
+    candidates.swap(everyCandidate);
+  }
+  if (candidates.size() < 2)
+    return;
+
+  // every start is matched with every end that's good enough, looked up by
+  // the frame sums like at full sample rate
+  double limit = m_qualityFactor * COARSE_QUALITY_TOLERANCE;
+  std::vector<std::pair<double, unsigned> > endPointIndex;
+  for (unsigned j = 0; j < candidates.size(); j++)
+    endPointIndex.push_back(std::make_pair(FrameSum(&coarse[0], candidates[j]), j));
+  std::sort(endPointIndex.begin(), endPointIndex.end());
+
+  ThreadPool *pool = ThreadPool::GetShared();
+  std::vector<std::vector<char> > isCoarseLoopPoint(pool->GetWorkerCount(), std::vector<char>(nbrCoarse));
+  pool->Run(candidates.size() - 1, [&](unsigned i, unsigned worker) {
+    unsigned start = candidates[i];
+    double startSum = FrameSum(&coarse[0], start - 1);
+    std::vector<std::pair<double, unsigned> >::const_iterator it = std::lower_bound(
+      endPointIndex.begin(),
+      endPointIndex.end(),
+      std::make_pair(startSum - limit - FRAME_SUM_MARGIN, 0u)
+    );
+    for (; it != endPointIndex.end() && it->first <= startSum + limit + FRAME_SUM_MARGIN; ++it) {
+      if (it->second <= i)
+        continue;
+      unsigned end = candidates[it->second];
+      if ((end - start) * factor < samplerate * m_minLoopDuration)
+        continue;
+      if (LoopQuality(&coarse[0], 0, 1, start, end, limit) <= limit) {
+        isCoarseLoopPoint[worker][start] = 1;
+        isCoarseLoopPoint[worker][end] = 1;
+      }
+    }
+  });
+
+  // the loop points at full sample rate are somewhere around the coarse ones
+  for (unsigned k = 0; k < nbrCoarse; k++) {
+    bool isLoopPoint = false;
+    for (unsigned w = 0; w < isCoarseLoopPoint.size(); w++) {
+      if (isCoarseLoopPoint[w][k])
+        isLoopPoint = true;
+    }
+    if (!isLoopPoint)
+      continue;
+    unsigned first = k * factor > factor ? k * factor - factor : 0;
+    unsigned last = std::min(k * factor + factor, (unsigned) isPromising.size() - 1);
+    for (unsigned i = first; i <= last; i++)
+      isPromising[i] = 1;
+  }
+}
+
+std::pair<unsigned, double> AutoLooping::FindLoopEnd(
+  FileHandling *audioFile,
+  const double *data,
+  unsigned firstFrame,
+  const std::vector<unsigned> &loopCandidates,
+  const std::vector<std::pair<double, unsigned> > &endPointIndex,
+  unsigned startCandidate,
+  unsigned samplerate,
+  const LoopCorrelator *correlator,
+  CorrelationScratch &scratch) {
+
+  std::pair<unsigned, double> match(0, 0.0);
+  unsigned loopStartIndex = loopCandidates[startCandidate];
+  if (loopStartIndex < LOOP_QUALITY_FRAMES)
+    return match;
+  if (correlator && loopStartIndex < correlator->GetWindowLength())
+    return match;
+  scratch.endCandidates.clear();
+
+  // the end of a wave file loop should be compared against the sample just
+  // before start, and of the possible end points the last one that is good
+  // enough gives the longest loop
+  double startSum = FrameSum(data, loopStartIndex - 1);
+  std::vector<std::pair<double, unsigned> >::const_iterator it = std::lower_bound(
+    endPointIndex.begin(),
+    endPointIndex.end(),
+    std::make_pair(startSum - m_qualityFactor - FRAME_SUM_MARGIN, 0u)
+  );
+  for (; it != endPointIndex.end() && it->first <= startSum + m_qualityFactor + FRAME_SUM_MARGIN; ++it) {
+    unsigned j = it->second;
+    if (j <= startCandidate + 1 || (j <= match.first && !correlator))
+      continue;
+    unsigned loopEndIndex = loopCandidates[j];
+
+    // check if the endpoint is too close to startpoint
+    if (loopEndIndex - loopStartIndex < samplerate * m_minLoopDuration)
+      continue;
+
+    // now comes the actual comparison of the candidates
+    double correlationValue = audioFile->GetLoopQuality(firstFrame + loopStartIndex, firstFrame + loopEndIndex, m_qualityFactor);
+    // if the quality of the correlation is better (lower) than threshold it's a match
+    if (correlationValue <= m_qualityFactor) {
+      if (correlator)
+        scratch.endCandidates.push_back(j);
+      else
+        match = std::make_pair(j, correlationValue);
+    }
+  }
+  if (!correlator || scratch.endCandidates.empty())
+    return match;
+
+  // the windows before the good enough end points are all correlated with
+  // the window before the start at once, and the best one is used
+  std::vector<unsigned> &endCandidates = scratch.endCandidates;
+  std::sort(endCandidates.begin(), endCandidates.end());
+  scratch.ends.resize(endCandidates.size());
+  scratch.correlations.resize(endCandidates.size());
+  for (unsigned k = 0; k < endCandidates.size(); k++)
+    scratch.ends[k] = loopCandidates[endCandidates[k]];
+  correlator->Correlate(loopStartIndex, &scratch.ends[0], scratch.ends.size(), &scratch.correlations[0], &scratch.work[0]);
+  unsigned best = 0;
+  for (unsigned k = 1; k < endCandidates.size(); k++) {
+    if (scratch.correlations[k] >= scratch.correlations[best])
+      best = k;
+  }
+  return std::make_pair(endCandidates[best], 1.0 - scratch.correlations[best]);
+}
+
 void AutoLooping::SetThreshold(double th) {
   m_derivativeThreshold = th;
 }
@@ -388,3 +685,27 @@ unsigned AutoLooping::GetLoopMultiple() {
 bool AutoLooping::GetBruteForce() {
   return m_useBruteForce;
 }
+
+void AutoLooping::SetCorrelation(bool c) {
+  m_useCorrelation = c;
+}
+
+void AutoLooping::SetCorrelationWindow(double w) {
+  m_correlationWindow = w;
+}
+
+bool AutoLooping::GetCorrelation() {
+  return m_useCorrelation;
+}
+
+double AutoLooping::GetCorrelationWindow() {
+  return m_correlationWindow;
+}
+
+void AutoLooping::SetCoarseSearch(bool c) {
+  m_useCoarseSearch = c;
+}
+
+bool AutoLooping::GetCoarseSearch() {
+  return m_useCoarseSearch;
+}
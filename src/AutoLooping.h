@@ -24,6 +24,8 @@
 #include <vector>
 #include "FileHandling.h"
 
+class LoopCorrelator;
+
 class AutoLooping {
 public:
   // the constructor sets up the general settings for loopfinding
@@ -56,6 +58,9 @@ public:
   void SetLoops(int l);
   void SetMultiple(int m);
   void SetBruteForce(bool b);
+  void SetCorrelation(bool c);
+  void SetCorrelationWindow(double w);
+  void SetCoarseSearch(bool c);
 
   double GetThreshold();
   double GetMinDuration();
@@ -65,6 +70,9 @@ public:
   unsigned GetLoopsToReturn();
   unsigned GetLoopMultiple();
   bool GetBruteForce();
+  bool GetCorrelation();
+  double GetCorrelationWindow();
+  bool GetCoarseSearch();
 
 private:
   double m_derivativeThreshold;  // 0.03 (3 %)
@@ -75,6 +83,48 @@ private:
   unsigned m_loopsToReturn;      // 6
   unsigned m_maxLoopsMultiple;   // 10
   bool m_useBruteForce;
+  bool m_useCorrelation;         // score loops by correlation over a window
+  double m_correlationWindow;    // 0.02 seconds
+  bool m_useCoarseSearch;        // search a decimated copy first
+
+  // Scratch data of each worker when scoring by correlation
+  struct CorrelationScratch {
+    std::vector<unsigned> endCandidates;
+    std::vector<unsigned> ends;
+    std::vector<double> correlations;
+    std::vector<double> work;
+  };
+
+  // Marks the frames of the sustain section from sustainStart to sustainEnd
+  // that are close to the start or end of a loop found in a decimated and
+  // low pass filtered copy of it
+  void FindCoarseRegions(
+    const double *data,
+    unsigned nbrFrames,
+    unsigned sustainStart,
+    unsigned sustainEnd,
+    unsigned samplerate,
+    std::vector<char> &isPromising
+  );
+
+  // Index of the last end point candidate that makes a good enough loop with
+  // the start point candidate and the quality of it, 0 if there's none. The
+  // end point index holds the frame sums of data at the end point candidates
+  // with their indexes, sorted by the sums. Data and the candidates start at
+  // firstFrame of the file. With a correlator the end point of the good
+  // enough loops that correlates best is returned instead, with one minus
+  // the correlation as the quality
+  std::pair<unsigned, double> FindLoopEnd(
+    FileHandling *audioFile,
+    const double *data,
+    unsigned firstFrame,
+    const std::vector<unsigned> &loopCandidates,
+    const std::vector<std::pair<double, unsigned> > &endPointIndex,
+    unsigned startCandidate,
+    unsigned samplerate,
+    const LoopCorrelator *correlator,
+    CorrelationScratch &scratch
+  );
 };
 
 #endif
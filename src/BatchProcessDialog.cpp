@@ -436,7 +436,7 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
         for (unsigned i = 0; i < filesToProcess.GetCount(); i++) {
           m_statusProgress->AppendText(filesToProcess.Item(i));
           m_statusProgress->AppendText(wxT("\n"));
-          FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue());
+          FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue(), true);
           if (fh.FileCouldBeOpened()) {
             m_statusProgress->AppendText(wxT("\tFile opened.\n"));
             if (fh.m_loops->GetNumberOfLoops() > 0) {
@@ -462,7 +462,7 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
         for (unsigned i = 0; i < filesToProcess.GetCount(); i++) {
           m_statusProgress->AppendText(filesToProcess.Item(i));
           m_statusProgress->AppendText(wxT("\n"));
-          FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue());
+          FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue(), true);
           if (fh.FileCouldBeOpened()) {
             m_statusProgress->AppendText(wxT("\tFile opened.\n"));
             if (fh.m_cues->GetNumberOfCues() > 0) {
@@ -488,7 +488,7 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
         for (unsigned i = 0; i < filesToProcess.GetCount(); i++) {
           m_statusProgress->AppendText(filesToProcess.Item(i));
           m_statusProgress->AppendText(wxT("\n"));
-          FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue());
+          FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue(), true);
           if (fh.FileCouldBeOpened()) {
             m_statusProgress->AppendText(wxT("\tFile opened.\n"));
             fh.m_loops->SetMIDIUnityNote(0);
@@ -512,7 +512,7 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
         for (unsigned i = 0; i < filesToProcess.GetCount(); i++) {
           m_statusProgress->AppendText(filesToProcess.Item(i));
           m_statusProgress->AppendText(wxT("\n"));
-          FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue());
+          FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue(), true);
           if (fh.FileCouldBeOpened()) {
             m_statusProgress->AppendText(wxT("\tFile opened.\n"));
             if (fh.m_loops->GetNumberOfLoops() > 0) {
@@ -549,6 +549,9 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
       autoloop->SetLoops(m_loopSettings->GetNrLoops());
       autoloop->SetMultiple(m_loopSettings->GetMultiple());
       autoloop->SetBruteForce(m_loopSettings->GetBruteForce());
+      autoloop->SetCorrelation(m_loopSettings->GetCorrelation());
+      autoloop->SetCorrelationWindow(m_loopSettings->GetCorrelationWindow());
+      autoloop->SetCoarseSearch(m_loopSettings->GetCoarseSearch());
 
       if (!filesToProcess.IsEmpty()) {
         for (unsigned i = 0; i < filesToProcess.GetCount(); i++) {
@@ -644,8 +647,8 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
             m_statusProgress->AppendText(wxT("\tFile opened.\n"));
 
             // autosearch pitch and calculate midi note and pitch fraction
-            double fftPitches[3];
-            for (int j = 0; j < 3; j++)
+            double fftPitches[4];
+            for (int j = 0; j < 4; j++)
               fftPitches[j] = 0;
             fh.GetFFTPitch(fftPitches);
             int midi_note = (69 + 12 * (log10(fftPitches[0] / 440.0) / log10(2)));
@@ -687,8 +690,8 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
           if (fh.FileCouldBeOpened()) {
 
             // autosearch pitch and calculate midi note and pitch fraction
-            double fftPitches[3];
-            for (int j = 0; j < 3; j++)
+            double fftPitches[4];
+            for (int j = 0; j < 4; j++)
               fftPitches[j] = 0;
             fh.GetFFTPitch(fftPitches);
             int midi_note = (69 + 12 * (log10(fftPitches[0] / 440.0) / log10(2)));
@@ -728,8 +731,8 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
             m_statusProgress->AppendText(wxT("\tFile opened.\n"));
 
             // autosearch pitch and calculate midi note and pitch fraction
-            double fftPitches[3];
-            for (int j = 0; j < 3; j++)
+            double fftPitches[4];
+            for (int j = 0; j < 4; j++)
               fftPitches[j] = 0;
             fh.GetFFTPitch(fftPitches);
             int midi_note = (69 + 12 * (log10(fftPitches[1] / 440.0) / log10(2)));
@@ -771,8 +774,8 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
           if (fh.FileCouldBeOpened()) {
 
             // autosearch pitch and calculate midi note and pitch fraction
-            double fftPitches[3];
-            for (int j = 0; j < 3; j++)
+            double fftPitches[4];
+            for (int j = 0; j < 4; j++)
               fftPitches[j] = 0;
             fh.GetFFTPitch(fftPitches);
             int midi_note = (69 + 12 * (log10(fftPitches[1] / 440.0) / log10(2)));
@@ -905,7 +908,7 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
         for (unsigned i = 0; i < filesToProcess.GetCount(); i++) {
           m_statusProgress->AppendText(filesToProcess.Item(i));
           m_statusProgress->AppendText(wxT("\n"));
-          FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue());
+          FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue(), true);
           if (fh.FileCouldBeOpened()) {
             // get pitch info and calculate resulting pitch frequency
             double cents = (double) fh.m_loops->GetMIDIPitchFraction() / (double)UINT_MAX * 100.0;
@@ -949,7 +952,7 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
           m_statusProgress->AppendText(wxT("\n"));
           m_statusProgress->AppendText(wxT("\n"));
           for (unsigned i = 0; i < filesToProcess.GetCount(); i++) {
-            FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue());
+            FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue(), true);
             if (fh.FileCouldBeOpened()) {
               wxString currentFileName = filesToProcess.Item(i);
               wxString midiNrStr = currentFileName.Mid(0, 3);
@@ -1012,7 +1015,7 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
         for (unsigned i = 0; i < filesToProcess.GetCount(); i++) {
           m_statusProgress->AppendText(filesToProcess.Item(i));
           m_statusProgress->AppendText(wxT("\n"));
-          FileHandling sourceFile(filesToProcess.Item(i), m_sourceField->GetValue());
+          FileHandling sourceFile(filesToProcess.Item(i), m_sourceField->GetValue(), true);
           if (sourceFile.FileCouldBeOpened()) {
             // get pitch info from the source file
             unsigned int pitchFraction = sourceFile.m_loops->GetMIDIPitchFraction();
@@ -1020,7 +1023,7 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
             double cents = (double) pitchFraction / (double)UINT_MAX * 100.0;
 
             // try to open a corresponding target file
-            FileHandling targetFile(filesToProcess.Item(i), m_targetField->GetValue());
+            FileHandling targetFile(filesToProcess.Item(i), m_targetField->GetValue(), true);
             if (targetFile.FileCouldBeOpened()) {
               // set midi note and pitch fraction to target file
               targetFile.m_loops->SetMIDIUnityNote((char) midiNote);
@@ -1057,7 +1060,7 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
           int lastMidiNr = 0;
           int pipeNr = 0;
           for (unsigned i = 0; i < filesToProcess.GetCount(); i++) {
-            FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue());
+            FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue(), true);
             // get midi number from file name
             wxString currentFileName = filesToProcess.Item(i);
             wxString midiNrStr = currentFileName.Mid(0, 3);
@@ -1422,7 +1425,7 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
         wxString comm;
         wxDateTime cr_dt;
         // we must actually open the first file to be able to create list info dialog
-        FileHandling *first = new FileHandling(filesToProcess.Item(0), m_sourceField->GetValue());
+        FileHandling *first = new FileHandling(filesToProcess.Item(0), m_sourceField->GetValue(), true);
         if (first->FileCouldBeOpened()) {
           // create the list info dialog
           ListInfoDialog infoDlg(first, this);
@@ -1460,7 +1463,7 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
         
         // now we'll fill all the files with the set LIST INFO strings
         for (unsigned i = 0; i < filesToProcess.GetCount(); i++) {
-          FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue());
+          FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue(), true);
           if (fh.FileCouldBeOpened()) {
             // set info strings
             fh.m_info.artist = art;
@@ -1499,7 +1502,7 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
           tsvFile->Write(wxTextFile::GetEOL(wxTextFileType_Dos));
           for (unsigned i = 0; i < filesToProcess.GetCount(); i++) {
 
-            FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue());
+            FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue(), true);
             if (fh.FileCouldBeOpened()) {
               // get pitch info and calculate resulting pitch frequency
               double cents = (double) fh.m_loops->GetMIDIPitchFraction() / (double)UINT_MAX * 100.0;
@@ -1542,7 +1545,7 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
           tsvFile->Write(wxTextFile::GetEOL(wxTextFileType_Dos));
           for (unsigned i = 0; i < filesToProcess.GetCount(); i++) {
 
-            FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue());
+            FileHandling fh(filesToProcess.Item(i), m_sourceField->GetValue(), true);
             if (fh.FileCouldBeOpened() && fh.m_loops->GetNumberOfLoops() > 0) {
               for (int j = 0; j < fh.m_loops->GetNumberOfLoops(); j++) {
                 LOOPDATA loop;
@@ -1577,10 +1580,10 @@ void BatchProcessDialog::OnRunBatch(wxCommandEvent& WXUNUSED(event)) {
         for (unsigned i = 0; i < filesToProcess.GetCount(); i++) {
           m_statusProgress->AppendText(filesToProcess.Item(i));
           m_statusProgress->AppendText(wxT("\n"));
-          FileHandling sourceFile(filesToProcess.Item(i), m_sourceField->GetValue());
+          FileHandling sourceFile(filesToProcess.Item(i), m_sourceField->GetValue(), true);
           if (sourceFile.FileCouldBeOpened() && sourceFile.m_loops->GetNumberOfLoops() > 0) {
             // try to open a corresponding target file
-            FileHandling targetFile(filesToProcess.Item(i), m_targetField->GetValue());
+            FileHandling targetFile(filesToProcess.Item(i), m_targetField->GetValue(), true);
             if (targetFile.FileCouldBeOpened()) {
               // copy loop(s) to target file if they would be valid
               unsigned nbrLoopsCopied = 0;
@@ -45,85 +45,28 @@
 #include <math.h>
 
 #include "FFT.h"
+#include "FFTPlan.h"
+#include <map>
+#include <vector>
+#include <mutex>
 
-int **gFFTBitTable = NULL;
-const int MaxFastBits = 16;
+static std::map<std::pair<int, int>, std::vector<double>*> gWindowTables;
+static std::mutex gWindowTablesMutex;
 
-/* Declare Static functions */
-static int IsPowerOfTwo(int x);
-static int NumberOfBitsNeeded(int PowerOfTwo);
-static int ReverseBits(int index, int NumBits);
-static void InitFFT();
-
-int IsPowerOfTwo(int x)
-{
-   if (x < 2)
-      return false;
-
-   if (x & (x - 1))             /* Thanks to 'byang' for this cute trick! */
-      return false;
-
-   return true;
-}
-
-int NumberOfBitsNeeded(int PowerOfTwo)
-{
-   int i;
-
-   if (PowerOfTwo < 2) {
-      fprintf(stderr, "Error: FFT called with size %d\n", PowerOfTwo);
-      exit(1);
-   }
-
-   for (i = 0;; i++)
-      if (PowerOfTwo & (1 << i))
-         return i;
-}
-
-int ReverseBits(int index, int NumBits)
-{
-   int i, rev;
-
-   for (i = rev = 0; i < NumBits; i++) {
-      rev = (rev << 1) | (index & 1);
-      index >>= 1;
-   }
-
-   return rev;
-}
-
-void InitFFT()
-{
-   gFFTBitTable = new int *[MaxFastBits];
-
-   int len = 2;
-   for (int b = 1; b <= MaxFastBits; b++) {
-
-      gFFTBitTable[b - 1] = new int[len];
-
-      for (int i = 0; i < len; i++)
-         gFFTBitTable[b - 1][i] = ReverseBits(i, b);
-
-      len <<= 1;
-   }
-}
+/*
+ * The transforms themselves are done by FFTPlan, these functions only
+ * keep the original interface. The plans for each size are shared.
+ */
 
 void DeinitFFT()
 {
-   if (gFFTBitTable) {
-      for (int b = 1; b <= MaxFastBits; b++) {
-         delete[] gFFTBitTable[b-1];
-      }
-      delete[] gFFTBitTable;
-   }
-}
+   FFTPlan::ReleasePlans();
 
-inline int FastReverseBits(int i, int NumBits)
-{
-   if (NumBits <= MaxFastBits)
-      return gFFTBitTable[NumBits - 1][i];
-   else
-      return ReverseBits(i, NumBits);
+   std::lock_guard<std::mutex> lock(gWindowTablesMutex);
+   std::map<std::pair<int, int>, std::vector<double>*>::iterator it;
+   for (it = gWindowTables.begin(); it != gWindowTables.end(); ++it)
+      delete it->second;
+   gWindowTables.clear();
 }
 
 /*
@@ -134,163 +77,24 @@ void FFT(int NumSamples,
          bool InverseTransform,
          double *RealIn, double *ImagIn, double *RealOut, double *ImagOut)
 {
-   int NumBits;                 /* Number of bits needed to store indices */
-   int i, j, k, n;
-   int BlockSize, BlockEnd;
-
-   double angle_numerator = 2.0 * M_PI;
-   double tr, ti;                /* temp real, temp imaginary */
-
-   if (!IsPowerOfTwo(NumSamples)) {
-      fprintf(stderr, "%d is not a power of two\n", NumSamples);
-      exit(1);
-   }
-
-   if (!gFFTBitTable)
-      InitFFT();
-
-   if (!InverseTransform)
-      angle_numerator = -angle_numerator;
-
-   NumBits = NumberOfBitsNeeded(NumSamples);
-
-   /*
-    **   Do simultaneous data copy and bit-reversal ordering into outputs...
-    */
-
-   for (i = 0; i < NumSamples; i++) {
-      j = FastReverseBits(i, NumBits);
-      RealOut[j] = RealIn[i];
-      ImagOut[j] = (ImagIn == NULL) ? 0.0 : ImagIn[i];
-   }
-
-   /*
-    **   Do the FFT itself...
-    */
-
-   BlockEnd = 1;
-   for (BlockSize = 2; BlockSize <= NumSamples; BlockSize <<= 1) {
-
-      double delta_angle = angle_numerator / (double) BlockSize;
-
-      double sm2 = sin(-2 * delta_angle);
-      double sm1 = sin(-delta_angle);
-      double cm2 = cos(-2 * delta_angle);
-      double cm1 = cos(-delta_angle);
-      double w = 2 * cm1;
-      double ar0, ar1, ar2, ai0, ai1, ai2;
-
-      for (i = 0; i < NumSamples; i += BlockSize) {
-         ar2 = cm2;
-         ar1 = cm1;
-
-         ai2 = sm2;
-         ai1 = sm1;
-
-         for (j = i, n = 0; n < BlockEnd; j++, n++) {
-            ar0 = w * ar1 - ar2;
-            ar2 = ar1;
-            ar1 = ar0;
-
-            ai0 = w * ai1 - ai2;
-            ai2 = ai1;
-            ai1 = ai0;
-
-            k = j + BlockEnd;
-            tr = ar0 * RealOut[k] - ai0 * ImagOut[k];
-            ti = ar0 * ImagOut[k] + ai0 * RealOut[k];
-
-            RealOut[k] = RealOut[j] - tr;
-            ImagOut[k] = ImagOut[j] - ti;
-
-            RealOut[j] += tr;
-            ImagOut[j] += ti;
-         }
-      }
-
-      BlockEnd = BlockSize;
-   }
-
-   /*
-      **   Need to normalize if inverse transform...
-    */
-
-   if (InverseTransform) {
-      double denom = (double) NumSamples;
-
-      for (i = 0; i < NumSamples; i++) {
-         RealOut[i] /= denom;
-         ImagOut[i] /= denom;
-      }
-   }
+   FFTPlan::GetPlan(NumSamples)->Transform(RealIn, ImagIn, RealOut, ImagOut, InverseTransform);
 }
 
 /*
  * Real Fast Fourier Transform
  *
- * This function was based on the code in Numerical Recipes in C.
- * In Num. Rec., the inner loop is based on a single 1-based array
- * of interleaved real and imaginary numbers.  Because we have two
- * separate zero-based arrays, our indices are quite different.
- * Here is the correspondence between Num. Rec. indices and our indices:
- *
- * i1  <->  real[i]
- * i2  <->  imag[i]
- * i3  <->  real[n/2-i]
- * i4  <->  imag[n/2-i]
+ * The upper half of the output is filled in from the conjugate
+ * symmetry of the spectrum of real input.
  */
 
 void RealFFT(int NumSamples, double *RealIn, double *RealOut, double *ImagOut)
 {
-   int Half = NumSamples / 2;
-   int i;
-
-   double theta = M_PI / Half;
-
-   double *tmpReal = new double[Half];
-   double *tmpImag = new double[Half];
+   FFTPlan::GetPlan(NumSamples)->RealTransform(RealIn, RealOut, ImagOut);
 
-   for (i = 0; i < Half; i++) {
-      tmpReal[i] = RealIn[2 * i];
-      tmpImag[i] = RealIn[2 * i + 1];
+   for (int i = NumSamples / 2 + 1; i < NumSamples; i++) {
+      RealOut[i] = RealOut[NumSamples - i];
+      ImagOut[i] = -ImagOut[NumSamples - i];
    }
-
-   FFT(Half, 0, tmpReal, tmpImag, RealOut, ImagOut);
-
-   double wtemp = double (sin(0.5 * theta));
-
-   double wpr = -2.0 * wtemp * wtemp;
-   double wpi = -1.0 * double (sin(theta));
-   double wr = 1.0 + wpr;
-   double wi = wpi;
-
-   int i3;
-
-   double h1r, h1i, h2r, h2i;
-
-   for (i = 1; i < Half / 2; i++) {
-
-      i3 = Half - i;
-
-      h1r = 0.5 * (RealOut[i] + RealOut[i3]);
-      h1i = 0.5 * (ImagOut[i] - ImagOut[i3]);
-      h2r = 0.5 * (ImagOut[i] + ImagOut[i3]);
-      h2i = -0.5 * (RealOut[i] - RealOut[i3]);
-
-      RealOut[i] = h1r + wr * h2r - wi * h2i;
-      ImagOut[i] = h1i + wr * h2i + wi * h2r;
-      RealOut[i3] = h1r - wr * h2r + wi * h2i;
-      ImagOut[i3] = -h1i + wr * h2i + wi * h2r;
-
-      wr = (wtemp = wr) * wpr - wi * wpi + wr;
-      wi = wi * wpr + wtemp * wpi + wi;
-   }
-
-   RealOut[0] = (h1r = RealOut[0]) + ImagOut[0];
-   ImagOut[0] = h1r - ImagOut[0];
-
-   delete[]tmpReal;
-   delete[]tmpImag;
 }
 
 /*
@@ -300,76 +104,11 @@ void RealFFT(int NumSamples, double *RealIn, double *RealOut, double *ImagOut)
  * adds the squares of the real and imaginary part of each
  * coefficient, extracting the power and throwing away the
  * phase.
- *
- * For speed, it does not call RealFFT, but duplicates some
- * of its code.
  */
 
 void PowerSpectrum(int NumSamples, double *In, double *Out)
 {
-   int Half = NumSamples / 2;
-   int i;
-
-   double theta = M_PI / Half;
-
-   double *tmpReal = new double[Half];
-   double *tmpImag = new double[Half];
-   double *RealOut = new double[Half];
-   double *ImagOut = new double[Half];
-
-   for (i = 0; i < Half; i++) {
-      tmpReal[i] = In[2 * i];
-      tmpImag[i] = In[2 * i + 1];
-   }
-
-   FFT(Half, 0, tmpReal, tmpImag, RealOut, ImagOut);
-
-   double wtemp = double (sin(0.5 * theta));
-
-   double wpr = -2.0 * wtemp * wtemp;
-   double wpi = -1.0 * double (sin(theta));
-   double wr = 1.0 + wpr;
-   double wi = wpi;
-
-   int i3;
-
-   double h1r, h1i, h2r, h2i, rt, it;
-
-   for (i = 1; i < Half / 2; i++) {
-
-      i3 = Half - i;
-
-      h1r = 0.5 * (RealOut[i] + RealOut[i3]);
-      h1i = 0.5 * (ImagOut[i] - ImagOut[i3]);
-      h2r = 0.5 * (ImagOut[i] + ImagOut[i3]);
-      h2i = -0.5 * (RealOut[i] - RealOut[i3]);
-
-      rt = h1r + wr * h2r - wi * h2i;
-      it = h1i + wr * h2i + wi * h2r;
-
-      Out[i] = rt * rt + it * it;
-
-      rt = h1r - wr * h2r + wi * h2i;
-      it = -h1i + wr * h2i + wi * h2r;
-
-      Out[i3] = rt * rt + it * it;
-
-      wr = (wtemp = wr) * wpr - wi * wpi + wr;
-      wi = wi * wpr + wtemp * wpi + wi;
-   }
-
-   rt = (h1r = RealOut[0]) + ImagOut[0];
-   it = h1r - ImagOut[0];
-   Out[0] = rt * rt + it * it;
-
-   rt = RealOut[Half / 2];
-   it = ImagOut[Half / 2];
-   Out[Half / 2] = rt * rt + it * it;
-
-   delete[]tmpReal;
-   delete[]tmpImag;
-   delete[]RealOut;
-   delete[]ImagOut;
+   FFTPlan::GetPlan(NumSamples)->PowerSpectrum(In, Out);
 }
 
 /*
@@ -485,6 +224,21 @@ void WindowFunc(int whichFunction, int NumSamples, double *in)
    }
 }
 
+const double *WindowTable(int whichFunction, int NumSamples)
+{
+   std::lock_guard<std::mutex> lock(gWindowTablesMutex);
+   std::pair<int, int> key(whichFunction, NumSamples);
+   std::map<std::pair<int, int>, std::vector<double>*>::iterator it = gWindowTables.find(key);
+   if (it != gWindowTables.end())
+      return &(*it->second)[0];
+
+   std::vector<double> *table = new std::vector<double>(NumSamples > 0 ? NumSamples : 1, 1.0);
+   if (whichFunction > 0)
+      WindowFunc(whichFunction, NumSamples, &(*table)[0]);
+   gWindowTables[key] = table;
+   return &(*table)[0];
+}
+
 // Indentation settings for Vim and Emacs and unique identifier for Arch, a
 // version control system. Please do not modify past this point.
 //
@@ -59,7 +59,8 @@
  * spectrum by doing a Real FFT and then computing the
  * sum of the squares of the real and imaginary parts.
  * Note that the output array is half the length of the
- * input array, and that NumSamples must be a power of two.
+ * input array. Any NumSamples is supported but powers of
+ * two are the fastest.
  */
 
 void PowerSpectrum(int NumSamples, double *In, double *Out);
@@ -68,7 +69,6 @@ void PowerSpectrum(int NumSamples, double *In, double *Out);
  * Computes an FFT when the input data is real but you still
  * want complex data as output.  The output arrays are the
  * same length as the input, but will be conjugate-symmetric
- * NumSamples must be a power of two.
  */
 
 void RealFFT(int NumSamples,
@@ -77,7 +77,7 @@ void RealFFT(int NumSamples,
 /*
  * Computes a FFT of complex input and returns complex output.
  * Currently this is the only function here that supports the
- * inverse transform as well.
+ * inverse transform as well. ImagIn may be NULL for real input.
  */
 
 void FFT(int NumSamples,
@@ -101,6 +101,14 @@ void FFT(int NumSamples,
 
 void WindowFunc(int whichFunction, int NumSamples, double *data);
 
+/*
+ * Returns the values of a windowing function (1.0 for all samples
+ * of the rectangular window). The table for each function and size
+ * is only calculated once and then shared until DeinitFFT.
+ */
+
+const double *WindowTable(int whichFunction, int NumSamples);
+
 /*
  * Returns the name of the windowing function (for UI display)
  */
@@ -113,6 +121,11 @@ const wxChar *WindowFuncName(int whichFunction);
 
 int NumWindowFuncs();
 
+/*
+ * Releases the shared FFT plans and window tables, no transform
+ * may be running
+ */
+
 void DeinitFFT();
 
 // Indentation settings for Vim and Emacs and unique identifier for Arch, a
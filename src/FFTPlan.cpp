@@ -0,0 +1,363 @@
+/*
+ * FFTPlan.cpp is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+#include "FFTPlan.h"
+#include <cmath>
+#include <map>
+#include <mutex>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static std::map<unsigned, FFTPlan*> s_plans;
+static std::mutex s_plansMutex;
+
+static bool IsPowerOfTwo(unsigned x) {
+  return x > 0 && (x & (x - 1)) == 0;
+}
+
+// The radix-2 butterflies of all stages, on data in bit reversed order
+static void Butterflies(double *re, double *im, unsigned n, const double *stageCos, const double *stageSin, bool inverse) {
+  double sign = inverse ? -1.0 : 1.0;
+  unsigned firstStage = 1;
+  if (n >= 4) {
+    // the first two stages only need the twiddles 1 and -i (or i for the
+    // inverse) so they are done together without any multiplications
+    for (unsigned i = 0; i < n; i += 4) {
+      double sr01 = re[i] + re[i + 1];
+      double si01 = im[i] + im[i + 1];
+      double dr01 = re[i] - re[i + 1];
+      double di01 = im[i] - im[i + 1];
+      double sr23 = re[i + 2] + re[i + 3];
+      double si23 = im[i + 2] + im[i + 3];
+      double tr = (im[i + 2] - im[i + 3]) * sign;
+      double ti = (re[i + 3] - re[i + 2]) * sign;
+      re[i] = sr01 + sr23;
+      im[i] = si01 + si23;
+      re[i + 2] = sr01 - sr23;
+      im[i + 2] = si01 - si23;
+      re[i + 1] = dr01 + tr;
+      im[i + 1] = di01 + ti;
+      re[i + 3] = dr01 - tr;
+      im[i + 3] = di01 - ti;
+    }
+    firstStage = 4;
+  }
+  for (unsigned h = firstStage; h < n; h <<= 1) {
+    const double *wr = stageCos + h - 1;
+    const double *wi = stageSin + h - 1;
+    for (unsigned i = 0; i < n; i += 2 * h) {
+      double *ar = re + i;
+      double *ai = im + i;
+      double *br = re + i + h;
+      double *bi = im + i + h;
+      unsigned j = 0;
+#ifdef __SSE2__
+      __m128d s = _mm_set1_pd(sign);
+      for (; j + 2 <= h; j += 2) {
+        __m128d c = _mm_loadu_pd(wr + j);
+        __m128d si = _mm_mul_pd(_mm_loadu_pd(wi + j), s);
+        __m128d xr = _mm_loadu_pd(br + j);
+        __m128d xi = _mm_loadu_pd(bi + j);
+        __m128d tr = _mm_sub_pd(_mm_mul_pd(c, xr), _mm_mul_pd(si, xi));
+        __m128d ti = _mm_add_pd(_mm_mul_pd(c, xi), _mm_mul_pd(si, xr));
+        __m128d yr = _mm_loadu_pd(ar + j);
+        __m128d yi = _mm_loadu_pd(ai + j);
+        _mm_storeu_pd(br + j, _mm_sub_pd(yr, tr));
+        _mm_storeu_pd(bi + j, _mm_sub_pd(yi, ti));
+        _mm_storeu_pd(ar + j, _mm_add_pd(yr, tr));
+        _mm_storeu_pd(ai + j, _mm_add_pd(yi, ti));
+      }
+#endif
+      for (; j < h; j++) {
+        double c = wr[j];
+        double si = wi[j] * sign;
+        double tr = c * br[j] - si * bi[j];
+        double ti = c * bi[j] + si * br[j];
+        br[j] = ar[j] - tr;
+        bi[j] = ai[j] - ti;
+        ar[j] += tr;
+        ai[j] += ti;
+      }
+    }
+  }
+}
+
+FFTPlan::FFTPlan(unsigned size) : m_size(size), m_isPowerOfTwo(IsPowerOfTwo(size)), m_halfPlan(NULL), m_convolutionPlan(NULL) {
+  if (m_isPowerOfTwo) {
+    CreateTables();
+
+    // real input of this size is packed into a complex transform of half
+    // the size, which itself only needs the plain complex transform
+    if (size > 2) {
+      unsigned half = size / 2;
+      m_halfPlan = new FFTPlan(half, true);
+      m_realCos.resize(half / 2 + 1);
+      m_realSin.resize(half / 2 + 1);
+      for (unsigned k = 0; k <= half / 2; k++) {
+        double angle = -2.0 * M_PI * k / size;
+        m_realCos[k] = cos(angle);
+        m_realSin[k] = sin(angle);
+      }
+    }
+  } else if (size > 0) {
+    // Bluestein, the transform is a convolution with a chirp which is done
+    // with power of two transforms of at least 2 * size - 1 points
+    unsigned convolutionSize = 1;
+    while (convolutionSize < 2 * size - 1)
+      convolutionSize <<= 1;
+    m_convolutionPlan = new FFTPlan(convolutionSize, true);
+
+    m_chirpCos.resize(size);
+    m_chirpSin.resize(size);
+    for (unsigned k = 0; k < size; k++) {
+      // k * k is reduced first to keep the angle accurate for large k
+      unsigned long long k2 = ((unsigned long long) k * k) % (2ULL * size);
+      double angle = M_PI * k2 / size;
+      m_chirpCos[k] = cos(angle);
+      m_chirpSin[k] = -sin(angle);
+    }
+
+    std::vector<double> filterReal(convolutionSize, 0.0);
+    std::vector<double> filterImag(convolutionSize, 0.0);
+    for (unsigned k = 0; k < size; k++) {
+      filterReal[k] = m_chirpCos[k];
+      filterImag[k] = -m_chirpSin[k];
+      if (k > 0) {
+        filterReal[convolutionSize - k] = filterReal[k];
+        filterImag[convolutionSize - k] = filterImag[k];
+      }
+    }
+    m_filterReal.resize(convolutionSize);
+    m_filterImag.resize(convolutionSize);
+    m_convolutionPlan->TransformPowerOfTwo(&filterReal[0], &filterImag[0], &m_filterReal[0], &m_filterImag[0], false);
+  }
+}
+
+FFTPlan::FFTPlan(unsigned size, bool) : m_size(size), m_isPowerOfTwo(true), m_halfPlan(NULL), m_convolutionPlan(NULL) {
+  CreateTables();
+}
+
+FFTPlan::~FFTPlan() {
+  delete m_halfPlan;
+  delete m_convolutionPlan;
+}
+
+void FFTPlan::CreateTables() {
+  unsigned bits = 0;
+  while ((1U << bits) < m_size)
+    bits++;
+  m_bitReversed.resize(m_size);
+  for (unsigned i = 0; i < m_size; i++) {
+    unsigned rev = 0;
+    for (unsigned b = 0, idx = i; b < bits; b++, idx >>= 1)
+      rev = (rev << 1) | (idx & 1);
+    m_bitReversed[i] = rev;
+  }
+
+  if (m_size > 1) {
+    m_stageCos.resize(m_size - 1);
+    m_stageSin.resize(m_size - 1);
+    for (unsigned h = 1; h < m_size; h <<= 1) {
+      for (unsigned j = 0; j < h; j++) {
+        double angle = -M_PI * j / h;
+        m_stageCos[h - 1 + j] = cos(angle);
+        m_stageSin[h - 1 + j] = sin(angle);
+      }
+    }
+  }
+}
+
+const FFTPlan *FFTPlan::GetPlan(unsigned size) {
+  std::lock_guard<std::mutex> lock(s_plansMutex);
+  std::map<unsigned, FFTPlan*>::iterator it = s_plans.find(size);
+  if (it != s_plans.end())
+    return it->second;
+  FFTPlan *plan = new FFTPlan(size);
+  s_plans[size] = plan;
+  return plan;
+}
+
+void FFTPlan::ReleasePlans() {
+  std::lock_guard<std::mutex> lock(s_plansMutex);
+  for (std::map<unsigned, FFTPlan*>::iterator it = s_plans.begin(); it != s_plans.end(); ++it)
+    delete it->second;
+  s_plans.clear();
+}
+
+unsigned FFTPlan::GetSize() const {
+  return m_size;
+}
+
+void FFTPlan::Transform(const double *realIn, const double *imagIn, double *realOut, double *imagOut, bool inverse) const {
+  if (m_isPowerOfTwo) {
+    TransformPowerOfTwo(realIn, imagIn, realOut, imagOut, inverse);
+  } else if (m_size > 0) {
+    std::vector<double> work(GetWorkSize());
+    TransformBluestein(realIn, imagIn, realOut, imagOut, inverse, &work[0]);
+  }
+}
+
+void FFTPlan::RealTransform(const double *in, double *realOut, double *imagOut) const {
+  if (m_halfPlan) {
+    TransformPacked(in, realOut, imagOut);
+  } else if (m_size > 0) {
+    std::vector<double> work(GetWorkSize());
+    TransformReal(in, realOut, imagOut, &work[0]);
+  }
+}
+
+void FFTPlan::PowerSpectrum(const double *in, double *out) const {
+  std::vector<double> work(GetWorkSize());
+  PowerSpectrum(in, out, &work[0]);
+}
+
+void FFTPlan::PowerSpectrum(const double *in, double *out, double *work) const {
+  unsigned bins = m_size / 2;
+  double *re = work;
+  double *im = work + bins + 1;
+  TransformReal(in, re, im, work + 2 * (bins + 1));
+  for (unsigned k = 0; k < bins; k++)
+    out[k] = re[k] * re[k] + im[k] * im[k];
+}
+
+unsigned long FFTPlan::GetWorkSize() const {
+  // room for the bins of a power spectrum, a complex transform of real
+  // input that can't be packed and the Bluestein convolution
+  unsigned long size = 2 * ((unsigned long) m_size / 2 + 1) + 2 * (unsigned long) m_size;
+  if (m_convolutionPlan)
+    size += 4 * (unsigned long) m_convolutionPlan->GetSize();
+  return size;
+}
+
+void FFTPlan::TransformPowerOfTwo(const double *realIn, const double *imagIn, double *realOut, double *imagOut, bool inverse) const {
+  // the bit reversal is its own inverse so the data can be gathered
+  for (unsigned i = 0; i < m_size; i++) {
+    unsigned j = m_bitReversed[i];
+    realOut[i] = realIn[j];
+    imagOut[i] = imagIn ? imagIn[j] : 0.0;
+  }
+
+  if (m_size > 1)
+    Butterflies(realOut, imagOut, m_size, &m_stageCos[0], &m_stageSin[0], inverse);
+
+  if (inverse) {
+    double scale = 1.0 / m_size;
+    for (unsigned i = 0; i < m_size; i++) {
+      realOut[i] *= scale;
+      imagOut[i] *= scale;
+    }
+  }
+}
+
+void FFTPlan::TransformBluestein(const double *realIn, const double *imagIn, double *realOut, double *imagOut, bool inverse, double *work) const {
+  // the inverse is the forward transform of the conjugates, conjugated
+  double conjugate = inverse ? -1.0 : 1.0;
+  unsigned convolutionSize = m_convolutionPlan->GetSize();
+  double *re = work;
+  double *im = work + convolutionSize;
+  double *spectrumReal = work + 2 * convolutionSize;
+  double *spectrumImag = work + 3 * convolutionSize;
+  for (unsigned k = m_size; k < convolutionSize; k++) {
+    re[k] = 0.0;
+    im[k] = 0.0;
+  }
+  for (unsigned k = 0; k < m_size; k++) {
+    double xr = realIn[k];
+    double xi = imagIn ? imagIn[k] * conjugate : 0.0;
+    re[k] = xr * m_chirpCos[k] - xi * m_chirpSin[k];
+    im[k] = xr * m_chirpSin[k] + xi * m_chirpCos[k];
+  }
+
+  m_convolutionPlan->TransformPowerOfTwo(re, im, spectrumReal, spectrumImag, false);
+  for (unsigned k = 0; k < convolutionSize; k++) {
+    double ar = spectrumReal[k];
+    double ai = spectrumImag[k];
+    spectrumReal[k] = ar * m_filterReal[k] - ai * m_filterImag[k];
+    spectrumImag[k] = ar * m_filterImag[k] + ai * m_filterReal[k];
+  }
+  m_convolutionPlan->TransformPowerOfTwo(spectrumReal, spectrumImag, re, im, true);
+
+  double scale = inverse ? 1.0 / m_size : 1.0;
+  for (unsigned k = 0; k < m_size; k++) {
+    realOut[k] = (re[k] * m_chirpCos[k] - im[k] * m_chirpSin[k]) * scale;
+    imagOut[k] = (re[k] * m_chirpSin[k] + im[k] * m_chirpCos[k]) * scale * conjugate;
+  }
+}
+
+void FFTPlan::TransformReal(const double *in, double *realOut, double *imagOut, double *work) const {
+  if (m_halfPlan) {
+    TransformPacked(in, realOut, imagOut);
+    return;
+  }
+  if (m_size == 0)
+    return;
+
+  // the whole complex transform is needed, the upper half is thrown away
+  double *re = work;
+  double *im = work + m_size;
+  if (m_isPowerOfTwo)
+    TransformPowerOfTwo(in, NULL, re, im, false);
+  else
+    TransformBluestein(in, NULL, re, im, false, work + 2 * m_size);
+  for (unsigned k = 0; k <= m_size / 2; k++) {
+    realOut[k] = re[k];
+    imagOut[k] = im[k];
+  }
+}
+
+void FFTPlan::TransformPacked(const double *in, double *realOut, double *imagOut) const {
+  // the even samples are used as the real part and the odd samples as the
+  // imaginary part of a transform of half the size, which is gathered in
+  // bit reversed order directly from the input
+  unsigned half = m_size / 2;
+  const std::vector<unsigned> &order = m_halfPlan->m_bitReversed;
+  for (unsigned i = 0; i < half; i++) {
+    realOut[i] = in[2 * order[i]];
+    imagOut[i] = in[2 * order[i] + 1];
+  }
+  Butterflies(realOut, imagOut, half, &m_halfPlan->m_stageCos[0], &m_halfPlan->m_stageSin[0], false);
+
+  // then the even and odd spectra are separated and combined, the bins k
+  // and half - k are calculated together
+  realOut[half] = realOut[0];
+  imagOut[half] = imagOut[0];
+  for (unsigned k = 0; k <= half / 2; k++) {
+    unsigned k2 = half - k;
+    double ar = realOut[k];
+    double ai = imagOut[k];
+    double br = realOut[k2];
+    double bi = -imagOut[k2];
+    double evenReal = 0.5 * (ar + br);
+    double evenImag = 0.5 * (ai + bi);
+    double oddReal = 0.5 * (ai - bi);
+    double oddImag = -0.5 * (ar - br);
+    double tr = m_realCos[k] * oddReal - m_realSin[k] * oddImag;
+    double ti = m_realCos[k] * oddImag + m_realSin[k] * oddReal;
+    realOut[k] = evenReal + tr;
+    imagOut[k] = evenImag + ti;
+    realOut[k2] = evenReal - tr;
+    imagOut[k2] = -(evenImag - ti);
+  }
+}
@@ -0,0 +1,95 @@
+/*
+ * FFTPlan.h is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+#ifndef FFTPLAN_H
+#define FFTPLAN_H
+
+#include <vector>
+
+/*
+ * FFTPlan holds everything that only depends on the size of a transform
+ * (twiddle factors and the bit reversal order) so that it's calculated once
+ * instead of for every transform. A plan is never changed after it has been
+ * created, so the same plan can be used by several threads at the same time.
+ *
+ * Power of two sizes use an iterative radix-2 transform on separate real
+ * and imaginary arrays, with SSE2 butterflies where available. Real input
+ * is transformed as a complex transform of half the size. Any other size
+ * is done with Bluestein's algorithm on top of a power of two plan.
+ */
+class FFTPlan {
+public:
+  FFTPlan(unsigned size);
+  ~FFTPlan();
+
+  // A shared plan for the size, created the first time it's asked for. It
+  // stays valid until ReleasePlans is called
+  static const FFTPlan *GetPlan(unsigned size);
+  static void ReleasePlans();
+
+  unsigned GetSize() const;
+
+  // Complex transform, imagIn may be NULL for real input. The output arrays
+  // must not be the input arrays. The inverse transform is normalized
+  void Transform(const double *realIn, const double *imagIn, double *realOut, double *imagOut, bool inverse) const;
+  // Transform of real input, only the bins 0 to size / 2 (both included)
+  // are written as the rest are their complex conjugates
+  void RealTransform(const double *in, double *realOut, double *imagOut) const;
+  // Squared magnitudes of the bins 0 to size / 2 - 1 of real input
+  void PowerSpectrum(const double *in, double *out) const;
+  // The same with work space provided by the caller, which makes it free
+  // of allocations. It must hold GetWorkSize() doubles
+  void PowerSpectrum(const double *in, double *out, double *work) const;
+  unsigned long GetWorkSize() const;
+
+private:
+  // Plain complex power of two plan, used inside other plans
+  FFTPlan(unsigned size, bool complexOnly);
+  FFTPlan(const FFTPlan&);
+  FFTPlan& operator=(const FFTPlan&);
+
+  unsigned m_size;
+  bool m_isPowerOfTwo;
+  // bit reversed order of the indexes
+  std::vector<unsigned> m_bitReversed;
+  // twiddles of the butterflies of each stage, the stage combining blocks
+  // of h frames uses the h values starting at h - 1
+  std::vector<double> m_stageCos;
+  std::vector<double> m_stageSin;
+  // twiddles for splitting the half size transform of real input
+  std::vector<double> m_realCos;
+  std::vector<double> m_realSin;
+  FFTPlan *m_halfPlan;
+  // Bluestein, the chirp and the transformed filter of the power of two
+  // convolution done with m_convolutionPlan
+  std::vector<double> m_chirpCos;
+  std::vector<double> m_chirpSin;
+  std::vector<double> m_filterReal;
+  std::vector<double> m_filterImag;
+  FFTPlan *m_convolutionPlan;
+
+  void CreateTables();
+  void TransformPowerOfTwo(const double *realIn, const double *imagIn, double *realOut, double *imagOut, bool inverse) const;
+  void TransformBluestein(const double *realIn, const double *imagIn, double *realOut, double *imagOut, bool inverse, double *work) const;
+  void TransformReal(const double *in, double *realOut, double *imagOut, double *work) const;
+  void TransformPacked(const double *in, double *realOut, double *imagOut) const;
+};
+
+#endif
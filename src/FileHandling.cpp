@@ -20,33 +20,114 @@
 
 #include "FileHandling.h"
 #include "FFT.h"
+#include "FFTPlan.h"
+#include "ThreadPool.h"
+#include "SampleKernels.h"
+#include "MappedWavReader.h"
+#include "RiffChunkWriter.h"
+#include <wx/stopwatch.h>
+#include <wx/filename.h>
 #include <cfloat>
 #include <algorithm>
 
-FileHandling::FileHandling(wxString fileName, wxString path) : m_loops(NULL), m_cues(NULL), shortAudioData(NULL), intAudioData(NULL), floatAudioData(NULL), doubleAudioData(NULL), fileOpenWasSuccessful(false), m_fftPitch(0), m_fftHPS(0), m_fftPeakPitch(0), m_timeDomainPitch(0), m_autoSustainStart(0),
-m_autoSustainEnd(0), m_sliderSustainStart(0), m_sliderSustainEnd(0) {
+// Number of frames read from the audio store at a time when scanning all data
+static const unsigned READ_BLOCK_FRAMES = 16384;
+
+// Number of overlapping windows of a spectrum that are summed in each task
+static const unsigned SPECTRUM_WINDOWS_PER_TASK = 4;
+
+// Pitch detection by FFT needs at least this many frames to analyze, and
+// doesn't use transforms larger than this
+static const unsigned MIN_PITCH_FRAMES = 1024;
+static const unsigned MAX_PITCH_FFT_SIZE = 131072;
+// Peaks in the spectrum must be above -90 dB, and anything above -200 dB
+// can be the greatest peak (as linear power)
+static const double PEAK_THRESHOLD_POWER = 1.0e-9;
+static const double MIN_PEAK_POWER = 1.0e-20;
+
+// The zoomed pitch starts from an FFT of this size, and then evaluates the
+// band around the fundamental in a number of passes over at most this many
+// seconds of the sustain. Each pass evaluates a grid of frequencies, whose
+// phasors are set again after each block of frames
+static const unsigned ZOOM_COARSE_FFT_SIZE = 16384;
+static const unsigned ZOOM_MAX_SECONDS = 8;
+static const unsigned ZOOM_PASSES = 3;
+static const unsigned ZOOM_GRID_POINTS = 16;
+static const unsigned ZOOM_PHASOR_BLOCK = 4096;
+
+// The phase vocoder uses frames of at least this size, large enough to have
+// the fundamental at least PV_MIN_BINS bins above zero, and the frames are
+// a quarter of a frame apart. At most PV_MAX_FRAMES frames are analyzed
+static const unsigned PV_MIN_FRAME_SIZE = 4096;
+static const unsigned PV_MAX_FRAME_SIZE = 32768;
+static const unsigned PV_MIN_BINS = 8;
+static const unsigned PV_HOP_DIVISOR = 4;
+static const unsigned PV_MAX_FRAMES = 256;
+
+// Harmonics are measured over at most this many seconds of the sustain,
+// each with a grid of 2 * HARMONIC_GRID_HALF + 1 frequencies. A fundamental
+// below the greatest peak is confirmed by the first HARMONICS_TO_CONFIRM
+// harmonics of the greatest peak, its own harmonics between them must have
+// at least MIN_OWN_HARMONIC_ENERGY of their energy
+static const unsigned HARMONIC_SECONDS = 2;
+static const unsigned HARMONIC_GRID_HALF = 4;
+static const unsigned HARMONICS_TO_CONFIRM = 4;
+static const unsigned MAX_HARMONICS = 32;
+static const double MIN_OWN_HARMONIC_ENERGY = 0.001;
+
+// Lowest pitch that the time domain detection looks for, the least
+// normalized correlation that is taken as a pitch at all and how close to
+// the highest one the first maximum of the correlation must be
+static const double MIN_TD_PITCH = 15.0;
+static const double MIN_TD_CLARITY = 0.5;
+static const double TD_KEY_MAXIMUM_RATIO = 0.9;
+
+// Number of power spectra that are remembered for each file
+static const unsigned SPECTRUM_CACHE_SIZE = 8;
+
+// Number of frames converted and written to file at a time
+static const unsigned WRITE_BLOCK_FRAMES = 16384;
+
+template <typename T>
+static void WriteBlocks(SndfileHandle &sf, AudioStore *audio, unsigned firstFrame, unsigned nbrFrames) {
+  int channels = audio->GetChannels();
+  T *buffer = new T[WRITE_BLOCK_FRAMES * channels];
+  unsigned framesWritten = 0;
+  while (framesWritten < nbrFrames) {
+    unsigned framesInBlock = std::min(WRITE_BLOCK_FRAMES, nbrFrames - framesWritten);
+    audio->ExportInterleaved(buffer, firstFrame + framesWritten, framesInBlock);
+    sf.write(buffer, (sf_count_t) framesInBlock * channels);
+    framesWritten += framesInBlock;
+  }
+  delete[] buffer;
+}
+
+FileHandling::FileHandling(wxString fileName, wxString path, bool metadataOnly) : m_loops(NULL), m_cues(NULL), m_audio(NULL), ArrayLength(0), fileOpenWasSuccessful(false), m_decodeTime(0), m_reader(NULL), m_fftPitch(0), m_fftHPS(0), m_fftPeakPitch(0), m_zoomPitch(0), m_phaseVocoderPitch(0), m_timeDomainPitch(0), m_autoSustainStart(0),
+m_autoSustainEnd(0), m_sliderSustainStart(0), m_sliderSustainEnd(0), m_statsAreValid(false), m_statsChangeCount(0), m_strongestChannel(0), m_spectrumChangeCount(0), m_loopWindowFirst(0), m_loopWindowFrames(0), m_loopWindowChangeCount(0) {
   m_fileName = fileName;
   m_loops = new LoopMarkers();
   m_cues = new CueMarkers();
+  m_audio = new AudioStore();
   wxString filePath;
   filePath = path;
   filePath += wxFILE_SEP_PATH;
   filePath += fileName;
 
   // Here we get all the info about the file to be able to later open new file in write mode if changes should be saved
-  SndfileHandle sfHandle;
+  // Plain PCM/float wav files are memory mapped, anything else is read with libsndfile
+  m_sourcePath = filePath;
+  m_reader = new MappedWavReader();
+  MappedWavReader &wavReader = *m_reader;
 
-  sfHandle = SndfileHandle(std::string(filePath.mb_str())); // Open file only for read first to get all info
+  if (wavReader.Open(filePath)) { // checking if opening file was succesful or not
 
-  if (sfHandle) { // checking if opening file was succesful or not
-
-    m_format = sfHandle.format();
-    m_samplerate = sfHandle.samplerate();
-    m_channels = sfHandle.channels();
-    m_minorFormat = sfHandle.format() & SF_FORMAT_SUBMASK;
+    m_format = wavReader.GetFormat();
+    m_samplerate = wavReader.GetSampleRate();
+    m_channels = wavReader.GetChannels();
+    m_minorFormat = m_format & SF_FORMAT_SUBMASK;
 
     // Try to get loop info from the file
-    if (sfHandle.command(SFC_GET_INSTRUMENT, &instr, sizeof(instr)) == SF_TRUE) {
+    if (wavReader.GetInstrument(instr)) {
       // There are loops!
 
       m_loops->SetMIDIUnityNote(instr.basenote);
@@ -68,7 +149,7 @@ m_autoSustainEnd(0), m_sliderSustainStart(0), m_sliderSustainEnd(0) {
     }
 
     // Try to get cue info from file
-    if (sfHandle.command(SFC_GET_CUE, &cues, sizeof(cues)) == SF_TRUE) {
+    if (wavReader.GetCues(cues)) {
       // There are cues!
 
       // Check if the cue is a real cue or a label, only keep real cues!
@@ -95,93 +176,63 @@ m_autoSustainEnd(0), m_sliderSustainStart(0), m_sliderSustainEnd(0) {
       }
     }
 
-    // Decide what format to store audio data as and copy it
-    if (m_minorFormat == SF_FORMAT_DOUBLE) {
-      ArrayLength = sfHandle.frames() * sfHandle.channels();
-      doubleAudioData = new double[ArrayLength];
-      sfHandle.read(doubleAudioData, ArrayLength);
-
-      fileOpenWasSuccessful = true;
-    } else if (m_minorFormat == SF_FORMAT_FLOAT) {
-      ArrayLength = sfHandle.frames() * sfHandle.channels();
-      floatAudioData = new float[ArrayLength];
-      sfHandle.read(floatAudioData, ArrayLength);
-
-      fileOpenWasSuccessful = true;
-    } else if ((m_minorFormat == SF_FORMAT_PCM_16) || (m_minorFormat == SF_FORMAT_PCM_S8) || (m_minorFormat == SF_FORMAT_PCM_U8)) {
-      ArrayLength = sfHandle.frames() * sfHandle.channels();
-      shortAudioData = new short[ArrayLength];
-      sfHandle.read(shortAudioData, ArrayLength);
-
-      fileOpenWasSuccessful = true;
-    } else if ((m_minorFormat == SF_FORMAT_PCM_24) || (m_minorFormat == SF_FORMAT_PCM_32)) {
-      ArrayLength = sfHandle.frames() * sfHandle.channels();
-      intAudioData = new int[ArrayLength];
-      sfHandle.read(intAudioData, ArrayLength);
-
+    // Decode the audio data in a single pass, block by block, straight into
+    // the (already allocated) planar tracks of the audio store. Only 32 bit
+    // integer and 64 bit float data need double precision to be kept
+    // losslessly, everything else is stored as floats. Files that wouldn't
+    // fit in the memory budget are instead paged in from the file when needed
+    wxStopWatch decodeTimer;
+    unsigned frames = wavReader.GetFrames();
+    unsigned framesRead = frames;
+    if ((m_minorFormat == SF_FORMAT_DOUBLE) || (m_minorFormat == SF_FORMAT_FLOAT) ||
+        (m_minorFormat == SF_FORMAT_PCM_16) || (m_minorFormat == SF_FORMAT_PCM_S8) || (m_minorFormat == SF_FORMAT_PCM_U8) ||
+        (m_minorFormat == SF_FORMAT_PCM_24) || (m_minorFormat == SF_FORMAT_PCM_32)) {
+      bool useDoubles = (m_minorFormat == SF_FORMAT_DOUBLE) || (m_minorFormat == SF_FORMAT_PCM_32);
+      if (metadataOnly ||
+          AudioStore::GetRequiredBytes(m_channels, frames, useDoubles) > (size_t) AudioStore::GetMemoryBudget() * 1024 * 1024) {
+        m_audio->AttachSource(m_channels, frames, useDoubles, m_reader);
+      } else {
+        m_audio->Allocate(m_channels, frames, useDoubles);
+        framesRead = wavReader.ReadFrames(m_audio);
+      }
       fileOpenWasSuccessful = true;
     } else {
       // file didn't contain any audio data
       fileOpenWasSuccessful = false;
     }
 
-    // also store audio data as doubles de-interleaved if successful
-    // plus check if the float audio data needs to be read for playback
-    if (fileOpenWasSuccessful) {
-      // remember to "rewind" file before read
-      sfHandle.seek(0, SEEK_SET);
-
-      for (int i = 0; i < m_channels; i++) {
-        WAVETRACK track;
-        waveTracks.push_back(track);
-      }
-      double *buffer = new double[ArrayLength];
-      sfHandle.read(buffer, ArrayLength);
-
-      int index = 0;
-      for (unsigned i = 0; i < ArrayLength; i++) {
-        // de-interleaving
-        waveTracks[index].waveData.push_back(buffer[i]);
-        index++;
+    // the store now matches the file, a truncated file gives fewer frames
+    // than the header claims though
+    m_audio->ClearModified();
+    if (framesRead < frames)
+      m_audio->Trim(0, framesRead);
+    ArrayLength = m_audio->GetLength();
+    m_decodeTime = decodeTimer.Time();
 
-        if (index == m_channels)
-          index = 0;
-      }
-      delete[] buffer;
-      
-      if (m_minorFormat != SF_FORMAT_FLOAT) {
-        // if the format is something else than floats we also need data as
-        // floats for audio playback reasons
-        sfHandle.seek(0, SEEK_SET);
-        floatAudioData = new float[ArrayLength];
-        sfHandle.read(floatAudioData, ArrayLength);
-      }
-    }
-    
     // Try to get LIST INFO strings
-    if (sfHandle.getString(SF_STR_ARTIST) != NULL)
-      m_info.artist = wxString::FromUTF8(sfHandle.getString(SF_STR_ARTIST));
+    if (wavReader.GetString(SF_STR_ARTIST) != NULL)
+      m_info.artist = wxString::FromUTF8(wavReader.GetString(SF_STR_ARTIST));
     else
       m_info.artist = wxEmptyString;
     
-    if (sfHandle.getString(SF_STR_COPYRIGHT) != NULL)
-      m_info.copyright = wxString::FromUTF8(sfHandle.getString(SF_STR_COPYRIGHT));
+    if (wavReader.GetString(SF_STR_COPYRIGHT) != NULL)
+      m_info.copyright = wxString::FromUTF8(wavReader.GetString(SF_STR_COPYRIGHT));
     else
       m_info.copyright = wxEmptyString;
     
-    if (sfHandle.getString(SF_STR_SOFTWARE) != NULL)
-      m_info.software = wxString::FromUTF8(sfHandle.getString(SF_STR_SOFTWARE));
+    if (wavReader.GetString(SF_STR_SOFTWARE) != NULL)
+      m_info.software = wxString::FromUTF8(wavReader.GetString(SF_STR_SOFTWARE));
     else
       m_info.software = wxEmptyString;
     
-    if (sfHandle.getString(SF_STR_COMMENT) != NULL)
-      m_info.comment = wxString::FromUTF8(sfHandle.getString(SF_STR_COMMENT));
+    if (wavReader.GetString(SF_STR_COMMENT) != NULL)
+      m_info.comment = wxString::FromUTF8(wavReader.GetString(SF_STR_COMMENT));
     else
       m_info.comment = wxEmptyString;
     
     // creation date is special
-    if (sfHandle.getString(SF_STR_DATE) != NULL) {
-      wxString dateString = wxString::FromUTF8(sfHandle.getString(SF_STR_DATE));
+    if (wavReader.GetString(SF_STR_DATE) != NULL) {
+      wxString dateString = wxString::FromUTF8(wavReader.GetString(SF_STR_DATE));
       wxDateTime dt;
       wxString::const_iterator end;
       if (dt.ParseDate(dateString, &end))
@@ -192,8 +243,15 @@ m_autoSustainEnd(0), m_sliderSustainStart(0), m_sliderSustainEnd(0) {
       m_info.creation_date = wxDateTime::Now();
     }
     
-    // Auto calculate the sustainsection too
-    if (fileOpenWasSuccessful)
+    // the file is only needed later if the audio data is paged in from it
+    if (!m_audio->IsPaged()) {
+      delete m_reader;
+      m_reader = NULL;
+    }
+
+    // Auto calculate the sustainsection too, unless only the metadata is of
+    // interest in which case no audio data should be read at all
+    if (fileOpenWasSuccessful && !metadataOnly)
       CalculateSustainStartAndEnd();
     
     // set a default, this will be set when the file is already opened from MyFrame
@@ -209,13 +267,10 @@ FileHandling::~FileHandling() {
 
   delete m_cues;
 
-  delete[] shortAudioData;
+  delete m_audio;
 
-  delete[] intAudioData;
-
-  delete[] doubleAudioData;
-  
-  delete[] floatAudioData;
+  if (m_reader)
+    delete m_reader;
 }
 
 void FileHandling::SaveAudioFile(wxString fileName, wxString path) {
@@ -224,8 +279,14 @@ void FileHandling::SaveAudioFile(wxString fileName, wxString path) {
   filePath += wxFILE_SEP_PATH;
   filePath += fileName;
 
-  // This we open the file write
-  sfh = SndfileHandle(std::string(filePath.mb_str()), SFM_WRITE, m_format, m_channels, m_samplerate);
+  // The audio data is streamed to a temporary file which then replaces the
+  // target. That way the source file stays intact (and usable for paging in
+  // audio data) until everything has been written. The temporary file gets
+  // a unique name in the same directory so that it can't be mixed up with
+  // any other file and the rename doesn't need to copy anything
+  wxString tempPath = wxFileName::CreateTempFileName(filePath);
+  if (tempPath.IsEmpty())
+    return;
 
   // Deal with the loops first
   m_loops->ExportLoops();
@@ -242,7 +303,6 @@ void FileHandling::SaveAudioFile(wxString fileName, wxString path) {
     instr.loops[i].end = m_loops->loopsOut[i].dwEnd;
     instr.loops[i].count = m_loops->loopsOut[i].dwPlayCount;
   }
-  sfh.command(SFC_SET_INSTRUMENT, &instr, sizeof(instr)); // this writes the loops metadata
 
   // Then take care of the cues
   m_cues->ExportCues();
@@ -259,40 +319,105 @@ void FileHandling::SaveAudioFile(wxString fileName, wxString path) {
     cues.cue_points[i].block_start =  m_cues->exportedCues[i].dwBlockStart;
     cues.cue_points[i].sample_offset =  m_cues->exportedCues[i].dwSampleOffset;
   }
-  sfh.command(SFC_SET_CUE, &cues, sizeof(cues));
-  
-  // Write LIST INFO strings if they are set
+
+  // Collect the LIST INFO strings that are set
+  std::vector<std::pair<int, std::string> > infoStrings;
   if (m_info.artist != wxEmptyString)
-    sfh.setString(SF_STR_ARTIST, (const char*)m_info.artist.mb_str());
+    infoStrings.push_back(std::make_pair(SF_STR_ARTIST, std::string(m_info.artist.mb_str())));
     
   if (m_info.copyright != wxEmptyString)
-    sfh.setString(SF_STR_COPYRIGHT, (const char*)m_info.copyright.mb_str());
+    infoStrings.push_back(std::make_pair(SF_STR_COPYRIGHT, std::string(m_info.copyright.mb_str())));
   
   // Remember to set the software string of the used software!
   m_info.software = wxT("LoopAuditioneer");
   if (m_info.software != wxEmptyString)
-    sfh.setString(SF_STR_SOFTWARE, (const char*)m_info.software.mb_str());
+    infoStrings.push_back(std::make_pair(SF_STR_SOFTWARE, std::string(m_info.software.mb_str())));
   
   if (m_info.comment != wxEmptyString)
-    sfh.setString(SF_STR_COMMENT, (const char*)m_info.comment.mb_str());
+    infoStrings.push_back(std::make_pair(SF_STR_COMMENT, std::string(m_info.comment.mb_str())));
   
   // the creation date must be formatted as YYYY-MM-DD and nothing else
   if (m_info.creation_date.IsValid()) {
     wxString dateString = m_info.creation_date.FormatISODate();
-    sfh.setString(SF_STR_DATE, (const char*)dateString.mb_str());
+    infoStrings.push_back(std::make_pair(SF_STR_DATE, std::string(dateString.mb_str())));
   }
-  
-  // Finally write the data back
+
+  // If the audio data is unchanged only the metadata chunks need to be
+  // replaced, the rest of the source file is copied without decoding it.
+  // Otherwise (or if that isn't possible) the whole file is written again
+  bool writeOk = false;
+  if (!m_audio->IsModified() && ((m_format & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAV || (m_format & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAVEX)) {
+    RiffChunkWriter chunkWriter;
+    if (chunkWriter.Open(m_sourcePath)) {
+      chunkWriter.SetInstrument(instr, m_samplerate);
+      chunkWriter.SetCues(cues);
+      for (unsigned i = 0; i < infoStrings.size(); i++)
+        chunkWriter.SetString(infoStrings[i].first, infoStrings[i].second.c_str());
+      writeOk = chunkWriter.Write(tempPath);
+    }
+  }
+
+  if (!writeOk) {
+    // This we open the file write
+    sfh = SndfileHandle(std::string(tempPath.mb_str()), SFM_WRITE, m_format, m_channels, m_samplerate);
+    if (!sfh) {
+      sfh = SndfileHandle();
+      wxRemoveFile(tempPath);
+      return;
+    }
+    sfh.command(SFC_SET_INSTRUMENT, &instr, sizeof(instr)); // this writes the loops metadata
+    sfh.command(SFC_SET_CUE, &cues, sizeof(cues));
+    for (unsigned i = 0; i < infoStrings.size(); i++)
+      sfh.setString(infoStrings[i].first, infoStrings[i].second.c_str());
+
+    // Finally write the data back
+    WriteAudioData(sfh, 0, m_audio->GetFrames());
+    writeOk = sfh.error() == SF_ERR_NO_ERROR;
+    sfh = SndfileHandle(); // closes the file
+  }
+
+  if (!writeOk) {
+    wxRemoveFile(tempPath);
+    return;
+  }
+
+  // the source file is replaced so its mapping must be released first
+  bool replacesSource = filePath == m_sourcePath;
+  if (m_reader && replacesSource)
+    m_reader->Close();
+  bool replaced = RiffChunkWriter::ReplaceFile(tempPath, filePath, m_sourcePath);
+  if (!replaced)
+    wxRemoveFile(tempPath);
+
+  if (replacesSource) {
+    if (m_reader) {
+      // audio data that's still paged in must come from the new file now
+      m_reader->Open(filePath);
+      if (m_audio->IsPaged()) {
+        // what's on disk now matches the store so nothing needs to be pinned
+        if (replaced)
+          m_audio->ReplaceSource(m_reader);
+      } else {
+        delete m_reader;
+        m_reader = NULL;
+      }
+    }
+    if (replaced)
+      m_audio->ClearModified();
+  }
+}
+
+void FileHandling::WriteAudioData(SndfileHandle &sf, unsigned firstFrame, unsigned nbrFrames) {
+  // convert the stored tracks back to the native format a block at a time
   if (m_minorFormat == SF_FORMAT_DOUBLE) {
-    sfh.write(doubleAudioData, ArrayLength);
+    WriteBlocks<double>(sf, m_audio, firstFrame, nbrFrames);
   } else if (m_minorFormat == SF_FORMAT_FLOAT) {
-    sfh.write(floatAudioData, ArrayLength);
+    WriteBlocks<float>(sf, m_audio, firstFrame, nbrFrames);
   } else if ((m_minorFormat == SF_FORMAT_PCM_16) || (m_minorFormat == SF_FORMAT_PCM_S8) || (m_minorFormat == SF_FORMAT_PCM_U8)) {
-    sfh.write(shortAudioData, ArrayLength);
+    WriteBlocks<short>(sf, m_audio, firstFrame, nbrFrames);
   } else {
-    sfh.write(intAudioData, ArrayLength);
+    WriteBlocks<int>(sf, m_audio, firstFrame, nbrFrames);
   }
-  // File will be finally closed when the instance is deleted!
 }
 
 int FileHandling::GetSampleRate() {
@@ -303,6 +428,10 @@ void FileHandling::SetSampleRate(unsigned s_rate) {
   m_samplerate = s_rate;
 }
 
+long FileHandling::GetDecodeTime() {
+  return m_decodeTime;
+}
+
 int FileHandling::GetAudioFormat() {
   return m_minorFormat;
 }
@@ -359,6 +488,8 @@ bool FileHandling::GetFFTPitch(double pitches[]) {
     pitches[0] = m_fftPitch;
     pitches[1] = m_fftHPS;
     pitches[2] = m_fftPeakPitch;
+    DetectPitchByPhaseVocoder(m_fftPitch);
+    pitches[3] = m_phaseVocoderPitch;
 
     return true;
   } else
@@ -367,96 +498,163 @@ bool FileHandling::GetFFTPitch(double pitches[]) {
 
 /*
  * GetSpectrum needs an array of doubles that is the size of (fftSize / 2) for the total output in dB for each bin
- * fftSize must be a power of 2
+ * fftSize can be any size but a power of 2 is the fastest
  * windowType must be in range 0 to 9
  */
 bool FileHandling::GetSpectrum(double *outInDb, unsigned fftSize, int windowType) {
-  if (!waveTracks.empty()) {
-    unsigned numberOfSamples = waveTracks[0].waveData.size();
-    if (fftSize > numberOfSamples) {
-      return false;
-    }
-
-    unsigned nbrWindows = 0;
-    unsigned halfFFTsize = fftSize / 2;
-    double *input = new double[fftSize];
-    double *output = new double[fftSize];
-    double *fftData = new double[fftSize];
-    double *window = new double[fftSize];
-
-    for (unsigned i = 0; i < fftSize; i++) {
-      input[i] = 0.0f;
-      output[i] = 0.0f;
-      fftData[i] = 0.0f;
-      window[i] = 1.0f;
-    }
-
-    // Create a window that will be applied to the in data later
-    if (windowType > 0)
-      WindowFunc(windowType, fftSize, window);
+  const std::vector<double> *power = GetPowerSpectrum(fftSize, windowType, 0, m_audio->GetFrames());
+  if (!power)
+    return false;
 
-    // Scale window so an amplitude of 1.0 equals to 0 dB
-    double winScale = 0;
-    for (unsigned i = 0; i < fftSize; i++)
-      winScale += window[i];
-    if (winScale > 0)
-      winScale = 4.0 / (winScale * winScale);
+  // Convert to decibels and store value in the double array sent as parameter
+  for (unsigned i = 0; i < fftSize / 2; i++) {
+    double temp = 10 * log10((*power)[i]);
+    if (temp > -145)
+      outInDb[i] = temp;
     else
-      winScale = 1.0;
-
-    for (unsigned i = 0; i < waveTracks.size(); i++) {
-      unsigned currentStartIdx = 0;
-      while (currentStartIdx + fftSize < waveTracks[i].waveData.size()) {
-        // Fill this input window with audio data from current channel
-        for (unsigned j = 0; j < fftSize; j++) {
-          input[j] = window[j] * waveTracks[i].waveData[currentStartIdx + j];
-        }
+      outInDb[i] = -145;
+  }
+  return true;
+}
 
-        // Perform the FFT
-        PowerSpectrum(fftSize, input, output);
+const std::vector<double> *FileHandling::GetPowerSpectrum(unsigned fftSize, int windowType, unsigned firstFrame, unsigned nbrFrames) {
+  if (m_audio->IsEmpty() || fftSize > nbrFrames || firstFrame + nbrFrames > m_audio->GetFrames())
+    return NULL;
 
-        for (unsigned j = 0; j < halfFFTsize; j++)
-          fftData[j] += output[j];
+  // Any change of the audio data makes all the spectra invalid
+  if (m_spectrumChangeCount != m_audio->GetChangeCount()) {
+    m_spectrumCache.clear();
+    m_spectrumChangeCount = m_audio->GetChangeCount();
+  }
 
-        // Overlap each window 50%
-        currentStartIdx += halfFFTsize;
-        nbrWindows++;
-      }
+  std::list<CachedSpectrum>::iterator it;
+  for (it = m_spectrumCache.begin(); it != m_spectrumCache.end(); ++it) {
+    if (it->fftSize == fftSize && it->windowType == windowType && it->firstFrame == firstFrame && it->nbrFrames == nbrFrames) {
+      // most recently used first
+      m_spectrumCache.splice(m_spectrumCache.begin(), m_spectrumCache, it);
+      return &m_spectrumCache.front().power;
     }
+  }
 
-    double scale = winScale / (double) nbrWindows;
-    // Convert to decibels and store value in the double array sent as parameter
-    for (unsigned i = 0; i < halfFFTsize; i++) {
-      double temp = 10 * log10(fftData[i] * scale);
-      if (temp > -145)
-        outInDb[i] = temp;
-      else
-        outInDb[i] = -145;
+  if (m_spectrumCache.size() >= SPECTRUM_CACHE_SIZE)
+    m_spectrumCache.pop_back();
+  m_spectrumCache.push_front(CachedSpectrum());
+  CachedSpectrum &spectrum = m_spectrumCache.front();
+  spectrum.fftSize = fftSize;
+  spectrum.windowType = windowType;
+  spectrum.firstFrame = firstFrame;
+  spectrum.nbrFrames = nbrFrames;
+  CalculatePowerSpectrum(spectrum);
+  return &spectrum.power;
+}
+
+void FileHandling::CalculatePowerSpectrum(CachedSpectrum &spectrum) {
+  unsigned fftSize = spectrum.fftSize;
+  unsigned halfFFTsize = fftSize / 2;
+  const double *window = WindowTable(spectrum.windowType, fftSize);
+  // The plan is shared and can be used for every window
+  const FFTPlan *plan = FFTPlan::GetPlan(fftSize);
+
+  // Scale window so an amplitude of 1.0 equals to 0 dB
+  double winScale = 0;
+  for (unsigned i = 0; i < fftSize; i++)
+    winScale += window[i];
+  if (winScale > 0)
+    winScale = 4.0 / (winScale * winScale);
+  else
+    winScale = 1.0;
+
+  // The windows overlap each other 50%, their power spectra are summed in
+  // blocks that are run in parallel and then added in block order
+  unsigned windowsPerChannel = 0;
+  for (unsigned start = 0; start + fftSize < spectrum.nbrFrames; start += halfFFTsize)
+    windowsPerChannel++;
+  unsigned nbrWindows = windowsPerChannel * m_audio->GetChannels();
+  unsigned nbrBlocks = (nbrWindows + SPECTRUM_WINDOWS_PER_TASK - 1) / SPECTRUM_WINDOWS_PER_TASK;
+
+  ThreadPool *pool = ThreadPool::GetShared();
+  unsigned long scratchSize = fftSize + halfFFTsize + plan->GetWorkSize();
+  if (m_spectrumScratch.size() < pool->GetWorkerCount())
+    m_spectrumScratch.resize(pool->GetWorkerCount());
+  m_spectrumSums.assign((unsigned long) std::max(nbrBlocks, 1U) * halfFFTsize, 0.0);
+
+  pool->Run(nbrBlocks, [&](unsigned block, unsigned worker) {
+    std::vector<double> &scratch = m_spectrumScratch[worker];
+    if (scratch.size() < scratchSize)
+      scratch.resize(scratchSize);
+    double *input = &scratch[0];
+    double *output = input + fftSize;
+    double *work = output + halfFFTsize;
+    double *sums = &m_spectrumSums[(unsigned long) block * halfFFTsize];
+
+    unsigned lastWindow = std::min(nbrWindows, (block + 1) * SPECTRUM_WINDOWS_PER_TASK);
+    for (unsigned w = block * SPECTRUM_WINDOWS_PER_TASK; w < lastWindow; w++) {
+      // Fill this input window with audio data from its channel
+      unsigned start = spectrum.firstFrame + (w % windowsPerChannel) * halfFFTsize;
+      m_audio->ReadTrack(w / windowsPerChannel, start, fftSize, input);
+      for (unsigned j = 0; j < fftSize; j++)
+        input[j] *= window[j];
+
+      // Perform the FFT
+      plan->PowerSpectrum(input, output, work);
+
+      for (unsigned j = 0; j < halfFFTsize; j++)
+        sums[j] += output[j];
     }
+  });
+
+  // The average power of the windows, scaled so that 1.0 in amplitude
+  // gives 1.0 in power
+  double scale = winScale / (double) nbrWindows;
+  spectrum.power.assign(halfFFTsize, 0.0);
+  for (unsigned block = 0; block < std::max(nbrBlocks, 1U); block++) {
+    const double *sums = &m_spectrumSums[(unsigned long) block * halfFFTsize];
+    for (unsigned j = 0; j < halfFFTsize; j++)
+      spectrum.power[j] += sums[j];
+  }
+  for (unsigned j = 0; j < halfFFTsize; j++)
+    spectrum.power[j] *= scale;
+}
 
-    delete[] input;
-    delete[] output;
-    delete[] fftData;
-    delete[] window;
-    return true;
-  } else {
-    return false;
+void FileHandling::GetPitchAnalysisRange(unsigned &firstFrame, unsigned &nbrFrames) {
+  // The analysis is done on the sustain section only (if there is one) as
+  // the attack and release would just smear the spectrum. It's the same
+  // sustain section as the loop search uses, the automatically found one or
+  // the one set with the sliders
+  firstFrame = 0;
+  nbrFrames = m_audio->GetFrames();
+  std::pair<unsigned, unsigned> sustain = GetSustainsection();
+  if (nbrFrames && sustain.second >= nbrFrames)
+    sustain.second = nbrFrames - 1;
+  if (sustain.second > sustain.first && sustain.second - sustain.first + 1 >= MIN_PITCH_FRAMES) {
+    firstFrame = sustain.first;
+    nbrFrames = sustain.second - sustain.first + 1;
   }
 }
 
 bool FileHandling::DetectPitchByFFT() {
-  if (waveTracks[0].waveData.size() < 1024) {
-    // the file doesn't contain enough data...
-    m_fftPitch = 0;
-    m_fftHPS = 0;
-    m_fftPeakPitch = 0;
+  FFTPitchResult result;
+  bool gotPitch = FindFFTPitch(MAX_PITCH_FFT_SIZE, result);
+  m_fftPitch = result.pitch;
+  m_fftHPS = result.hps;
+  m_fftPeakPitch = result.peakPitch;
+  return gotPitch;
+}
+
+bool FileHandling::FindFFTPitch(unsigned maxFftSize, FFTPitchResult &result) {
+  result = FFTPitchResult();
+  unsigned firstFrame;
+  unsigned nbrFrames;
+  GetPitchAnalysisRange(firstFrame, nbrFrames);
+
+  // the file doesn't contain enough data...
+  if (nbrFrames < MIN_PITCH_FRAMES)
     return false;
-  }
 
-  unsigned fftSize = 131072;
+  unsigned fftSize = maxFftSize;
   bool foundLargestSize = false;
   while (!foundLargestSize) {
-    if (fftSize < waveTracks[0].waveData.size()) {
+    if (fftSize < nbrFrames) {
       foundLargestSize = true;
     } else {
       fftSize /= 2;
@@ -464,51 +662,57 @@ bool FileHandling::DetectPitchByFFT() {
   }
 
   unsigned halfSize = fftSize / 2;
-  double *pwrSpec = new double[halfSize];
-
-  if (GetSpectrum(pwrSpec, fftSize, 3)) {
-    // fft data is now available in pwrSpec array already as dB values
-    // so we store all peaks and get largest (greatest) peak in one go
+  result.binWidth = (double) m_samplerate / fftSize;
+  const std::vector<double> *spectrum = GetPowerSpectrum(fftSize, 3, firstFrame, nbrFrames);
+
+  if (spectrum) {
+    // the power is linear, which is what all the calculations below need,
+    // so only the peaks get dB values. All peaks are stored and the largest
+    // (greatest) peak is found in one go
+    const double *pwrSpec = &(*spectrum)[0];
     std::vector<SpectrumPeak> allPeaks;
-    double peakDb = -200;
+    double peakPower = MIN_PEAK_POWER;
     unsigned peakBin = 0;
     unsigned peakIdx = 0;
-    double peakPitch = 0;
     for (unsigned i = 0; i < halfSize; i++) {
       // only care for storing peaks that are above -90 dB
-      if (pwrSpec[i] > -90.0f && i > 0 && i < halfSize - 1) {
+      if (pwrSpec[i] > PEAK_THRESHOLD_POWER && i > 0 && i < halfSize - 1) {
         if (pwrSpec[i] > pwrSpec[i - 1] && pwrSpec[i] > pwrSpec[i + 1]) {
           // this bin is a peak
           SpectrumPeak peak;
           peak.m_binNbr = i;
-          peak.m_dB = pwrSpec[i];
+          peak.m_power = pwrSpec[i];
+          peak.m_dB = 10 * log10(pwrSpec[i]);
           peak.m_pitch = i * (double) m_samplerate / fftSize;
           allPeaks.push_back(peak);
         }
       }
       // next comes storing the greatest peak that is expected to be significant
-      if (pwrSpec[i] > peakDb && i > 0 && allPeaks.size() > 0) {
-        peakDb = pwrSpec[i];
+      if (pwrSpec[i] > peakPower && i > 0 && allPeaks.size() > 0) {
+        peakPower = pwrSpec[i];
         peakBin = i;
         peakIdx = allPeaks.size() - 1;
-        peakPitch = allPeaks[peakIdx].m_pitch;
       }
     }
 
+    // nothing strong enough to be a tone
+    if (allPeaks.empty())
+      return false;
+
     // initially we set the possible fundamental to the largest peak
     unsigned possibleF0 = peakIdx;
-    m_fftPeakPitch = TranslateIndexToPitch(
+    result.peakPitch = TranslateIndexToPitch(
       peakBin,
-      pow(10, (pwrSpec[peakBin - 1] / 10)),
-      pow(10, (pwrSpec[peakBin] / 10)),
-      pow(10, (pwrSpec[peakBin + 1] / 10)),
+      pwrSpec[peakBin - 1],
+      pwrSpec[peakBin],
+      pwrSpec[peakBin + 1],
       fftSize
     );
 
     if (peakIdx > 0 && allPeaks.size()) {
       // each peak up to and including max peak should be compared for harmonic quality relative to other peaks
       for (unsigned i = 0; i <= peakIdx; i++) {
-        allPeaks[i].m_harmonicQuality = pow(10, (allPeaks[i].m_dB / 10.0));
+        allPeaks[i].m_harmonicQuality = allPeaks[i].m_power;
         std::vector<double> harmonicsPitch;
         for (unsigned j = 2; j < 10; j++) {
           harmonicsPitch.push_back(allPeaks[i].m_pitch * j);
@@ -533,10 +737,10 @@ bool FileHandling::DetectPitchByFFT() {
               }
             }
             allPeaks[i].m_matchingHarmonics.push_back(candidateHarmonics[strongestCandidate]);
-            allPeaks[i].m_harmonicQuality += pow(10, (allPeaks[candidateHarmonics[strongestCandidate]].m_dB / 10.0));
+            allPeaks[i].m_harmonicQuality += allPeaks[candidateHarmonics[strongestCandidate]].m_power;
           } else if (candidateHarmonics.size()) {
             allPeaks[i].m_matchingHarmonics.push_back(candidateHarmonics[0]);
-            allPeaks[i].m_harmonicQuality += pow(10, (allPeaks[candidateHarmonics[0]].m_dB / 10.0));
+            allPeaks[i].m_harmonicQuality += allPeaks[candidateHarmonics[0]].m_power;
           }
           if (candidateHarmonics.empty()) {
             allPeaks[i].m_harmonicQuality *= 0.5;
@@ -576,9 +780,35 @@ bool FileHandling::DetectPitchByFFT() {
       // otherwise we'll just fall back to greatest peak
       if (!peakContainStrongest) {
         possibleF0 = peakIdx;
+      } else {
+        // A real fundamental below the greatest peak has energy at its
+        // harmonics that aren't harmonics of the greatest peak too,
+        // otherwise the greatest peak is the fundamental after all
+        double candidate = TranslateIndexToPitch(
+          allPeaks[possibleF0].m_binNbr,
+          pwrSpec[allPeaks[possibleF0].m_binNbr - 1],
+          pwrSpec[allPeaks[possibleF0].m_binNbr],
+          pwrSpec[allPeaks[possibleF0].m_binNbr + 1],
+          fftSize
+        );
+        unsigned ratio = lround(result.peakPitch / candidate);
+        std::vector<HarmonicMeasurement> harmonics;
+        if (ratio > 1 && MeasureHarmonics(candidate, std::min(ratio * HARMONICS_TO_CONFIRM, MAX_HARMONICS), harmonics)) {
+          double ownEnergy = 0;
+          double sharedEnergy = 0;
+          for (unsigned h = 1; h <= harmonics.size(); h++) {
+            double energy = harmonics[h - 1].m_amplitude * harmonics[h - 1].m_amplitude;
+            if (h % ratio)
+              ownEnergy += energy;
+            else
+              sharedEnergy += energy;
+          }
+          if (ownEnergy < MIN_OWN_HARMONIC_ENERGY * sharedEnergy)
+            possibleF0 = peakIdx;
+        }
       }
     }
-    m_fftPitch = allPeaks[possibleF0].m_pitch;
+    result.pitch = allPeaks[possibleF0].m_pitch;
 
     // now try detecting pitch with HPS
     unsigned maxBin = 0;
@@ -586,7 +816,7 @@ bool FileHandling::DetectPitchByFFT() {
     double *hps = new double[halfSize];
 
     for (unsigned i = 0; i < halfSize; i++) {
-      original[i] = sqrt(pow(10, (pwrSpec[i] / 10)));
+      original[i] = sqrt(pwrSpec[i]);
       if (i > 0)
         hps[i] = original[i];
       else
@@ -606,7 +836,7 @@ bool FileHandling::DetectPitchByFFT() {
     if (!maxBin)
       maxBin = peakBin;
 
-    m_fftHPS = TranslateIndexToPitch(
+    result.hps = TranslateIndexToPitch(
       maxBin,
       original[maxBin - 1],
       original[maxBin],
@@ -624,20 +854,8 @@ bool FileHandling::DetectPitchByFFT() {
       hps = NULL;
     }
 
-    if (pwrSpec) {
-      delete[] pwrSpec;
-      pwrSpec = NULL;
-    }
-
     return true;
   } else {
-    m_fftPitch = 0;
-    m_fftHPS = 0;
-    m_fftPeakPitch = 0;
-    if (pwrSpec) {
-      delete[] pwrSpec;
-      pwrSpec = NULL;
-    }
     return false;
   }
 }
@@ -664,124 +882,413 @@ double FileHandling::TranslateIndexToPitch(
 }
 
 bool FileHandling::DetectPitchInTimeDomain() {
-  unsigned numberOfSamples = waveTracks[0].waveData.size();
-  if (!numberOfSamples)
+  if (!m_audio->GetFrames())
     return false;
-  std::pair <unsigned, unsigned> sustainStartAndEnd;
-  sustainStartAndEnd.first = 0;
-  sustainStartAndEnd.second = 0;
-  double *channel_data = new double[numberOfSamples];
 
-  // Get channel data
-  SeparateStrongestChannel(channel_data);
+  // the same section as the other pitch methods use
+  unsigned firstFrame = 0;
+  unsigned length = 0;
+  GetPitchAnalysisRange(firstFrame, length);
+  if (length < 3) {
+    m_timeDomainPitch = 0;
+    return false; // cannot calculate pitch
+  }
 
-  // Get sustainsection start and end
-  sustainStartAndEnd.first = m_autoSustainStart;
-  sustainStartAndEnd.second = m_autoSustainEnd;
-  
-  // Check if sustainsection is not valid and if so just set the whole channel as sustain
-  if (sustainStartAndEnd.first == 0 && sustainStartAndEnd.second == 0) {
-    sustainStartAndEnd.first = 0;
-    sustainStartAndEnd.second = numberOfSamples - 1;
+  // if the section is longer than 2 seconds we limit it
+  if (length > m_samplerate * 2 + 1)
+    length = m_samplerate * 2 + 1;
+
+  // The pitch is found with the normalized square difference function
+  // (McLeod) of the section, which is
+  //   n(lag) = 2 * r(lag) / m(lag)
+  // where r is the autocorrelation and m the sum of the squares of both the
+  // frames that are compared. The autocorrelation of all lags is calculated
+  // at once through the FFT, as the transform of the power spectrum.
+
+  // at least two periods of the lowest pitch must fit in the section
+  unsigned maxLag = std::min(length / 2, (unsigned) (m_samplerate / MIN_TD_PITCH));
+  if (maxLag < 4) {
+    m_timeDomainPitch = 0;
+    return false;
   }
 
-  int startValue = sustainStartAndEnd.first;
-  int endValue = sustainStartAndEnd.second;
-  if (endValue - startValue < 2)
-    return false; // cannot calculate pitch
+  // zero padding to twice the length makes the correlation linear
+  unsigned fftSize = 1;
+  while (fftSize < 2 * length)
+    fftSize *= 2;
+  unsigned halfSize = fftSize / 2;
+  const FFTPlan *plan = FFTPlan::GetPlan(fftSize);
+
+  std::vector<double> frames(fftSize, 0.0);
+  ReadStrongestChannel(firstFrame, length, &frames[0]);
+
+  double mean = 0;
+  for (unsigned i = 0; i < length; i++)
+    mean += frames[i];
+  mean /= length;
+  for (unsigned i = 0; i < length; i++)
+    frames[i] -= mean;
+
+  std::vector<double> real(halfSize + 1);
+  std::vector<double> imag(halfSize + 1);
+  plan->RealTransform(&frames[0], &real[0], &imag[0]);
+
+  // the power spectrum is real and even so its inverse transform is the
+  // same as the forward transform, divided by the size
+  std::vector<double> power(fftSize);
+  for (unsigned k = 0; k <= halfSize; k++) {
+    power[k] = real[k] * real[k] + imag[k] * imag[k];
+    if (k > 0 && k < halfSize)
+      power[fftSize - k] = power[k];
+  }
+  plan->RealTransform(&power[0], &real[0], &imag[0]);
+
+  // m(lag) drops the square of the first frame and the last frame compared
+  // for each step of the lag
+  std::vector<double> nsdf(maxLag + 1);
+  double squares = 0;
+  for (unsigned i = 0; i < length; i++)
+    squares += frames[i] * frames[i];
+  squares *= 2;
+  for (unsigned lag = 0; lag <= maxLag; lag++) {
+    if (lag > 0)
+      squares -= frames[lag - 1] * frames[lag - 1] + frames[length - lag] * frames[length - lag];
+    double correlation = real[lag] / fftSize;
+    nsdf[lag] = squares > 0 ? 2 * correlation / squares : 0;
+  }
 
-  // if sustainsection is longer than 2 seconds we limit it
-  if (sustainStartAndEnd.second - sustainStartAndEnd.first > m_samplerate * 2)
-    sustainStartAndEnd.second = sustainStartAndEnd.first + m_samplerate * 2;
+  // The key maxima are the highest values of each part where the function
+  // is positive, after the first part that only is the lag around zero. The
+  // first one that is almost as high as the highest one is the period, the
+  // later ones are just multiples of it
+  std::vector<unsigned> keyMaxima;
+  double highestMaximum = 0;
+  unsigned lag = 1;
+  while (lag < maxLag && nsdf[lag] > 0)
+    lag++;
+  while (lag < maxLag) {
+    while (lag < maxLag && nsdf[lag] <= 0)
+      lag++;
+    unsigned peakLag = lag;
+    while (lag < maxLag && nsdf[lag] > 0) {
+      if (nsdf[lag] > nsdf[peakLag])
+        peakLag = lag;
+      lag++;
+    }
+    if (peakLag < maxLag) {
+      keyMaxima.push_back(peakLag);
+      if (nsdf[peakLag] > highestMaximum)
+        highestMaximum = nsdf[peakLag];
+    }
+  }
 
-  std::vector<double> allDetectedPitches;
-  double prev = channel_data[sustainStartAndEnd.second]; // Last sample
-  unsigned end_point = 0; // Preliminary value of the last sample of period
+  if (keyMaxima.empty() || highestMaximum < MIN_TD_CLARITY) {
+    m_timeDomainPitch = 0; /* Couldn't find out the pitch */
+    return false;
+  }
 
-  for (unsigned i = sustainStartAndEnd.second - 2; i > sustainStartAndEnd.first; i--) {
-    double v = channel_data[i];
+  unsigned periodLag = keyMaxima.back();
+  for (unsigned i = 0; i < keyMaxima.size(); i++) {
+    if (nsdf[keyMaxima[i]] >= TD_KEY_MAXIMUM_RATIO * highestMaximum) {
+      periodLag = keyMaxima[i];
+      break;
+    }
+  }
 
-    /* We are interested in positive zero crossings */
-    if ((v > 0.0) && (prev <= 0.0)) {
-      if (!end_point) {
-        end_point = i;
-      } else {
-        /* Found the next zero crossing - is this a good loop? */
-        unsigned len = end_point - i; /* no +1 as we don't want to look at the second crossover point */
-        if (i > len) {
-          unsigned prev_start_point = i - len;
-
-          /* Find the RMS of the first signal and compute the error of the second signal. */
-          double rms = 0.0;
-          double error_rms = 0.0;
-
-          for (unsigned j = 0; j < len; j++) {
-            double error = channel_data[j + prev_start_point] - channel_data[j + i];
-            double d     = channel_data[j + prev_start_point];
-
-            error *= error;
-            d *= d;
-            error_rms = error_rms * j / ((double)(j + 1)) + error / ((double)(j + 1));
-            rms = rms * j / ((double)(j + 1)) + d / ((double)(j + 1));
-          }
+  // parabolic interpolation of the lag between the frames
+  double period = periodLag;
+  double before = nsdf[periodLag - 1];
+  double atPeak = nsdf[periodLag];
+  double after = nsdf[periodLag + 1];
+  double denominator = before - 2 * atPeak + after;
+  if (denominator < 0)
+    period += 0.5 * (before - after) / denominator;
 
-          if ((error_rms > 0.0) && (rms > 0.0)) {
-            error_rms = sqrt(error_rms);
-            rms = sqrt(rms);
+  m_timeDomainPitch = (double) m_samplerate / period;
+  return true;
+}
 
-            if ((error_rms / rms) < 0.55) {
-              // store pitch
-              allDetectedPitches.push_back( ((double) m_samplerate) / (double) len );
-              // set endpoint for next period
-              end_point = i;
-            }
-          }
+double FileHandling::GetZoomPitch() {
+  bool gotPitch = DetectPitchByZoomFFT();
+  if (gotPitch)
+    return m_zoomPitch;
+  else
+    return 0;
+}
+
+/*
+ * The zoomed pitch is found in two stages. A modest FFT finds the
+ * fundamental to within a bin, then the spectrum of just the band around it
+ * is evaluated at much finer resolution. The band is so narrow that it's
+ * cheaper to evaluate its frequencies directly (a chirp-z transform without
+ * the convolution) than to do any transform of the whole section, and it
+ * needs no memory besides the grid. The grid is narrowed around
+ * the greatest value a few times and the final peak is interpolated.
+ */
+bool FileHandling::DetectPitchByZoomFFT() {
+  m_zoomPitch = 0;
+  // the coarse pass leaves the results of the FFT pitch method alone
+  FFTPitchResult coarse;
+  if (!FindFFTPitch(ZOOM_COARSE_FFT_SIZE, coarse) || coarse.pitch <= 0)
+    return false;
+
+  unsigned firstFrame;
+  unsigned nbrFrames;
+  GetPitchAnalysisRange(firstFrame, nbrFrames);
+  if (nbrFrames > ZOOM_MAX_SECONDS * m_samplerate)
+    nbrFrames = ZOOM_MAX_SECONDS * m_samplerate;
+
+  // Hann window over the whole range, its sidelobes fall off quickly enough
+  // to keep the other partials out of the band
+  double windowStep = 2 * M_PI / (nbrFrames - 1);
+
+  std::vector<double> magnitudes(ZOOM_GRID_POINTS);
+  std::vector<double> phaseReal(ZOOM_GRID_POINTS);
+  std::vector<double> phaseImag(ZOOM_GRID_POINTS);
+  std::vector<double> stepReal(ZOOM_GRID_POINTS);
+  std::vector<double> stepImag(ZOOM_GRID_POINTS);
+  std::vector<double> sumReal(ZOOM_GRID_POINTS);
+  std::vector<double> sumImag(ZOOM_GRID_POINTS);
+  std::vector<double> block(ZOOM_PHASOR_BLOCK);
+
+  // the true frequency is within a bin of the coarse peak
+  double center = coarse.pitch;
+  double halfBand = coarse.binWidth;
+  for (unsigned pass = 0; pass < ZOOM_PASSES; pass++) {
+    double lowest = center - halfBand;
+    if (lowest <= 0)
+      lowest = halfBand / ZOOM_GRID_POINTS;
+    double spacing = (center + halfBand - lowest) / (ZOOM_GRID_POINTS - 1);
+
+    for (unsigned k = 0; k < ZOOM_GRID_POINTS; k++) {
+      double omega = 2 * M_PI * (lowest + k * spacing) / m_samplerate;
+      stepReal[k] = cos(omega);
+      stepImag[k] = -sin(omega);
+      sumReal[k] = 0;
+      sumImag[k] = 0;
+    }
+
+    // the phasors (and the one of the window) are rotated one frame at a
+    // time and set again from the exact angle for each block so that the
+    // errors don't accumulate
+    double windowStepCos = cos(windowStep);
+    double windowStepSin = sin(windowStep);
+    for (unsigned blockStart = 0; blockStart < nbrFrames; blockStart += ZOOM_PHASOR_BLOCK) {
+      unsigned blockEnd = std::min(blockStart + ZOOM_PHASOR_BLOCK, nbrFrames);
+      double windowCos = cos(windowStep * blockStart);
+      double windowSin = sin(windowStep * blockStart);
+      for (unsigned k = 0; k < ZOOM_GRID_POINTS; k++) {
+        double angle = fmod(2 * M_PI * (lowest + k * spacing) / m_samplerate * blockStart, 2 * M_PI);
+        phaseReal[k] = cos(angle);
+        phaseImag[k] = -sin(angle);
+      }
+      ReadStrongestChannel(firstFrame + blockStart, blockEnd - blockStart, &block[0]);
+      for (unsigned i = blockStart; i < blockEnd; i++) {
+        double value = block[i - blockStart] * (0.5 - 0.5 * windowCos);
+        double c = windowCos * windowStepCos - windowSin * windowStepSin;
+        windowSin = windowCos * windowStepSin + windowSin * windowStepCos;
+        windowCos = c;
+        for (unsigned k = 0; k < ZOOM_GRID_POINTS; k++) {
+          sumReal[k] += value * phaseReal[k];
+          sumImag[k] += value * phaseImag[k];
+          double re = phaseReal[k] * stepReal[k] - phaseImag[k] * stepImag[k];
+          phaseImag[k] = phaseReal[k] * stepImag[k] + phaseImag[k] * stepReal[k];
+          phaseReal[k] = re;
         }
       }
     }
-    prev = v;
+
+    unsigned greatest = 0;
+    for (unsigned k = 0; k < ZOOM_GRID_POINTS; k++) {
+      magnitudes[k] = sumReal[k] * sumReal[k] + sumImag[k] * sumImag[k];
+      if (magnitudes[k] > magnitudes[greatest])
+        greatest = k;
+    }
+    if (magnitudes[greatest] <= 0)
+      return false;
+
+    // the peak of the main lobe is close to a parabola in dB
+    center = lowest + greatest * spacing;
+    if (greatest > 0 && greatest < ZOOM_GRID_POINTS - 1) {
+      double before = log(magnitudes[greatest - 1]);
+      double atPeak = log(magnitudes[greatest]);
+      double after = log(magnitudes[greatest + 1]);
+      double denominator = before - 2 * atPeak + after;
+      if (denominator < 0)
+        center += 0.5 * (before - after) / denominator * spacing;
+    }
+    halfBand = 2 * spacing;
   }
 
-  delete[] channel_data;
+  m_zoomPitch = center;
+  return true;
+}
 
-  if (!allDetectedPitches.empty() && allDetectedPitches.size() > 1) {
-    double pitchSum = 0.0;
-    for (unsigned i = 0; i < allDetectedPitches.size(); i++)
-      pitchSum += allDetectedPitches[i];
+/*
+ * The phase vocoder pitch is the instantaneous frequency of the fundamental,
+ * which is given as found by the FFT pitch method. The phase
+ * of the peak bin advances by exactly 2 * pi * frequency * hop / samplerate
+ * from one frame to the next, so the deviation from the advance of the bin
+ * centre gives the frequency within the bin. With a hop of a quarter frame
+ * this is unambiguous within two bins of the centre. The frequencies of all
+ * the frame pairs are averaged, weighted by the magnitude.
+ */
+bool FileHandling::DetectPitchByPhaseVocoder(double fundamental) {
+  m_phaseVocoderPitch = 0;
+  if (fundamental <= 0)
+    return false;
 
-    double meanTdPitch = pitchSum / allDetectedPitches.size();
+  unsigned firstFrame;
+  unsigned nbrFrames;
+  GetPitchAnalysisRange(firstFrame, nbrFrames);
 
-    double varianceSum = 0;
-    for (unsigned i = 0; i < allDetectedPitches.size(); i++) {
-      varianceSum += pow(allDetectedPitches[i] - meanTdPitch, 2);
+  unsigned frameSize = PV_MIN_FRAME_SIZE;
+  while (frameSize < PV_MAX_FRAME_SIZE && frameSize * fundamental < PV_MIN_BINS * m_samplerate)
+    frameSize *= 2;
+  unsigned hop = frameSize / PV_HOP_DIVISOR;
+  if (nbrFrames < frameSize + hop)
+    return false;
+  unsigned nbrAnalysisFrames = std::min((nbrFrames - frameSize) / hop + 1, PV_MAX_FRAMES);
+
+  double binWidth = (double) m_samplerate / frameSize;
+  unsigned centerBin = lround(fundamental / binWidth);
+  if (centerBin < 2 || centerBin + 2 > frameSize / 2)
+    return false;
+
+  const FFTPlan *plan = FFTPlan::GetPlan(frameSize);
+  const double *window = WindowTable(3, frameSize);
+  std::vector<double> frame(frameSize);
+  std::vector<double> real(frameSize / 2 + 1);
+  std::vector<double> imag(frameSize / 2 + 1);
+  std::vector<double> previousPhase(3);
+
+  double weightedSum = 0;
+  double weights = 0;
+  for (unsigned f = 0; f < nbrAnalysisFrames; f++) {
+    ReadStrongestChannel(firstFrame + f * hop, frameSize, &frame[0]);
+    for (unsigned i = 0; i < frameSize; i++)
+      frame[i] *= window[i];
+    plan->RealTransform(&frame[0], &real[0], &imag[0]);
+
+    // the peak is the strongest of the bins around the fundamental
+    unsigned peak = centerBin - 1;
+    double peakPower = 0;
+    for (unsigned k = centerBin - 1; k <= centerBin + 1; k++) {
+      double power = real[k] * real[k] + imag[k] * imag[k];
+      if (power > peakPower) {
+        peakPower = power;
+        peak = k;
+      }
     }
-    double variance = varianceSum / allDetectedPitches.size();
-    double stdDeviation = sqrt(variance);
 
-    std::vector<double> usableValues;
-    for (unsigned i = 0; i < allDetectedPitches.size(); i++) {
-      if (allDetectedPitches[i] > (meanTdPitch - stdDeviation / 2.0) && allDetectedPitches[i] < (meanTdPitch + stdDeviation / 2.0))
-        usableValues.push_back(allDetectedPitches[i]);
+    if (f > 0 && peakPower > 0) {
+      double expected = 2 * M_PI * peak * hop / frameSize;
+      double deviation = atan2(imag[peak], real[peak]) - previousPhase[peak - centerBin + 1] - expected;
+      deviation -= 2 * M_PI * floor(deviation / (2 * M_PI) + 0.5);
+      double frequency = (peak + deviation * frameSize / (2 * M_PI * hop)) * binWidth;
+      double weight = sqrt(peakPower);
+      weightedSum += frequency * weight;
+      weights += weight;
     }
+    for (unsigned k = 0; k < 3; k++)
+      previousPhase[k] = atan2(imag[centerBin - 1 + k], real[centerBin - 1 + k]);
+  }
 
-    if (!usableValues.empty()) {
-      pitchSum = 0;
-      for (unsigned i = 0; i < usableValues.size(); i++)
-        pitchSum += usableValues[i];
+  if (weights <= 0)
+    return false;
 
-      m_timeDomainPitch = pitchSum / usableValues.size();
-      return true;
-    } else {
-      m_timeDomainPitch = meanTdPitch; /* Falling back to mean value */
-      return true;
+  m_phaseVocoderPitch = weightedSum / weights;
+  return true;
+}
+
+/*
+ * The harmonics are measured with a bank of Goertzel filters, a grid of
+ * them around each harmonic, that all run in the same pass over the frames.
+ * The peak of each grid is interpolated as a parabola in log magnitude like
+ * the zoomed pitch. The frames are Hann windowed, which scales the
+ * magnitude of a sinusoid to a quarter of its amplitude times the length.
+ */
+bool FileHandling::MeasureHarmonics(double fundamental, unsigned nbrHarmonics, std::vector<HarmonicMeasurement> &harmonics) {
+  harmonics.clear();
+  if (fundamental <= 0 || nbrHarmonics == 0 || m_audio->IsEmpty())
+    return false;
+
+  unsigned firstFrame;
+  unsigned nbrFrames;
+  GetPitchAnalysisRange(firstFrame, nbrFrames);
+  if (nbrFrames > HARMONIC_SECONDS * m_samplerate)
+    nbrFrames = HARMONIC_SECONDS * m_samplerate;
+  if (nbrFrames < MIN_PITCH_FRAMES)
+    return false;
+
+  // the grid spacing is one bin of the analysed frames, a quarter of the
+  // main lobe of the window, where the parabola fits the log magnitude well
+  double spacing = (double) m_samplerate / nbrFrames;
+  unsigned gridSize = 2 * HARMONIC_GRID_HALF + 1;
+  unsigned nbrFilters = 0;
+  std::vector<double> coefficients;
+  std::vector<double> frequencies;
+  for (unsigned h = 1; h <= nbrHarmonics; h++) {
+    double center = h * fundamental;
+    if (center + HARMONIC_GRID_HALF * spacing >= m_samplerate / 2.0)
+      break;
+    for (unsigned k = 0; k < gridSize; k++) {
+      double frequency = center + ((int) k - (int) HARMONIC_GRID_HALF) * spacing;
+      frequencies.push_back(frequency);
+      coefficients.push_back(2 * cos(2 * M_PI * frequency / m_samplerate));
     }
-  } else if (allDetectedPitches.size() == 1) {
-    m_timeDomainPitch = allDetectedPitches[0];
-    return true;
-  } else {
-    m_timeDomainPitch = 0; /* Couldn't find out the pitch */
+    nbrFilters += gridSize;
+  }
+  if (!nbrFilters)
     return false;
+
+  std::vector<double> previous(nbrFilters, 0.0);
+  std::vector<double> beforePrevious(nbrFilters, 0.0);
+  std::vector<double> block(std::min(READ_BLOCK_FRAMES, nbrFrames));
+  double windowStep = 2 * M_PI / (nbrFrames - 1);
+  for (unsigned j = 0; j < nbrFrames; j += READ_BLOCK_FRAMES) {
+    unsigned framesInBlock = std::min(READ_BLOCK_FRAMES, nbrFrames - j);
+    ReadStrongestChannel(firstFrame + j, framesInBlock, &block[0]);
+    for (unsigned i = j; i < j + framesInBlock; i++) {
+      double value = block[i - j] * (0.5 - 0.5 * cos(windowStep * i));
+      for (unsigned k = 0; k < nbrFilters; k++) {
+        double current = value + coefficients[k] * previous[k] - beforePrevious[k];
+        beforePrevious[k] = previous[k];
+        previous[k] = current;
+      }
+    }
   }
+
+  std::vector<double> magnitudes(gridSize);
+  for (unsigned first = 0; first < nbrFilters; first += gridSize) {
+    unsigned greatest = 0;
+    for (unsigned k = 0; k < gridSize; k++) {
+      double s1 = previous[first + k];
+      double s2 = beforePrevious[first + k];
+      magnitudes[k] = s1 * s1 + s2 * s2 - coefficients[first + k] * s1 * s2;
+      if (magnitudes[k] > magnitudes[greatest])
+        greatest = k;
+    }
+
+    HarmonicMeasurement harmonic;
+    harmonic.m_frequency = frequencies[first + greatest];
+    double peak = magnitudes[greatest];
+    if (greatest > 0 && greatest < gridSize - 1 && magnitudes[greatest - 1] > 0 && magnitudes[greatest + 1] > 0) {
+      double before = log(magnitudes[greatest - 1]);
+      double atPeak = log(magnitudes[greatest]);
+      double after = log(magnitudes[greatest + 1]);
+      double denominator = before - 2 * atPeak + after;
+      if (denominator < 0) {
+        double offset = 0.5 * (before - after) / denominator;
+        harmonic.m_frequency += offset * spacing;
+        peak = exp(atPeak - 0.25 * (before - after) * offset);
+      }
+    }
+    harmonic.m_amplitude = 4 * sqrt(std::max(peak, 0.0)) / nbrFrames;
+    harmonics.push_back(harmonic);
+  }
+
+  return true;
 }
 
 double FileHandling::GetTDPitch() {
@@ -793,13 +1300,9 @@ double FileHandling::GetTDPitch() {
 }
 
 void FileHandling::PerformCrossfade(int loopNumber, double fadeLength, int fadeType) {
-  // get the audio data as doubles
-  double *audioData = new double[ArrayLength];
-  bool gotData = GetDoubleAudioData(audioData);
-  
-  if (!gotData)
+  if (m_audio->IsEmpty())
     return;
-  
+
   LOOPDATA loopToCrossfade;
   m_loops->GetLoopData(loopNumber, loopToCrossfade);
   unsigned samplesToFade = m_samplerate * fadeLength;
@@ -813,10 +1316,6 @@ void FileHandling::PerformCrossfade(int loopNumber, double fadeLength, int fadeT
   if ((samplesToFadeOut + loopToCrossfade.dwEnd + 1) * m_channels > ArrayLength)
     samplesToFadeOut = (ArrayLength / m_channels) - (loopToCrossfade.dwEnd + 1);
 
-  unsigned firstTargetIdx = (loopToCrossfade.dwEnd - (samplesToFade - 1)) * m_channels;
-  unsigned firstSourceIdx = (loopToCrossfade.dwStart - samplesToFade) * m_channels;
-  unsigned secondTargetIdx = (loopToCrossfade.dwEnd + 1) * m_channels;
-  unsigned secondSourceIdx = loopToCrossfade.dwStart * m_channels;
 
   // prepare arrays for the crossfade curve data
   double *fadeData = new double[samplesToFade];
@@ -880,85 +1379,75 @@ void FileHandling::PerformCrossfade(int loopNumber, double fadeLength, int fadeT
   // and the new sample after loopEnd will be identical to loopStart
   // with crossfades to either side of loopEnd with source from loopStart
 
-  for (unsigned i = 0; i < samplesToFade; i++) {
-    for (int j = 0; j < m_channels; j++) {
-      audioData[firstTargetIdx + j] = 
-        audioData[firstTargetIdx + j] * fadeData[samplesToFade - 1 - i] +
-        audioData[firstSourceIdx + j] * fadeData[i];
-    }
-    firstTargetIdx += m_channels;
-    firstSourceIdx += m_channels;
-  }
+  // the fade in to the loop end uses the curve reversed for the old data
+  double *reversedFadeData = new double[samplesToFade];
+  for (unsigned i = 0; i < samplesToFade; i++)
+    reversedFadeData[i] = fadeData[samplesToFade - 1 - i];
+  double *reversedFadeOutData = new double[samplesToFadeOut];
+  for (unsigned i = 0; i < samplesToFadeOut; i++)
+    reversedFadeOutData[i] = fadeOutData[samplesToFadeOut - 1 - i];
 
-  for (unsigned i = 0; i < samplesToFadeOut; i++) {
-    for (int j = 0; j < m_channels; j++) {
-      audioData[secondTargetIdx + j] = 
-        audioData[secondTargetIdx + j] * fadeOutData[i] +
-        audioData[secondSourceIdx + j] * fadeOutData[samplesToFadeOut - 1 - i];
-    }
-    secondTargetIdx += m_channels;
-    secondSourceIdx += m_channels;
-  }
-  
-  // update the waveform data with the new data
-  UpdateWaveTracks(audioData);
-
-  // change the current audiodata stored after crossfade is done
-  if (shortAudioData != NULL) {
-    for (unsigned i = 0; i < ArrayLength; i++)
-      shortAudioData[i] = lrint(audioData[i] * (1.0 * 0x7FFF));
-  } else if (intAudioData != NULL) {
-    for (unsigned i = 0; i < ArrayLength; i++)
-      intAudioData[i] = lrint(audioData[i] * (1.0 * 0x7FFFFFFF));
-  } else if (doubleAudioData != NULL) {
-    for (unsigned i = 0; i < ArrayLength; i++)
-      doubleAudioData[i] = audioData[i];
-  }
-  if (floatAudioData != NULL) {
-    // this should always be the case as it's used for playback
-    for (unsigned i = 0; i < ArrayLength; i++)
-      floatAudioData[i] = (float) audioData[i];
-  }
-  delete[] audioData;
+  m_audio->Crossfade(loopToCrossfade.dwEnd + 1 - samplesToFade, loopToCrossfade.dwStart - samplesToFade, samplesToFade, reversedFadeData, fadeData);
+  m_audio->Crossfade(loopToCrossfade.dwEnd + 1, loopToCrossfade.dwStart, samplesToFadeOut, fadeOutData, reversedFadeOutData);
+
+  delete[] reversedFadeData;
+  delete[] reversedFadeOutData;
   delete[] fadeData;
   delete[] fadeOutData;
 }
 
-void FileHandling::SeparateStrongestChannel(double outData[]) {
-  if (!waveTracks.empty()) {
-    if (m_channels > 1) {
-      // we have more than one channel so deal with that
-      double maxRMS = 0.0;
-      unsigned strongestChannelIdx = 0;
-      for (unsigned i = 0; i < waveTracks.size(); i++) {
-        // this is done for each channel
-        double channelRMS = 0.0;
-        double totalValues = 0.0;
-        for (unsigned j = 0; j < waveTracks[i].waveData.size(); j++) {
-          double currentValue = pow(waveTracks[i].waveData[j], 2);
-          totalValues += currentValue;
-        }
-        channelRMS = sqrt((totalValues / waveTracks[i].waveData.size()));
+void FileHandling::ReadStrongestChannel(unsigned firstFrame, unsigned nbrFrames, double outData[]) {
+  if (nbrFrames)
+    m_audio->ReadTrack(GetStrongestChannelIndex(), firstFrame, nbrFrames, outData);
+}
 
-        if (channelRMS > maxRMS) {
-          maxRMS = channelRMS;
-          strongestChannelIdx = i;
-        }
+int FileHandling::GetStrongestChannelIndex() {
+  UpdateStatistics();
+  return m_strongestChannel;
+}
+
+double FileHandling::GetChannelPeak(int channel) {
+  UpdateStatistics();
+  return m_channelPeak[channel];
+}
+
+void FileHandling::UpdateStatistics() {
+  if (m_statsAreValid && m_statsChangeCount == m_audio->GetChangeCount())
+    return;
+
+  int channels = m_audio->GetChannels();
+  unsigned nbrFrames = m_audio->GetFrames();
+  m_channelPeak.assign(channels, 0.0);
+  m_strongestChannel = 0;
+
+  // the peak and the RMS of a channel are found in the same pass over it,
+  // the strongest channel is the one with the highest RMS
+  std::vector<double> block(std::min(READ_BLOCK_FRAMES, nbrFrames));
+  double maxRMS = 0.0;
+  for (int i = 0; i < channels && nbrFrames > 0; i++) {
+    double totalSquares = 0.0;
+    double peak = 0.0;
+    for (unsigned j = 0; j < nbrFrames; j += READ_BLOCK_FRAMES) {
+      unsigned framesInBlock = std::min(READ_BLOCK_FRAMES, nbrFrames - j);
+      m_audio->ReadTrack(i, j, framesInBlock, &block[0]);
+      for (unsigned k = 0; k < framesInBlock; k++) {
+        double value = block[k];
+        totalSquares += value * value;
+        if (fabs(value) > peak)
+          peak = fabs(value);
       }
-      // now we should know which channel has the highest RMS
-      for (unsigned i = 0; i < waveTracks[strongestChannelIdx].waveData.size(); i++)
-        outData[i] = waveTracks[strongestChannelIdx].waveData[i];
-    } else {
-      // there's just one channel so copy that double data
-      for (unsigned i = 0; i < waveTracks[0].waveData.size(); i++)
-        outData[i] = waveTracks[0].waveData[i];
     }
-  } else {
-    // for some reason there's no data in the waveTracks!
-    // for safety we then fill the outData array with zeros
-    for (unsigned i = 0; i < ArrayLength / m_channels; i++)
-        outData[i] = 0.0;
+    double rms = sqrt(totalSquares / nbrFrames);
+    m_channelPeak[i] = peak;
+
+    if (rms > maxRMS) {
+      maxRMS = rms;
+      m_strongestChannel = i;
+    }
   }
+
+  m_statsChangeCount = m_audio->GetChangeCount();
+  m_statsAreValid = true;
 }
 
 void FileHandling::CalculateSustainStartAndEnd() {
@@ -970,11 +1459,6 @@ void FileHandling::CalculateSustainStartAndEnd() {
     m_autoSustainEnd = 0;
     return;
   }
-  double *ch_data = new double[numberOfSamples];
-
-  // populate channel data
-  SeparateStrongestChannel(ch_data);
-
   // now detect sustain section
   // set a window size (mono now!)
   std::vector<double> rmsWindowValues;
@@ -982,34 +1466,29 @@ void FileHandling::CalculateSustainStartAndEnd() {
   if (windowSize > numberOfSamples)
     windowSize = numberOfSamples - 1;
 
-  // Find strongest value of any windowSize in file audio
-  double maxValue = 0.0;
-  double individualMax = 0.0;
-  unsigned indexWithMaxValue = 0;
+  // RMS of every windowSize in file audio (of the strongest channel), read
+  // a block at a time
   double rmsOfWholeFile = 0.0;
-  for (unsigned idx = 0; idx < numberOfSamples - windowSize; idx += windowSize) {
-    double totalValues = 0.0;
-    double rmsInThisWindow = 0.0;
-    for (unsigned j = idx; j < idx + windowSize; j++) {
-      double currentValue = pow(ch_data[j], 2);
-      totalValues += currentValue;
-      if (currentValue > individualMax) {
-        individualMax = currentValue;
-        indexWithMaxValue = j;
+  unsigned nbrWindows = windowSize ? (numberOfSamples - 1) / windowSize : 0;
+  unsigned framesInWindows = nbrWindows * windowSize;
+  std::vector<double> block(std::min(READ_BLOCK_FRAMES, numberOfSamples));
+  double windowEnergy = 0.0;
+  unsigned framesInWindow = 0;
+  for (unsigned j = 0; j < framesInWindows; j += READ_BLOCK_FRAMES) {
+    unsigned framesInBlock = std::min(READ_BLOCK_FRAMES, framesInWindows - j);
+    ReadStrongestChannel(j, framesInBlock, &block[0]);
+    for (unsigned k = 0; k < framesInBlock; k++) {
+      windowEnergy += block[k] * block[k];
+      if (++framesInWindow == windowSize) {
+        double rmsInThisWindow = sqrt(windowEnergy / windowSize);
+        rmsWindowValues.push_back(rmsInThisWindow);
+        rmsOfWholeFile += rmsInThisWindow;
+        windowEnergy = 0.0;
+        framesInWindow = 0;
       }
     }
-    rmsInThisWindow = sqrt((totalValues / windowSize));
-    rmsWindowValues.push_back(rmsInThisWindow);
-    rmsOfWholeFile += rmsInThisWindow;
-
-    if (rmsInThisWindow > maxValue) {
-      maxValue = rmsInThisWindow;
-    }
   }
 
-  // clean up
-  delete[] ch_data;
-
   if (rmsWindowValues.size()) {
     rmsOfWholeFile /= rmsWindowValues.size();
     unsigned firstStartIndexAboveAverageRMS = 0;
@@ -1107,190 +1586,40 @@ void FileHandling::TrimExcessData() {
       }
     }
 
-    long unsigned newArrayLength = (lastEndSample + 3) * m_channels;
+    // the audio up to two samples after the last loop end is kept
+    unsigned framesToKeep = lastEndSample + 3;
+    if (framesToKeep > m_audio->GetFrames())
+      framesToKeep = m_audio->GetFrames();
 
     if (firstCuePosAfter) {
-      newArrayLength += (ArrayLength - ((firstCuePosAfter - 1) * m_channels));
-
-      // we must also move one or more cues to new positions
-      unsigned samplesToRemove = (firstCuePosAfter - 1) - (lastEndSample + 3);
-      for (unsigned i = 0; i < m_cues->GetNumberOfCues(); i++) {
-        CUEPOINT currentCue;
-        m_cues->GetCuePoint(i, currentCue);
-        if (currentCue.dwSampleOffset > lastEndSample) {
-          unsigned newCuePosition = currentCue.dwSampleOffset - samplesToRemove;
-          m_cues->ChangePosition(newCuePosition, i);
-        }
-      }
-    }
-
-    // Time to copy data to a temporary array and then to cleaned target array
-    if ((m_minorFormat == SF_FORMAT_DOUBLE) || (m_minorFormat == SF_FORMAT_FLOAT)) {
-      double *audioData = new double[newArrayLength];
-
-      for (unsigned i = 0; i < (lastEndSample + 3) * m_channels; i++)
-        audioData[i] = doubleAudioData[i];
-
-      if (firstCuePosAfter) {
-        unsigned newIdx = (lastEndSample + 3) * m_channels;
-        for (unsigned i = (firstCuePosAfter - 1) * m_channels; i < ArrayLength; i++) {
-          audioData[newIdx] = doubleAudioData[i];
-          newIdx++;
-        }
-      }
-
-      delete[] doubleAudioData;
-      doubleAudioData = new double[newArrayLength];
-      ArrayLength = newArrayLength;
-
-      for (unsigned i = 0; i < ArrayLength; i++)
-        doubleAudioData[i] = audioData[i];
-
-      delete[] audioData;
-    } else if ((m_minorFormat == SF_FORMAT_PCM_16) || (m_minorFormat == SF_FORMAT_PCM_S8) || (m_minorFormat == SF_FORMAT_PCM_U8)) {
-      short *audioData = new short[newArrayLength];
-
-      for (unsigned i = 0; i < (lastEndSample + 3) * m_channels; i++)
-        audioData[i] = shortAudioData[i];
-
-      if (firstCuePosAfter) {
-        unsigned newIdx = (lastEndSample + 3) * m_channels;
-        for (unsigned i = (firstCuePosAfter - 1) * m_channels; i < ArrayLength; i++) {
-          audioData[newIdx] = shortAudioData[i];
-          newIdx++;
+      // the data from just before the cue is also kept
+      if (firstCuePosAfter - 1 > framesToKeep) {
+        // we must also move one or more cues to new positions
+        unsigned samplesToRemove = (firstCuePosAfter - 1) - framesToKeep;
+        for (unsigned i = 0; i < m_cues->GetNumberOfCues(); i++) {
+          CUEPOINT currentCue;
+          m_cues->GetCuePoint(i, currentCue);
+          if (currentCue.dwSampleOffset > lastEndSample) {
+            unsigned newCuePosition = currentCue.dwSampleOffset - samplesToRemove;
+            m_cues->ChangePosition(newCuePosition, i);
+          }
         }
+        m_audio->Erase(framesToKeep, samplesToRemove);
       }
-
-      delete[] shortAudioData;
-      shortAudioData = new short[newArrayLength];
-      ArrayLength = newArrayLength;
-
-      for (unsigned i = 0; i < ArrayLength; i++)
-        shortAudioData[i] = audioData[i];
-
-      delete[] audioData;
     } else {
-      int *audioData = new int[newArrayLength];
-
-      for (unsigned i = 0; i < (lastEndSample + 3) * m_channels; i++)
-        audioData[i] = intAudioData[i];
-
-      if (firstCuePosAfter) {
-        unsigned newIdx = (lastEndSample + 3) * m_channels;
-        for (unsigned i = (firstCuePosAfter - 1) * m_channels; i < ArrayLength; i++) {
-          audioData[newIdx] = intAudioData[i];
-          newIdx++;
-        }
-      }
-
-      delete[] intAudioData;
-      intAudioData = new int[newArrayLength];
-      ArrayLength = newArrayLength;
-
-      for (unsigned i = 0; i < ArrayLength; i++)
-        intAudioData[i] = audioData[i];
-
-      delete[] audioData;
+      m_audio->Trim(0, framesToKeep);
     }
+    ArrayLength = m_audio->GetLength();
   }
 }
 
 bool FileHandling::TrimStart(unsigned timeToTrim) {
   // convert time to samples
   unsigned samples = (timeToTrim / 1000.0) * m_samplerate;
-  unsigned samplesToCut = samples * m_channels;
-
-  if (samplesToCut < ArrayLength) {
-    // calculate new arraylength
-    long unsigned newArrayLength = ArrayLength - samplesToCut;
-
-    if (m_minorFormat == SF_FORMAT_DOUBLE) {
-      double *audioData = new double[newArrayLength];
-
-      for (unsigned i = 0; i < newArrayLength; i++)
-        audioData[i] = doubleAudioData[samplesToCut + i];
-
-      delete[] doubleAudioData;
-      doubleAudioData = new double[newArrayLength];
-      ArrayLength = newArrayLength;
-
-      for (unsigned i = 0; i < ArrayLength; i++)
-        doubleAudioData[i] = audioData[i];
-
-      delete[] audioData;
-
-    } else if ((m_minorFormat == SF_FORMAT_PCM_16) || (m_minorFormat == SF_FORMAT_PCM_S8) || (m_minorFormat == SF_FORMAT_PCM_U8)) {
-      short *audioData = new short[newArrayLength];
-
-      double *oldDblData = new double[ArrayLength];
-      bool gotData = GetDoubleAudioData(oldDblData);
-
-      if (!gotData)
-        return false;
-
-      for (unsigned i = 0; i < newArrayLength; i++)
-        audioData[i] = shortAudioData[samplesToCut + i];
-
-      delete[] shortAudioData;
-      shortAudioData = new short[newArrayLength];
-
-      for (unsigned i = 0; i < newArrayLength; i++)
-        shortAudioData[i] = audioData[i];
-      
-      delete[] audioData;
-
-    } else if ((m_minorFormat == SF_FORMAT_PCM_24) || (m_minorFormat == SF_FORMAT_PCM_32)) {
-      int *audioData = new int[newArrayLength];
-
-      double *oldDblData = new double[ArrayLength];
-      bool gotData = GetDoubleAudioData(oldDblData);
-
-      if (!gotData)
-        return false;
-
-      for (unsigned i = 0; i < newArrayLength; i++)
-        audioData[i] = intAudioData[samplesToCut + i];
-
-      delete[] intAudioData;
-      intAudioData = new int[newArrayLength];
-
-      for (unsigned i = 0; i < newArrayLength; i++)
-        intAudioData[i] = audioData[i];
-
-      delete[] audioData;
 
-    }
-
-    // always update float data as it's used for playback
-    float *audioData = new float[newArrayLength];
-
-    double *oldDblData = new double[ArrayLength];
-    bool gotData = GetDoubleAudioData(oldDblData);
-
-    if (!gotData)
-      return false;
-
-    for (unsigned i = 0; i < newArrayLength; i++)
-    audioData[i] = floatAudioData[samplesToCut + i];
-
-    delete[] floatAudioData;
-    floatAudioData = new float[newArrayLength];
-
-    for (unsigned i = 0; i < newArrayLength; i++)
-      floatAudioData[i] = audioData[i];
-
-    // update the double data in wavetracks too!
-    double *newDblData = new double[newArrayLength];
-    for (unsigned i = 0; i < newArrayLength; i++)
-      newDblData[i] = oldDblData[samplesToCut + i];
-        
-    ArrayLength = newArrayLength;
-      
-    UpdateWaveTracks(newDblData);
-      
-    delete[] audioData;
-    delete[] newDblData;
-    delete[] oldDblData;
+  if (samples < m_audio->GetFrames()) {
+    m_audio->Trim(samples, m_audio->GetFrames() - samples);
+    ArrayLength = m_audio->GetLength();
 
     // if loops and/or cues exist they must now be moved!
     m_loops->MoveLoops(samples);
@@ -1305,91 +1634,10 @@ bool FileHandling::TrimStart(unsigned timeToTrim) {
 bool FileHandling::TrimEnd(unsigned timeToTrim) {
   // convert time to samples
   unsigned samples = (timeToTrim / 1000.0) * m_samplerate;
-  unsigned samplesToCut = samples * m_channels;
-
-  if (samplesToCut < ArrayLength) {
-    // calculate new arraylength
-    long unsigned newArrayLength = ArrayLength - samplesToCut;
-
-    if (m_minorFormat == SF_FORMAT_DOUBLE) {
-      double *audioData = new double[newArrayLength];
-
-      for (unsigned i = 0; i < newArrayLength; i++)
-        audioData[i] = doubleAudioData[i];
-
-      delete[] doubleAudioData;
-      doubleAudioData = new double[newArrayLength];
-      ArrayLength = newArrayLength;
-
-      for (unsigned i = 0; i < ArrayLength; i++)
-        doubleAudioData[i] = audioData[i];
-
-      delete[] audioData;
-
-    } else if ((m_minorFormat == SF_FORMAT_PCM_16) || (m_minorFormat == SF_FORMAT_PCM_S8) || (m_minorFormat == SF_FORMAT_PCM_U8)) {
-      short *audioData = new short[newArrayLength];
-      
-      double *oldDblData = new double[ArrayLength];
-      bool gotData = GetDoubleAudioData(oldDblData);
-
-      if (!gotData)
-        return false;
-
-      for (unsigned i = 0; i < newArrayLength; i++)
-        audioData[i] = shortAudioData[i];
-
-      delete[] shortAudioData;
-      shortAudioData = new short[newArrayLength];
-
-      for (unsigned i = 0; i < newArrayLength; i++)
-        shortAudioData[i] = audioData[i];
-
-      delete[] audioData;
 
-    } else if ((m_minorFormat == SF_FORMAT_PCM_24) || (m_minorFormat == SF_FORMAT_PCM_32)){
-      int *audioData = new int[newArrayLength];
-
-      for (unsigned i = 0; i < newArrayLength; i++)
-        audioData[i] = intAudioData[i];
-
-      delete[] intAudioData;
-      intAudioData = new int[newArrayLength];
-
-      for (unsigned i = 0; i < newArrayLength; i++)
-        intAudioData[i] = audioData[i];
-
-      delete[] audioData;
-    }
-    
-    // always update float audio data since it's used for playback
-    float *audioData = new float[newArrayLength];
-
-    double *oldDblData = new double[ArrayLength];
-    bool gotData = GetDoubleAudioData(oldDblData);
-
-    if (!gotData)
-      return false;
-
-    for (unsigned i = 0; i < newArrayLength; i++)
-      audioData[i] = floatAudioData[i];
-
-    delete[] floatAudioData;
-    floatAudioData = new float[newArrayLength];
-    for (unsigned i = 0; i < newArrayLength; i++)
-      floatAudioData[i] = audioData[i];
-
-    // update the double data in wavetracks too
-    double *dblData = new double[newArrayLength];
-    for (unsigned i = 0; i < newArrayLength; i++)
-      dblData[i] = oldDblData[i];
-
-    ArrayLength = newArrayLength;
-
-    UpdateWaveTracks(dblData);
-
-    delete[] audioData;
-    delete[] dblData;
-    delete[] oldDblData;
+  if (samples < m_audio->GetFrames()) {
+    m_audio->Trim(0, m_audio->GetFrames() - samples);
+    ArrayLength = m_audio->GetLength();
 
     // Check if loops and/or cues still is within audio data!
     m_loops->AreLoopsStillValid(ArrayLength);
@@ -1500,64 +1748,8 @@ bool FileHandling::TrimAudioToLastCue() {
 }
 
 void FileHandling::TrimAudioData(unsigned startIdx, unsigned long int newLength) {
-  if ((m_minorFormat == SF_FORMAT_DOUBLE) || (m_minorFormat == SF_FORMAT_FLOAT)) {
-    double *audioData = new double[newLength];
-
-    for (unsigned i = 0; i < newLength; i++)
-      audioData[i] = doubleAudioData[startIdx + i];
-
-    delete[] doubleAudioData;
-    doubleAudioData = new double[newLength];
-
-    for (unsigned i = 0; i < newLength; i++)
-      doubleAudioData[i] = audioData[i];
-
-    delete[] audioData;
-
-  } else if ((m_minorFormat == SF_FORMAT_PCM_16) || (m_minorFormat == SF_FORMAT_PCM_S8) || (m_minorFormat == SF_FORMAT_PCM_U8)) {
-    short *audioData = new short[newLength];
-
-    for (unsigned i = 0; i < newLength; i++)
-      audioData[i] = shortAudioData[startIdx + i];
-
-    delete[] shortAudioData;
-    shortAudioData = new short[newLength];
-
-    for (unsigned i = 0; i < newLength; i++)
-      shortAudioData[i] = audioData[i];
-
-    delete[] audioData;
-
-  } else if ((m_minorFormat == SF_FORMAT_PCM_24) || (m_minorFormat == SF_FORMAT_PCM_32)) {
-    int *audioData = new int[newLength];
-
-    for (unsigned i = 0; i < newLength; i++)
-      audioData[i] = intAudioData[startIdx + i];
-
-    delete[] intAudioData;
-    intAudioData = new int[newLength];
-
-    for (unsigned i = 0; i < newLength; i++)
-      intAudioData[i] = audioData[i];
-
-    delete[] audioData;
-  }
-
-  // also update float data as it always exist
-  float *audioData = new float[newLength];
-
-  for (unsigned i = 0; i < newLength; i++)
-    audioData[i] = floatAudioData[startIdx + i];
-
-  delete[] floatAudioData;
-  floatAudioData = new float[newLength];
-
-  for (unsigned i = 0; i < newLength; i++)
-    floatAudioData[i] = audioData[i];
-
-  ArrayLength = newLength;
-
-  delete[] audioData;
+  m_audio->Trim(startIdx / m_channels, newLength / m_channels);
+  ArrayLength = m_audio->GetLength();
 }
 
 /*
@@ -1574,8 +1766,10 @@ bool FileHandling::ExportLoopAsNewFile(wxString fileName, wxString path, int loo
   if (loopToExport.dwEnd <= loopToExport.dwStart)
     return false;
 
+  if (loopToExport.dwEnd + 2 > m_audio->GetFrames())
+    return false;
+
   unsigned arrayLength = (loopToExport.dwEnd - loopToExport.dwStart + 2) * m_channels;
-  unsigned loopStartIdx = loopToExport.dwStart * m_channels;
   wxString filePath = path + wxFILE_SEP_PATH + fileName;
 
   // Open the file to write
@@ -1614,46 +1808,21 @@ bool FileHandling::ExportLoopAsNewFile(wxString fileName, wxString path, int loo
   }
 
   // Copy/write the audio data
-  if (m_minorFormat == SF_FORMAT_DOUBLE) {
-    double *audioData = new double[arrayLength];
-    for (unsigned i = 0; i < arrayLength; i++)
-      audioData[i] = doubleAudioData[loopStartIdx + i];
-    sf.write(audioData, arrayLength);
-    delete[] audioData;
-  } else if (m_minorFormat == SF_FORMAT_FLOAT) {
-    float *audioData = new float[arrayLength];
-    for (unsigned i = 0; i < arrayLength; i++)
-      audioData[i] = floatAudioData[loopStartIdx + i];
-    sf.write(audioData, arrayLength);
-    delete[] audioData;
-  } else if ((m_minorFormat == SF_FORMAT_PCM_16) || (m_minorFormat == SF_FORMAT_PCM_S8) || (m_minorFormat == SF_FORMAT_PCM_U8)) {
-    short *audioData = new short[arrayLength];
-    for (unsigned i = 0; i < arrayLength; i++)
-      audioData[i] = shortAudioData[loopStartIdx + i];
-    sf.write(audioData, arrayLength);
-    delete[] audioData;
-  } else {
-    int *audioData = new int[arrayLength];
-    for (unsigned i = 0; i < arrayLength; i++)
-      audioData[i] = intAudioData[loopStartIdx + i];
-    sf.write(audioData, arrayLength);
-    delete[] audioData;
-  }
+  WriteAudioData(sf, loopToExport.dwStart, arrayLength / m_channels);
 
   // The new file will be finally closed when the instance of sf is deleted!
   return true;
 }
 
 void FileHandling::PerformFade(unsigned fadeLength, int fadeType) {
-  double *audioData = new double[ArrayLength];
-  bool gotData = GetDoubleAudioData(audioData);
-
-  if (!gotData)
-    return;
-  
   // fadeType 0 == fade in, anything else is a fade out
 
   unsigned samplesToFade = (fadeLength / 1000.0) * m_samplerate;
+  unsigned nbrFrames = m_audio->GetFrames();
+  if (samplesToFade > nbrFrames)
+    samplesToFade = nbrFrames;
+  if (samplesToFade < 2)
+    return;
 
   // prepare an array for the crossfade curve data
   double *fadeData = new double[samplesToFade];
@@ -1663,76 +1832,14 @@ void FileHandling::PerformFade(unsigned fadeLength, int fadeType) {
     fadeData[i] = i * 1.0 / (samplesToFade - 1);
 
   if (fadeType == 0) {
-    for (unsigned i = 0; i < samplesToFade; i++) {
-      for (int j = 0; j < m_channels; j++) {
-        audioData[i * m_channels + j] *= fadeData[i];
-        // also change stored audio data as type which might need conversion
-        if (shortAudioData != NULL) {
-          shortAudioData[i * m_channels + j] = lrint(audioData[i * m_channels + j] * (1.0 * 0x7FFF));
-        } else if (intAudioData != NULL) {
-          intAudioData[i * m_channels + j] = lrint(audioData[i * m_channels + j] * (1.0 * 0x7FFFFFFF));
-        } else if (doubleAudioData != NULL) {
-          doubleAudioData[i * m_channels + j] = audioData[i * m_channels + j];
-        }
-        // this should always be the case as floats are used for playback
-        floatAudioData[i * m_channels + j] = (float) audioData[i * m_channels + j];
-      }
-    }
-  } else {
-    for (unsigned i = 0; i < samplesToFade; i++) {
-      for (int j = 0; j < m_channels; j++) {
-        audioData[(ArrayLength - 1) - (i + j)] *= fadeData[i];
-        // also change stored audio data as type which might need conversion
-        if (shortAudioData != NULL) {
-          shortAudioData[(ArrayLength - 1) - (i + j)] = lrint(audioData[(ArrayLength - 1) - (i + j)] * (1.0 * 0x7FFF));
-        } else if (intAudioData != NULL) {
-          intAudioData[(ArrayLength - 1) - (i + j)] = lrint(audioData[(ArrayLength - 1) - (i + j)] * (1.0 * 0x7FFFFFFF));
-        } else if (doubleAudioData != NULL) {
-          doubleAudioData[(ArrayLength - 1) - (i + j)] = audioData[(ArrayLength - 1) - (i + j)];
-        }
-        // this should always be the case as floats are used for playback
-        floatAudioData[(ArrayLength - 1) - (i + j)] = (float) audioData[(ArrayLength - 1) - (i + j)];
-      }
-    }
-  }
-  UpdateWaveTracks(audioData);
-  delete[] audioData;
-  delete[] fadeData;
-}
-
-bool FileHandling::GetDoubleAudioData(double audio[]) {
-  if (!waveTracks.empty()) {
-    unsigned length = waveTracks.size() * waveTracks[0].waveData.size();
-
-    if (ArrayLength == length) {
-      for (unsigned i = 0; i < waveTracks.size(); i++) {
-        for (unsigned j = 0; j < waveTracks[0].waveData.size(); j++) {
-          audio[i + j * waveTracks.size()] = waveTracks[i].waveData[j];
-        }
-      }
-      return true;
-    }
-    return false;
+    m_audio->ApplyGain(0, samplesToFade, fadeData);
   } else {
-    return false;
+    // the fade out is the same curve backwards at the end
+    std::reverse(fadeData, fadeData + samplesToFade);
+    m_audio->ApplyGain(nbrFrames - samplesToFade, samplesToFade, fadeData);
   }
-}
-
-void FileHandling::UpdateWaveTracks(double audio[]) {
-  // first empty old wavetracks
-  for (unsigned i = 0; i < waveTracks.size(); i++)
-    waveTracks[i].waveData.clear();
 
-  // copy the new track data to right tracks
-  int index = 0;
-  for (unsigned i = 0; i < ArrayLength; i++) {
-    // de-interleaving
-    waveTracks[index].waveData.push_back(audio[i]);
-    index++;
-
-    if (index == m_channels)
-      index = 0;
-  }
+  delete[] fadeData;
 }
 
 std::pair<unsigned, unsigned> FileHandling::GetSustainsection() {
@@ -1763,21 +1870,21 @@ bool FileHandling::GetAutoSustainSearch() {
 
 bool FileHandling::AutoCreateReleaseCue() {
   // from auto sustain end we back until we find a zero crossing in strongest channel
+  // (usually within a period, so the samples are read one by one)
   unsigned nbrSamples = ArrayLength / m_channels;
-  double *data = new double[nbrSamples];
-  SeparateStrongestChannel(data);
+  int channel = GetStrongestChannelIndex();
   unsigned cueSampleOffset = m_autoSustainEnd;
   if (cueSampleOffset < nbrSamples) {
-    if (data[cueSampleOffset] > 0) {
-      while (data[cueSampleOffset] > 0) {
+    if (m_audio->GetSample(channel, cueSampleOffset) > 0) {
+      while (cueSampleOffset > 0 && m_audio->GetSample(channel, cueSampleOffset) > 0) {
         cueSampleOffset--;
       }
     } else {
-      while (data[cueSampleOffset] < 0) {
+      while (cueSampleOffset > 0 && m_audio->GetSample(channel, cueSampleOffset) < 0) {
         cueSampleOffset--;
       }
     }
-    if (fabs(data[cueSampleOffset]) > fabs(data[cueSampleOffset + 1])) {
+    if (cueSampleOffset + 1 < nbrSamples && fabs(m_audio->GetSample(channel, cueSampleOffset)) > fabs(m_audio->GetSample(channel, cueSampleOffset + 1))) {
       cueSampleOffset += 1;
     }
 
@@ -1791,10 +1898,8 @@ bool FileHandling::AutoCreateReleaseCue() {
     newCue.keepThisCue = true;
 
     m_cues->AddCue(newCue); // add the cue to the file cue vector
-    delete[] data;
     return true;
   } else {
-    delete[] data;
     return false;
   }
 }
@@ -1809,57 +1914,74 @@ double FileHandling::GetLoopQuality(unsigned loopNbr) {
     m_loops->GetLoopData(loopNbr, loop);
     unsigned compareStartIndex = loop.dwStart;
     unsigned compareEndIndex = loop.dwEnd;
-    std::vector<double> loopQualityChannels = CalculateLoopQuality(compareStartIndex, compareEndIndex);
-    double lowestQuality = 11;
-    if (!loopQualityChannels.empty()) {
-      std::vector<double>::iterator worst = std::max_element(loopQualityChannels.begin(), loopQualityChannels.end());
-      lowestQuality = *worst;
-    }
-    return lowestQuality;
+    return GetLoopQuality(compareStartIndex, compareEndIndex);
   } else {
     return 12;
   }
 }
 
 double FileHandling::GetLoopQuality(unsigned start, unsigned end) {
-    std::vector<double> loopQualityChannels = CalculateLoopQuality(start, end);
-    double lowestQuality = 11;
-    if (!loopQualityChannels.empty()) {
-      std::vector<double>::iterator worst = std::max_element(loopQualityChannels.begin(), loopQualityChannels.end());
-      lowestQuality = *worst;
-    }
-    return lowestQuality;
+  return GetLoopQuality(start, end, DBL_MAX);
 }
 
-std::vector<double> FileHandling::CalculateLoopQuality(unsigned startIdx, unsigned endIdx) {
-  std::vector<double> qualityValues;
-  if (startIdx > 4 && endIdx > startIdx && endIdx < waveTracks[0].waveData.size() - 1) {
-    startIdx -= 5;
-    endIdx -= 4;
-  } else {
-    return qualityValues;
+double FileHandling::GetLoopQuality(unsigned start, unsigned end, double limit) {
+  if (start < LOOP_QUALITY_FRAMES || end <= start || end >= m_audio->GetFrames() - 1)
+    return 11;
+
+  if (
+    !m_loopWindow.empty() &&
+    m_loopWindowChangeCount == m_audio->GetChangeCount() &&
+    start - LOOP_QUALITY_FRAMES >= m_loopWindowFirst &&
+    end < m_loopWindowFirst + m_loopWindowFrames
+  ) {
+    return LoopQuality(&m_loopWindow[0], m_loopWindowFrames, m_channels, start - m_loopWindowFirst, end - m_loopWindowFirst, limit);
   }
 
-  for (unsigned i = 0; i < waveTracks.size(); i++) {
-    double channelDiff = 0;
-    for (int j = 0; j < 5; j++) {
-      double difference = fabs(waveTracks[i].waveData[startIdx + j] - waveTracks[i].waveData[endIdx + j]);
-      channelDiff += difference;
-    }
-    qualityValues.push_back(channelDiff);
+  // otherwise just the compared frames are read into a small window
+  double frames[2 * LOOP_QUALITY_FRAMES * 8];
+  std::vector<double> moreFrames;
+  double *window = frames;
+  if (m_channels > 8) {
+    moreFrames.resize(2 * LOOP_QUALITY_FRAMES * m_channels);
+    window = &moreFrames[0];
   }
+  ReadLoopQualityFrames(start, end, window);
+  return LoopQuality(window, 2 * LOOP_QUALITY_FRAMES, m_channels, LOOP_QUALITY_FRAMES, 2 * LOOP_QUALITY_FRAMES - 1, limit);
+}
 
-  return qualityValues;
+void FileHandling::ReadLoopQualityFrames(unsigned start, unsigned end, double *window) {
+  for (int c = 0; c < m_channels; c++) {
+    double *track = window + c * 2 * LOOP_QUALITY_FRAMES;
+    m_audio->ReadTrack(c, start - LOOP_QUALITY_FRAMES, LOOP_QUALITY_FRAMES, track);
+    m_audio->ReadTrack(c, end + 1 - LOOP_QUALITY_FRAMES, LOOP_QUALITY_FRAMES, track + LOOP_QUALITY_FRAMES);
+  }
+}
+
+void FileHandling::PrepareLoopQualityWindow(unsigned firstFrame, unsigned lastFrame) {
+  if (lastFrame >= m_audio->GetFrames())
+    lastFrame = m_audio->GetFrames() - 1;
+  if (m_audio->IsEmpty() || lastFrame < firstFrame) {
+    ReleaseLoopQualityWindow();
+    return;
+  }
+
+  m_loopWindowFirst = firstFrame;
+  m_loopWindowFrames = lastFrame - firstFrame + 1;
+  m_loopWindow.resize((unsigned long) m_loopWindowFrames * m_channels);
+  for (int c = 0; c < m_channels; c++)
+    m_audio->ReadTrack(c, firstFrame, m_loopWindowFrames, &m_loopWindow[(unsigned long) c * m_loopWindowFrames]);
+  m_loopWindowChangeCount = m_audio->GetChangeCount();
+}
+
+void FileHandling::ReleaseLoopQualityWindow() {
+  std::vector<double>().swap(m_loopWindow);
+  m_loopWindowFirst = 0;
+  m_loopWindowFrames = 0;
 }
 
 double FileHandling::GetStrongestSampleValue() {
   double strongestValue = 0;
-  for (unsigned i = 0; i < waveTracks.size(); i++) {
-    for (unsigned j = 0; j < waveTracks[i].waveData.size(); j++) {
-      double currentValue = sqrt(pow(waveTracks[i].waveData[j], 2));
-      if (currentValue > strongestValue)
-        strongestValue = currentValue;
-    }
-  }
+  for (int i = 0; i < m_audio->GetChannels(); i++)
+    strongestValue = std::max(strongestValue, GetChannelPeak(i));
   return strongestValue;
 }
@@ -25,13 +25,13 @@
 #include "sndfile.hh"
 #include "LoopMarkers.h"
 #include "CueMarkers.h"
+#include "AudioStore.h"
 #include <vector>
+#include <list>
 #include "RtAudio.h"
 #include <wx/datetime.h>
 
-typedef struct {
-  std::vector<double> waveData;
-} WAVETRACK;
+class MappedWavReader;
 
 typedef struct {
   // LIST INFO string data
@@ -47,23 +47,38 @@ public:
   SpectrumPeak() {
     m_binNbr = 0;
     m_dB = -200;
+    m_power = 0;
     m_pitch = 0;
     m_harmonicQuality = 0;
   }
   unsigned m_binNbr;
   double m_dB;
+  double m_power; // linear, the same as m_dB
   double m_pitch;
   std::vector<unsigned> m_matchingHarmonics;
   double m_harmonicQuality;
 };
 
+class HarmonicMeasurement {
+public:
+  HarmonicMeasurement() {
+    m_frequency = 0;
+    m_amplitude = 0;
+  }
+  double m_frequency;
+  double m_amplitude; // linear, 1.0 is full scale
+};
+
 class FileHandling {
 public:
-  FileHandling(wxString fileName, wxString path);
+  // With metadataOnly the audio data is not decoded when opening, it's only
+  // paged in from the file if it's accessed later (like when saving)
+  FileHandling(wxString fileName, wxString path, bool metadataOnly = false);
   ~FileHandling();
 
   LoopMarkers *m_loops;
   CueMarkers *m_cues;
+  AudioStore *m_audio;
 
   void SaveAudioFile(wxString fileName, wxString path);
   int GetSampleRate();
@@ -72,9 +87,17 @@ public:
   int GetWholeFormat();
   wxString GetInfoString();
   bool FileCouldBeOpened();
+  long GetDecodeTime(); // milliseconds it took to read the audio data
+  // Fills four pitches: FFT, HPS, strongest peak and phase vocoder
   bool GetFFTPitch(double pitches[]);
   bool GetSpectrum(double *output, unsigned fftSize, int windowType);
   double GetTDPitch();
+  // Pitch of the fundamental refined by zooming in on its part of the
+  // spectrum, 0 if it couldn't be found
+  double GetZoomPitch();
+  // Frequency and amplitude of the first nbrHarmonics harmonics of the
+  // fundamental, each measured within a few Hz of its expected frequency
+  bool MeasureHarmonics(double fundamental, unsigned nbrHarmonics, std::vector<HarmonicMeasurement> &harmonics);
   void PerformCrossfade(int loopNumber, double fadeLength, int fadeType);
   void TrimExcessData();
   bool TrimStart(unsigned timeToTrim);
@@ -84,28 +107,28 @@ public:
   bool TrimAudioToLastCue();
   bool ExportLoopAsNewFile(wxString fileName, wxString path, int loopIdx);
   void PerformFade(unsigned fadeLength, int fadeType);
-  // Get audio data as doubles
-  bool GetDoubleAudioData(double audio[]);
-  // Update the wave data vector if audio is changed
-  void UpdateWaveTracks(double audio[]);
   void SetAutoSustainSearch(bool choice);
   bool GetAutoSustainSearch();
   std::pair<unsigned, unsigned> GetSustainsection();
   void SetSliderSustainsection(int start, int end);
-  // Get strongest channel of audio data as doubles
-  void SeparateStrongestChannel(double outData[]);
+  // The nbrFrames frames from firstFrame of the strongest channel
+  void ReadStrongestChannel(unsigned firstFrame, unsigned nbrFrames, double outData[]);
+  int GetStrongestChannelIndex();
+  double GetChannelPeak(int channel);
   bool AutoCreateReleaseCue();
   wxString GetFileName();
   double GetLoopQuality(unsigned loopNbr);
   double GetLoopQuality(unsigned start, unsigned end);
-  std::vector<double> CalculateLoopQuality(unsigned startIdx, unsigned endIdx);
+  // The same, but once the quality is known to be worse than limit any
+  // value worse than limit may be returned
+  double GetLoopQuality(unsigned start, unsigned end, double limit);
+  // Copies the frames from firstFrame to lastFrame of all channels so that
+  // the quality of loops within them can be calculated without locking or
+  // allocating anything, until the window is released or the audio changed
+  void PrepareLoopQualityWindow(unsigned firstFrame, unsigned lastFrame);
+  void ReleaseLoopQualityWindow();
   double GetStrongestSampleValue();
 
-  short *shortAudioData;
-  int *intAudioData;
-  float *floatAudioData; // always read and used for playback!
-  double *doubleAudioData;
-  std::vector<WAVETRACK> waveTracks;
   WAV_LIST_INFO m_info;
 
   unsigned long int ArrayLength;
@@ -122,17 +145,73 @@ private:
   int m_minorFormat;
   unsigned m_samplerate;
   bool fileOpenWasSuccessful;
+  long m_decodeTime;
+  MappedWavReader *m_reader; // only kept while the audio data is paged in
+  wxString m_sourcePath;
   double m_fftPitch;
   double m_fftHPS;
   double m_fftPeakPitch;
+  double m_zoomPitch;
+  double m_phaseVocoderPitch;
   double m_timeDomainPitch;
   unsigned m_autoSustainStart;
   unsigned m_autoSustainEnd;
   unsigned m_sliderSustainStart;
   unsigned m_sliderSustainEnd;
   bool m_useAutoSustain;
-
+  // Statistics of the audio data, valid while the change count of m_audio
+  // is the same as when they were calculated
+  bool m_statsAreValid;
+  unsigned long m_statsChangeCount;
+  std::vector<double> m_channelPeak;
+  int m_strongestChannel;
+  // Power spectra of the audio data, valid while the change count of
+  // m_audio is m_spectrumChangeCount. The power is linear and scaled so
+  // that 1.0 in amplitude is 1.0, one value for each bin
+  struct CachedSpectrum {
+    unsigned fftSize;
+    int windowType;
+    unsigned firstFrame;
+    unsigned nbrFrames;
+    std::vector<double> power;
+  };
+  std::list<CachedSpectrum> m_spectrumCache; // most recently used first
+  unsigned long m_spectrumChangeCount;
+  // Scratch data of each worker of the spectrum calculation and the sums
+  // of each block of windows, kept between the calls
+  std::vector<std::vector<double> > m_spectrumScratch;
+  std::vector<double> m_spectrumSums;
+  // Planar copy of m_loopWindowFrames frames of all channels from
+  // m_loopWindowFirst, valid while the change count is m_loopWindowChangeCount
+  std::vector<double> m_loopWindow;
+  unsigned m_loopWindowFirst;
+  unsigned m_loopWindowFrames;
+  unsigned long m_loopWindowChangeCount;
+
+  void UpdateStatistics();
+  // The LOOP_QUALITY_FRAMES frames before start and up to and including end
+  // of each channel, one channel after another in window
+  void ReadLoopQualityFrames(unsigned start, unsigned end, double *window);
+  // Averaged power spectrum of nbrFrames from firstFrame of all channels,
+  // from the cache if it has been calculated before. NULL if the range is
+  // too short. The spectrum stays valid until the next call
+  const std::vector<double> *GetPowerSpectrum(unsigned fftSize, int windowType, unsigned firstFrame, unsigned nbrFrames);
+  void CalculatePowerSpectrum(CachedSpectrum &spectrum);
+  void GetPitchAnalysisRange(unsigned &firstFrame, unsigned &nbrFrames);
+  // Results of a search for the pitch among the peaks of a spectrum
+  struct FFTPitchResult {
+    FFTPitchResult() : pitch(0), hps(0), peakPitch(0), binWidth(0) {}
+    double pitch;     // fundamental chosen by the harmonics of the peaks
+    double hps;       // by the harmonic product spectrum
+    double peakPitch; // of the greatest peak
+    double binWidth;  // Hz per bin of the FFT that was used
+  };
+  // The search itself only returns its results so that it can be used by
+  // other methods without changing those of the FFT pitch method
+  bool FindFFTPitch(unsigned maxFftSize, FFTPitchResult &result);
   bool DetectPitchByFFT();
+  bool DetectPitchByZoomFFT();
+  bool DetectPitchByPhaseVocoder(double fundamental);
   bool DetectPitchInTimeDomain();
   double TranslateIndexToPitch(
     int idxAtPeak,
@@ -144,6 +223,7 @@ private:
   void CalculateSustainStartAndEnd();
   double GetDownsampledValue(double *fft, unsigned length, unsigned factor, unsigned index);
   void TrimAudioData(unsigned startIdx, unsigned long int newLength);
+  void WriteAudioData(SndfileHandle &sf, unsigned firstFrame, unsigned nbrFrames);
 
 };
 
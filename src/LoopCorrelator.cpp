@@ -0,0 +1,212 @@
+/*
+ * LoopCorrelator.cpp is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+#include "LoopCorrelator.h"
+#include "FFTPlan.h"
+#include <algorithm>
+#include <cmath>
+
+// The FFT size is at least this many window lengths, so that most of each
+// block gives valid correlations
+static const unsigned BLOCK_WINDOWS = 4;
+static const unsigned MIN_FFT_SIZE = 64;
+
+LoopCorrelator::LoopCorrelator(const double *data, unsigned firstEnd, unsigned lastEnd, unsigned windowLength) {
+  m_data = data;
+  m_windowLength = windowLength;
+  m_firstFrame = firstEnd + 1 - windowLength;
+
+  unsigned size = MIN_FFT_SIZE;
+  while (size < BLOCK_WINDOWS * windowLength)
+    size <<= 1;
+  m_plan = FFTPlan::GetPlan(size);
+  m_blockStep = size - windowLength + 1;
+  // half a transform (as two blocks share one) takes about as long as
+  // correlating this many frames directly
+  unsigned bits = 0;
+  while ((1U << bits) < size)
+    bits++;
+  m_directLimit = size * bits;
+
+  unsigned bins = size / 2 + 1;
+  unsigned nbrFrames = lastEnd + 1 - m_firstFrame;
+  unsigned nbrWindows = lastEnd + 1 - firstEnd;
+  unsigned nbrBlocks = (nbrWindows + m_blockStep - 1) / m_blockStep;
+  m_blockReal.resize((unsigned long) nbrBlocks * bins);
+  m_blockImag.resize((unsigned long) nbrBlocks * bins);
+  std::vector<double> block(size);
+  for (unsigned b = 0; b < nbrBlocks; b++) {
+    unsigned first = b * m_blockStep;
+    unsigned count = std::min(size, nbrFrames - first);
+    std::copy(data + m_firstFrame + first, data + m_firstFrame + first + count, block.begin());
+    std::fill(block.begin() + count, block.end(), 0.0);
+    m_plan->RealTransform(&block[0], &m_blockReal[(unsigned long) b * bins], &m_blockImag[(unsigned long) b * bins]);
+  }
+
+  m_energyBefore.resize(nbrFrames + 1);
+  m_energyBefore[0] = 0;
+  for (unsigned i = 0; i < nbrFrames; i++) {
+    double value = data[m_firstFrame + i];
+    m_energyBefore[i + 1] = m_energyBefore[i] + value * value;
+  }
+}
+
+LoopCorrelator::~LoopCorrelator() {
+}
+
+unsigned LoopCorrelator::GetWindowLength() const {
+  return m_windowLength;
+}
+
+unsigned long LoopCorrelator::GetWorkSize() const {
+  // the spectrum of the window, and the input and output of an inverse
+  // complex transform (the first part of which holds the window before
+  // it's transformed)
+  unsigned long size = m_plan->GetSize();
+  return 2 * (size / 2 + 1) + 4 * size;
+}
+
+void LoopCorrelator::Correlate(unsigned start, const unsigned *ends, unsigned nbrEnds, double *correlations, double *work) const {
+  unsigned size = m_plan->GetSize();
+  unsigned bins = size / 2 + 1;
+  double *windowReal = work;
+  double *windowImag = work + bins;
+  double *window = work + 2 * bins;
+
+  const double *windowData = m_data + start - m_windowLength;
+  double windowEnergy = 0;
+  for (unsigned n = 0; n < m_windowLength; n++) {
+    window[n] = windowData[n];
+    windowEnergy += windowData[n] * windowData[n];
+  }
+  std::fill(window + m_windowLength, window + size, 0.0);
+  m_plan->RealTransform(window, windowReal, windowImag);
+
+  // Only the blocks holding some of the end points are transformed back.
+  // As the correlations are real two blocks are done with one transform,
+  // so a block waits for the next one that needs to be transformed
+  bool isWaiting = false;
+  unsigned waitingBlock = 0;
+  unsigned waitingFirst = 0;
+  unsigned waitingLast = 0;
+  unsigned i = 0;
+  while (i < nbrEnds) {
+    unsigned block = GetBlock(ends[i]);
+    unsigned j = i;
+    while (j < nbrEnds && GetBlock(ends[j]) == block)
+      j++;
+
+    if ((j - i) * m_windowLength < m_directLimit) {
+      for (unsigned n = i; n < j; n++) {
+        const double *endData = m_data + ends[n] + 1 - m_windowLength;
+        double correlation = 0;
+        for (unsigned k = 0; k < m_windowLength; k++)
+          correlation += windowData[k] * endData[k];
+        correlations[n] = Normalize(correlation, windowEnergy, ends[n]);
+      }
+    } else if (isWaiting) {
+      CorrelateBlocks(waitingBlock, waitingFirst, waitingLast, block, i, j, ends, windowEnergy, correlations, work);
+      isWaiting = false;
+    } else {
+      isWaiting = true;
+      waitingBlock = block;
+      waitingFirst = i;
+      waitingLast = j;
+    }
+    i = j;
+  }
+  if (isWaiting)
+    CorrelateBlocks(waitingBlock, waitingFirst, waitingLast, waitingBlock, 0, 0, ends, windowEnergy, correlations, work);
+}
+
+unsigned LoopCorrelator::GetBlock(unsigned end) const {
+  return (end + 1 - m_windowLength - m_firstFrame) / m_blockStep;
+}
+
+double LoopCorrelator::GetWindowEnergy(unsigned end) const {
+  unsigned last = end + 1 - m_firstFrame;
+  double energy = m_energyBefore[last] - m_energyBefore[last - m_windowLength];
+  return energy > 0.0 ? energy : 0.0;
+}
+
+double LoopCorrelator::Normalize(double correlation, double windowEnergy, unsigned end) const {
+  double norm = sqrt(windowEnergy * GetWindowEnergy(end));
+  if (norm > 0.0)
+    return std::max(-1.0, std::min(1.0, correlation / norm));
+  else
+    return 0.0;
+}
+
+void LoopCorrelator::CorrelateBlocks(
+  unsigned block,
+  unsigned first,
+  unsigned last,
+  unsigned secondBlock,
+  unsigned secondFirst,
+  unsigned secondLast,
+  const unsigned *ends,
+  double windowEnergy,
+  double *correlations,
+  double *work) const {
+
+  unsigned size = m_plan->GetSize();
+  unsigned bins = size / 2 + 1;
+  const double *windowReal = work;
+  const double *windowImag = work + bins;
+  double *re = work + 2 * bins;
+  double *im = re + size;
+  double *outRe = im + size;
+  double *outIm = outRe + size;
+
+  // the spectrum of the correlation is the conjugated spectrum of the
+  // window times the spectrum of the block, the first block's is used as
+  // the real part and the second block's as the imaginary part
+  const double *aRe = &m_blockReal[(unsigned long) block * bins];
+  const double *aIm = &m_blockImag[(unsigned long) block * bins];
+  const double *bRe = &m_blockReal[(unsigned long) secondBlock * bins];
+  const double *bIm = &m_blockImag[(unsigned long) secondBlock * bins];
+  bool hasSecond = secondFirst < secondLast;
+  for (unsigned m = 0; m < bins; m++) {
+    double ar = windowReal[m] * aRe[m] + windowImag[m] * aIm[m];
+    double ai = windowReal[m] * aIm[m] - windowImag[m] * aRe[m];
+    double br = 0;
+    double bi = 0;
+    if (hasSecond) {
+      br = windowReal[m] * bRe[m] + windowImag[m] * bIm[m];
+      bi = windowReal[m] * bIm[m] - windowImag[m] * bRe[m];
+    }
+    re[m] = ar - bi;
+    im[m] = ai + br;
+    if (m > 0 && m < size - m) {
+      re[size - m] = ar + bi;
+      im[size - m] = br - ai;
+    }
+  }
+  m_plan->Transform(re, im, outRe, outIm, true);
+
+  for (unsigned n = first; n < last; n++) {
+    unsigned lag = ends[n] + 1 - m_windowLength - m_firstFrame - block * m_blockStep;
+    correlations[n] = Normalize(outRe[lag], windowEnergy, ends[n]);
+  }
+  for (unsigned n = secondFirst; n < secondLast; n++) {
+    unsigned lag = ends[n] + 1 - m_windowLength - m_firstFrame - secondBlock * m_blockStep;
+    correlations[n] = Normalize(outIm[lag], windowEnergy, ends[n]);
+  }
+}
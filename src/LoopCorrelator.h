@@ -0,0 +1,98 @@
+/*
+ * LoopCorrelator.h is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+#ifndef LOOPCORRELATOR_H
+#define LOOPCORRELATOR_H
+
+#include <vector>
+
+class FFTPlan;
+
+/*
+ * LoopCorrelator scores loops by the normalized cross correlation between
+ * the window of audio just before the loop start and the window up to and
+ * including the loop end, so that a loop must keep matching for a while
+ * and not only at the few samples where it's joined.
+ *
+ * The windows of all end points in a range are correlated at once with
+ * FFT. The range is split in overlapping blocks that are transformed when
+ * the correlator is created, so for each start only the window before it
+ * and the blocks holding the wanted end points need to be transformed.
+ * Blocks with just a few end points are correlated directly instead, when
+ * that takes less time than the transform would. The correlator is never
+ * changed after it has been created, so it can be used by several threads
+ * at the same time with their own work space.
+ */
+class LoopCorrelator {
+public:
+  // Windows of windowLength frames of data ending at any frame from
+  // firstEnd to lastEnd. firstEnd must be at least windowLength - 1
+  LoopCorrelator(const double *data, unsigned firstEnd, unsigned lastEnd, unsigned windowLength);
+  ~LoopCorrelator();
+
+  unsigned GetWindowLength() const;
+  // Number of doubles of work space that Correlate needs
+  unsigned long GetWorkSize() const;
+  // Correlation (-1.0 to 1.0) of the window just before start with the
+  // windows ending at each of the nbrEnds frames in ends, which must be
+  // sorted and within the range. start must be at least the window length
+  void Correlate(unsigned start, const unsigned *ends, unsigned nbrEnds, double *correlations, double *work) const;
+
+private:
+  LoopCorrelator(const LoopCorrelator&);
+  LoopCorrelator& operator=(const LoopCorrelator&);
+
+  const double *m_data;
+  unsigned m_windowLength;
+  unsigned m_firstFrame; // first frame of the window ending at firstEnd
+  // each block of the FFT size gives the correlations of m_blockStep
+  // windows, the next block starts m_blockStep frames later
+  unsigned m_blockStep;
+  // blocks where the end points times the window length are fewer than
+  // this are correlated directly
+  unsigned m_directLimit;
+  const FFTPlan *m_plan;
+  // spectra of the blocks, the bins 0 to size / 2 of one block after another
+  std::vector<double> m_blockReal;
+  std::vector<double> m_blockImag;
+  // sum of squares of the data from m_firstFrame up to each frame
+  std::vector<double> m_energyBefore;
+
+  unsigned GetBlock(unsigned end) const;
+  double GetWindowEnergy(unsigned end) const;
+  double Normalize(double correlation, double windowEnergy, unsigned end) const;
+  // Correlations of the ends from first to last (not included) in block,
+  // and the same for secondBlock if secondFirst < secondLast, with the
+  // spectrum of the window at the start of work
+  void CorrelateBlocks(
+    unsigned block,
+    unsigned first,
+    unsigned last,
+    unsigned secondBlock,
+    unsigned secondFirst,
+    unsigned secondLast,
+    const unsigned *ends,
+    double windowEnergy,
+    double *correlations,
+    double *work
+  ) const;
+};
+
+#endif
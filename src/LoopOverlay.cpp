@@ -181,7 +181,7 @@ LoopOverlay::LoopOverlay(
       wxDefaultSize,
       wxSP_ARROW_KEYS,
       m_drawingPanel->GetCurrentLoopStart() + 1,
-      m_fileReference->waveTracks[0].waveData.size() - 1,
+      m_fileReference->m_audio->GetFrames() - 1,
       m_drawingPanel->GetCurrentLoopEnd()
     );
     loopEndSizer->Add(loopEndSpin, 0, wxALIGN_CENTER_HORIZONTAL|wxALIGN_TOP|wxTOP|wxLEFT|wxRIGHT, 2);
@@ -264,7 +264,7 @@ void LoopOverlay::OnNextButton(wxCommandEvent& WXUNUSED(event)) {
 void LoopOverlay::UpdateSpinners() {
   loopStartSpin->SetRange(0, m_drawingPanel->GetCurrentLoopEnd() - 1);
   loopStartSpin->SetValue(m_drawingPanel->GetCurrentLoopStart());
-  loopEndSpin->SetRange(m_drawingPanel->GetCurrentLoopStart() + 1, m_fileReference->waveTracks[0].waveData.size() - 1);
+  loopEndSpin->SetRange(m_drawingPanel->GetCurrentLoopStart() + 1, m_fileReference->m_audio->GetFrames() - 1);
   loopEndSpin->SetValue(m_drawingPanel->GetCurrentLoopEnd());
 }
 
@@ -41,9 +41,8 @@ LoopOverlayPanel::LoopOverlayPanel(
   m_fileRef = fh;
   m_selectedLoop = selectedLoop;
 
-  // get the audio data as doubles from
-  audioData = new double[m_fileRef->ArrayLength];
-  bool gotData = m_fileRef->GetDoubleAudioData(audioData);
+  // the audio data is read directly from the audio store of the file
+  bool gotData = !m_fileRef->m_audio->IsEmpty();
 
   SetBackgroundColour(wxColour(244,242,239));
   SetMinSize(wxSize(400, 380));
@@ -58,8 +57,6 @@ LoopOverlayPanel::LoopOverlayPanel(
 }
 
 LoopOverlayPanel::~LoopOverlayPanel() {
-  if (audioData)
-    delete[] audioData;
 }
 
 int LoopOverlayPanel::GetCurrentLoopEnd() {
@@ -238,9 +235,9 @@ void LoopOverlayPanel::UpdateAudioTracks() {
     int startIdx = currentLoopstart * m_fileRef->m_channels - halfOfSamples * m_fileRef->m_channels + i;
     int endIdx = currentLoopend * m_fileRef->m_channels - (halfOfSamples - 1) * m_fileRef->m_channels + i;
     if (startIdx > 0)
-      startValue = audioData[startIdx];
-    if ((unsigned) endIdx < m_fileRef->ArrayLength - 1)
-      endValue = audioData[endIdx];
+      startValue = m_fileRef->m_audio->GetSample(startIdx % m_fileRef->m_channels, startIdx / m_fileRef->m_channels);
+    if (endIdx >= 0 && (unsigned) endIdx < m_fileRef->ArrayLength - 1)
+      endValue = m_fileRef->m_audio->GetSample(endIdx % m_fileRef->m_channels, endIdx / m_fileRef->m_channels);
     // de-interleaving
     m_startTracks[index].startData.push_back(startValue);
     m_endTracks[index].endData.push_back(endValue);
@@ -73,7 +73,6 @@ private:
   int m_trackWidth;
   int m_maxSamplesSpinner;
   FileHandling *m_fileRef;
-  double *audioData;
   int m_selectedLoop;
 
   void OnPaintEvent(wxPaintEvent& event);
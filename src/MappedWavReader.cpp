@@ -0,0 +1,588 @@
+/*
+ * MappedWavReader.cpp is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+#include "MappedWavReader.h"
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Number of frames converted and imported into the audio store at a time
+static const unsigned DECODE_BLOCK_FRAMES = 16384;
+
+static const unsigned short WAVE_FORMAT_PCM = 0x0001;
+static const unsigned short WAVE_FORMAT_IEEE_FLOAT = 0x0003;
+static const unsigned short WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+// Loop and cue limits are the same as in libsndfile
+static const unsigned MAX_LOOPS = 16;
+static const unsigned MAX_CUES = 100;
+
+static unsigned short ReadLE16(const unsigned char *p) {
+  return (unsigned short) (p[0] | (p[1] << 8));
+}
+
+static unsigned ReadLE32(const unsigned char *p) {
+  return (unsigned) p[0] | ((unsigned) p[1] << 8) | ((unsigned) p[2] << 16) | ((unsigned) p[3] << 24);
+}
+
+static bool IsChunk(const unsigned char *p, const char *id) {
+  return memcmp(p, id, 4) == 0;
+}
+
+static bool IsLittleEndianHost() {
+  unsigned short test = 1;
+  return *((unsigned char*) &test) == 1;
+}
+
+// Conversions from the file's sample layout to what libsndfile would return
+static void ConvertU8(const unsigned char *src, short *dst, unsigned count) {
+  for (unsigned i = 0; i < count; i++)
+    dst[i] = (short) ((src[i] - 128) << 8);
+}
+
+static void Convert24(const unsigned char *src, int *dst, unsigned count) {
+  for (unsigned i = 0; i < count; i++, src += 3)
+    dst[i] = (int) (((unsigned) src[0] << 8) | ((unsigned) src[1] << 16) | ((unsigned) src[2] << 24));
+}
+
+template <typename T>
+static void ConvertNative(const unsigned char *src, T *dst, unsigned count) {
+  memcpy(dst, src, count * sizeof(T));
+}
+
+MappedWavReader::MappedWavReader() : m_isMapped(false), m_isOpen(false), m_mapping(NULL), m_mappingSize(0),
+#ifdef _WIN32
+m_fileHandle(INVALID_HANDLE_VALUE), m_mappingHandle(NULL),
+#else
+m_fileDescriptor(-1),
+#endif
+m_format(0), m_channels(0), m_sampleRate(0), m_frames(0), m_bytesPerSample(0), m_data(NULL), m_smpl(NULL), m_smplSize(0), m_cue(NULL), m_cueSize(0) {
+}
+
+MappedWavReader::~MappedWavReader() {
+  Close();
+}
+
+bool MappedWavReader::Open(wxString filePath) {
+  Close();
+
+  // Try the fast path first and fall back to libsndfile for everything else
+  if (IsLittleEndianHost() && MapFile(filePath)) {
+    if (ParseChunks()) {
+      m_isMapped = true;
+      m_isOpen = true;
+      return true;
+    }
+    UnmapFile();
+  }
+
+  m_sfHandle = SndfileHandle(std::string(filePath.mb_str()));
+  if (m_sfHandle) {
+    m_format = m_sfHandle.format();
+    m_channels = m_sfHandle.channels();
+    m_sampleRate = m_sfHandle.samplerate();
+    m_frames = m_sfHandle.frames();
+    m_isOpen = true;
+  }
+  return m_isOpen;
+}
+
+void MappedWavReader::Close() {
+  UnmapFile();
+  m_sfHandle = SndfileHandle();
+  m_isMapped = false;
+  m_isOpen = false;
+  m_format = 0;
+  m_channels = 0;
+  m_sampleRate = 0;
+  m_frames = 0;
+  m_bytesPerSample = 0;
+}
+
+bool MappedWavReader::IsOpen() {
+  return m_isOpen;
+}
+
+int MappedWavReader::GetFormat() {
+  return m_format;
+}
+
+int MappedWavReader::GetChannels() {
+  return m_channels;
+}
+
+int MappedWavReader::GetSampleRate() {
+  return m_sampleRate;
+}
+
+unsigned MappedWavReader::GetFrames() {
+  return m_frames;
+}
+
+bool MappedWavReader::GetInstrument(SF_INSTRUMENT &instr) {
+  if (!m_isMapped)
+    return m_sfHandle.command(SFC_GET_INSTRUMENT, &instr, sizeof(instr)) == SF_TRUE;
+
+  if (m_smpl == NULL || m_smplSize < 36)
+    return false;
+
+  // Fill in the structure the same way libsndfile does from a smpl chunk
+  memset(&instr, 0, sizeof(instr));
+  instr.basenote = (char) ReadLE32(m_smpl + 12);
+  instr.dwMIDIPitchFraction = ReadLE32(m_smpl + 16);
+  instr.gain = 1;
+  instr.velocity_lo = instr.key_lo = 0;
+  instr.velocity_hi = instr.key_hi = 127;
+
+  unsigned loopCount = ReadLE32(m_smpl + 28);
+  unsigned loopsInChunk = (m_smplSize - 36) / 24;
+  loopCount = std::min(std::min(loopCount, loopsInChunk), MAX_LOOPS);
+  instr.loop_count = loopCount;
+  for (unsigned i = 0; i < loopCount; i++) {
+    const unsigned char *loop = m_smpl + 36 + i * 24;
+    switch (ReadLE32(loop + 4)) {
+      case 0:
+        instr.loops[i].mode = SF_LOOP_FORWARD;
+        break;
+      case 1:
+        instr.loops[i].mode = SF_LOOP_ALTERNATING;
+        break;
+      case 2:
+        instr.loops[i].mode = SF_LOOP_BACKWARD;
+        break;
+      default:
+        instr.loops[i].mode = SF_LOOP_NONE;
+        break;
+    }
+    instr.loops[i].start = ReadLE32(loop + 8);
+    // libsndfile reports the end as one past the last sample of the loop
+    instr.loops[i].end = ReadLE32(loop + 12) + 1;
+    instr.loops[i].count = ReadLE32(loop + 20);
+  }
+  return true;
+}
+
+bool MappedWavReader::GetCues(SF_CUES &cues) {
+  if (!m_isMapped)
+    return m_sfHandle.command(SFC_GET_CUE, &cues, sizeof(cues)) == SF_TRUE;
+
+  if (m_cue == NULL || m_cueSize < 4)
+    return false;
+
+  unsigned cueCount = ReadLE32(m_cue);
+  unsigned cuesInChunk = (m_cueSize - 4) / 24;
+  cueCount = std::min(std::min(cueCount, cuesInChunk), MAX_CUES);
+  cues.cue_count = cueCount;
+  for (unsigned i = 0; i < cueCount; i++) {
+    const unsigned char *point = m_cue + 4 + i * 24;
+    cues.cue_points[i].indx = ReadLE32(point);
+    cues.cue_points[i].position = ReadLE32(point + 4);
+    cues.cue_points[i].fcc_chunk = ReadLE32(point + 8);
+    cues.cue_points[i].chunk_start = ReadLE32(point + 12);
+    cues.cue_points[i].block_start = ReadLE32(point + 16);
+    cues.cue_points[i].sample_offset = ReadLE32(point + 20);
+    cues.cue_points[i].name[0] = '\0';
+  }
+  return true;
+}
+
+const char *MappedWavReader::GetString(int strType) {
+  if (!m_isMapped)
+    return m_sfHandle.getString(strType);
+
+  std::map<int, std::string>::iterator it = m_strings.find(strType);
+  if (it == m_strings.end())
+    return NULL;
+  return it->second.c_str();
+}
+
+unsigned MappedWavReader::ReadFrames(AudioStore *audio) {
+  int minorFormat = m_format & SF_FORMAT_SUBMASK;
+
+  if (!m_isMapped) {
+    if (minorFormat == SF_FORMAT_DOUBLE)
+      return ReadSndfileBlocks<double>(audio);
+    else if (minorFormat == SF_FORMAT_FLOAT)
+      return ReadSndfileBlocks<float>(audio);
+    else if ((minorFormat == SF_FORMAT_PCM_16) || (minorFormat == SF_FORMAT_PCM_S8) || (minorFormat == SF_FORMAT_PCM_U8))
+      return ReadSndfileBlocks<short>(audio);
+    else
+      return ReadSndfileBlocks<int>(audio);
+  }
+
+  // The data chunk will be read once from start to end
+  AdviseDataRange(0, m_frames, true);
+
+  switch (minorFormat) {
+    case SF_FORMAT_PCM_U8:
+      return DecodeBlocks<short>(audio, ConvertU8);
+    case SF_FORMAT_PCM_16:
+      return DecodeBlocks<short>(audio, ConvertNative<short>);
+    case SF_FORMAT_PCM_24:
+      return DecodeBlocks<int>(audio, Convert24);
+    case SF_FORMAT_PCM_32:
+      return DecodeBlocks<int>(audio, ConvertNative<int>);
+    case SF_FORMAT_FLOAT:
+      return DecodeBlocks<float>(audio, ConvertNative<float>);
+    case SF_FORMAT_DOUBLE:
+      return DecodeBlocks<double>(audio, ConvertNative<double>);
+    default:
+      return 0;
+  }
+}
+
+unsigned MappedWavReader::ReadPage(unsigned firstFrame, unsigned nbrFrames, double *out) {
+  if (firstFrame >= m_frames)
+    return 0;
+  nbrFrames = std::min(nbrFrames, m_frames - firstFrame);
+  if (nbrFrames == 0)
+    return 0;
+
+  int minorFormat = m_format & SF_FORMAT_SUBMASK;
+  if (!m_isMapped) {
+    if (m_sfHandle.seek(firstFrame, SEEK_SET) < 0)
+      return 0;
+
+    if (minorFormat == SF_FORMAT_DOUBLE)
+      return ReadSndfilePage<double>(nbrFrames, out);
+    else if (minorFormat == SF_FORMAT_FLOAT)
+      return ReadSndfilePage<float>(nbrFrames, out);
+    else if ((minorFormat == SF_FORMAT_PCM_16) || (minorFormat == SF_FORMAT_PCM_S8) || (minorFormat == SF_FORMAT_PCM_U8))
+      return ReadSndfilePage<short>(nbrFrames, out);
+    else
+      return ReadSndfilePage<int>(nbrFrames, out);
+  }
+
+  AdviseDataRange(firstFrame, nbrFrames, false);
+
+  switch (minorFormat) {
+    case SF_FORMAT_PCM_U8:
+      return DecodePage<short>(firstFrame, nbrFrames, out, ConvertU8);
+    case SF_FORMAT_PCM_16:
+      return DecodePage<short>(firstFrame, nbrFrames, out, ConvertNative<short>);
+    case SF_FORMAT_PCM_24:
+      return DecodePage<int>(firstFrame, nbrFrames, out, Convert24);
+    case SF_FORMAT_PCM_32:
+      return DecodePage<int>(firstFrame, nbrFrames, out, ConvertNative<int>);
+    case SF_FORMAT_FLOAT:
+      return DecodePage<float>(firstFrame, nbrFrames, out, ConvertNative<float>);
+    case SF_FORMAT_DOUBLE:
+      return DecodePage<double>(firstFrame, nbrFrames, out, ConvertNative<double>);
+    default:
+      return 0;
+  }
+}
+
+void MappedWavReader::AdviseDataRange(unsigned firstFrame, unsigned nbrFrames, bool sequential) {
+#ifndef _WIN32
+  if (nbrFrames == 0)
+    return;
+
+  long pageSize = sysconf(_SC_PAGESIZE);
+  const unsigned char *base = (const unsigned char*) m_mapping;
+  size_t bytesPerFrame = (size_t) m_channels * m_bytesPerSample;
+  size_t offset = (m_data - base) + (size_t) firstFrame * bytesPerFrame;
+  size_t alignedOffset = offset - (offset % pageSize);
+  size_t length = offset - alignedOffset + (size_t) nbrFrames * bytesPerFrame;
+  if (sequential)
+    madvise((void*) (base + alignedOffset), length, MADV_SEQUENTIAL);
+  madvise((void*) (base + alignedOffset), length, MADV_WILLNEED);
+#else
+  (void) firstFrame;
+  (void) nbrFrames;
+  (void) sequential;
+#endif
+}
+
+template <typename T>
+unsigned MappedWavReader::DecodePage(unsigned firstFrame, unsigned nbrFrames, double *out, void (*convert)(const unsigned char*, T*, unsigned)) {
+  unsigned long count = (unsigned long) nbrFrames * m_channels;
+  std::vector<T> buffer(count);
+  convert(m_data + (size_t) firstFrame * m_channels * m_bytesPerSample, &buffer[0], count);
+  AudioStore::Normalize(&buffer[0], out, count);
+  return nbrFrames;
+}
+
+template <typename T>
+unsigned MappedWavReader::ReadSndfilePage(unsigned nbrFrames, double *out) {
+  std::vector<T> buffer((unsigned long) nbrFrames * m_channels);
+  sf_count_t gotFrames = m_sfHandle.readf(&buffer[0], nbrFrames);
+  if (gotFrames <= 0)
+    return 0;
+  AudioStore::Normalize(&buffer[0], out, (unsigned long) gotFrames * m_channels);
+  return (unsigned) gotFrames;
+}
+
+template <typename T>
+unsigned MappedWavReader::DecodeBlocks(AudioStore *audio, void (*convert)(const unsigned char*, T*, unsigned)) {
+  // the data chunk needn't be aligned so samples are converted into a small
+  // aligned buffer that stays in cache before being de-interleaved
+  T *buffer = new T[DECODE_BLOCK_FRAMES * m_channels];
+  size_t bytesPerFrame = (size_t) m_channels * m_bytesPerSample;
+  unsigned framesRead = 0;
+  while (framesRead < m_frames) {
+    unsigned framesInBlock = std::min(DECODE_BLOCK_FRAMES, m_frames - framesRead);
+    convert(m_data + framesRead * bytesPerFrame, buffer, framesInBlock * m_channels);
+    audio->ImportInterleaved(buffer, framesRead, framesInBlock);
+    framesRead += framesInBlock;
+  }
+  delete[] buffer;
+  return framesRead;
+}
+
+template <typename T>
+unsigned MappedWavReader::ReadSndfileBlocks(AudioStore *audio) {
+  T *buffer = new T[DECODE_BLOCK_FRAMES * m_channels];
+  unsigned framesRead = 0;
+  while (framesRead < m_frames) {
+    unsigned framesToRead = std::min(DECODE_BLOCK_FRAMES, m_frames - framesRead);
+    sf_count_t gotFrames = m_sfHandle.readf(buffer, framesToRead);
+    if (gotFrames <= 0)
+      break;
+    audio->ImportInterleaved(buffer, framesRead, (unsigned) gotFrames);
+    framesRead += (unsigned) gotFrames;
+  }
+  delete[] buffer;
+  return framesRead;
+}
+
+bool MappedWavReader::MapFile(wxString filePath) {
+#ifdef _WIN32
+  m_fileHandle = CreateFileW(filePath.wc_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (m_fileHandle == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(m_fileHandle, &fileSize) || fileSize.QuadPart < 12 || (unsigned long long) fileSize.QuadPart > (size_t) -1) {
+    UnmapFile();
+    return false;
+  }
+  m_mappingSize = (size_t) fileSize.QuadPart;
+
+  m_mappingHandle = CreateFileMappingW(m_fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (m_mappingHandle == NULL) {
+    UnmapFile();
+    return false;
+  }
+
+  m_mapping = MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0);
+  if (m_mapping == NULL) {
+    UnmapFile();
+    return false;
+  }
+  return true;
+#else
+  m_fileDescriptor = open(filePath.mb_str(), O_RDONLY);
+  if (m_fileDescriptor < 0)
+    return false;
+
+  struct stat fileInfo;
+  if (fstat(m_fileDescriptor, &fileInfo) != 0 || fileInfo.st_size < 12 || (unsigned long long) fileInfo.st_size > (size_t) -1) {
+    UnmapFile();
+    return false;
+  }
+  m_mappingSize = (size_t) fileInfo.st_size;
+
+  void *mapping = mmap(NULL, m_mappingSize, PROT_READ, MAP_SHARED, m_fileDescriptor, 0);
+  if (mapping == MAP_FAILED) {
+    UnmapFile();
+    return false;
+  }
+  m_mapping = mapping;
+
+  // Until the audio data is read only the chunk headers are visited
+  madvise(m_mapping, m_mappingSize, MADV_RANDOM);
+  return true;
+#endif
+}
+
+void MappedWavReader::UnmapFile() {
+#ifdef _WIN32
+  if (m_mapping)
+    UnmapViewOfFile(m_mapping);
+  if (m_mappingHandle)
+    CloseHandle(m_mappingHandle);
+  if (m_fileHandle != INVALID_HANDLE_VALUE)
+    CloseHandle(m_fileHandle);
+  m_mappingHandle = NULL;
+  m_fileHandle = INVALID_HANDLE_VALUE;
+#else
+  if (m_mapping)
+    munmap(m_mapping, m_mappingSize);
+  if (m_fileDescriptor >= 0)
+    close(m_fileDescriptor);
+  m_fileDescriptor = -1;
+#endif
+  m_mapping = NULL;
+  m_mappingSize = 0;
+
+  // everything that was found in the mapping is gone with it
+  m_data = NULL;
+  m_smpl = NULL;
+  m_smplSize = 0;
+  m_cue = NULL;
+  m_cueSize = 0;
+  m_strings.clear();
+}
+
+bool MappedWavReader::ParseChunks() {
+  const unsigned char *file = (const unsigned char*) m_mapping;
+  if (!IsChunk(file, "RIFF") || !IsChunk(file + 8, "WAVE"))
+    return false;
+
+  bool hasFormat = false;
+  size_t dataSize = 0;
+  size_t pos = 12;
+  while (pos + 8 <= m_mappingSize) {
+    const unsigned char *chunk = file + pos + 8;
+    size_t chunkSize = ReadLE32(file + pos + 4);
+    // a truncated last chunk is used as far as it goes
+    size_t available = std::min(chunkSize, m_mappingSize - (pos + 8));
+
+    if (IsChunk(file + pos, "fmt ")) {
+      if (!ParseFormatChunk(chunk, available))
+        return false;
+      hasFormat = true;
+    } else if (IsChunk(file + pos, "data")) {
+      m_data = chunk;
+      dataSize = available;
+    } else if (IsChunk(file + pos, "smpl")) {
+      m_smpl = chunk;
+      m_smplSize = available;
+    } else if (IsChunk(file + pos, "cue ")) {
+      m_cue = chunk;
+      m_cueSize = available;
+    } else if (IsChunk(file + pos, "LIST") && available >= 4 && IsChunk(chunk, "INFO")) {
+      ParseInfoList(chunk + 4, available - 4);
+    }
+
+    // a chunk that goes past the end of the file is the last one, this also
+    // keeps a bogus size from wrapping the position around
+    if (chunkSize > m_mappingSize - (pos + 8))
+      break;
+    // chunks are word aligned
+    pos += 8 + chunkSize + (chunkSize & 1);
+  }
+
+  if (!hasFormat || m_data == NULL)
+    return false;
+
+  m_frames = dataSize / ((size_t) m_channels * m_bytesPerSample);
+  return true;
+}
+
+bool MappedWavReader::ParseFormatChunk(const unsigned char *chunk, unsigned size) {
+  if (size < 16)
+    return false;
+
+  unsigned short formatTag = ReadLE16(chunk);
+  m_channels = ReadLE16(chunk + 2);
+  m_sampleRate = ReadLE32(chunk + 4);
+  unsigned short blockAlign = ReadLE16(chunk + 12);
+  unsigned short bitsPerSample = ReadLE16(chunk + 14);
+  int majorFormat = SF_FORMAT_WAV;
+
+  if (formatTag == WAVE_FORMAT_EXTENSIBLE) {
+    // the real format tag is the start of the sub format GUID
+    if (size < 40)
+      return false;
+    formatTag = ReadLE16(chunk + 24);
+    majorFormat = SF_FORMAT_WAVEX;
+  }
+
+  if (m_channels < 1 || m_sampleRate < 1)
+    return false;
+
+  m_bytesPerSample = (bitsPerSample + 7) / 8;
+  if (blockAlign != m_channels * m_bytesPerSample)
+    return false;
+
+  if (formatTag == WAVE_FORMAT_PCM) {
+    switch (bitsPerSample) {
+      case 8:
+        m_format = majorFormat | SF_FORMAT_PCM_U8;
+        break;
+      case 16:
+        m_format = majorFormat | SF_FORMAT_PCM_16;
+        break;
+      case 24:
+        m_format = majorFormat | SF_FORMAT_PCM_24;
+        break;
+      case 32:
+        m_format = majorFormat | SF_FORMAT_PCM_32;
+        break;
+      default:
+        return false;
+    }
+  } else if (formatTag == WAVE_FORMAT_IEEE_FLOAT) {
+    if (bitsPerSample == 32)
+      m_format = majorFormat | SF_FORMAT_FLOAT;
+    else if (bitsPerSample == 64)
+      m_format = majorFormat | SF_FORMAT_DOUBLE;
+    else
+      return false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void MappedWavReader::ParseInfoList(const unsigned char *chunk, unsigned size) {
+  unsigned pos = 0;
+  while (pos < size && size - pos >= 8) {
+    const unsigned char *text = chunk + pos + 8;
+    unsigned textSize = std::min(ReadLE32(chunk + pos + 4), size - (pos + 8));
+    int strType = 0;
+
+    if (IsChunk(chunk + pos, "INAM"))
+      strType = SF_STR_TITLE;
+    else if (IsChunk(chunk + pos, "ICOP"))
+      strType = SF_STR_COPYRIGHT;
+    else if (IsChunk(chunk + pos, "ISFT"))
+      strType = SF_STR_SOFTWARE;
+    else if (IsChunk(chunk + pos, "IART"))
+      strType = SF_STR_ARTIST;
+    else if (IsChunk(chunk + pos, "ICMT"))
+      strType = SF_STR_COMMENT;
+    else if (IsChunk(chunk + pos, "ICRD"))
+      strType = SF_STR_DATE;
+
+    if (strType) {
+      // strings are zero terminated and padded but don't trust that
+      unsigned length = 0;
+      while (length < textSize && text[length] != '\0')
+        length++;
+      m_strings[strType] = std::string((const char*) text, length);
+    }
+
+    unsigned subChunkSize = ReadLE32(chunk + pos + 4);
+    if (subChunkSize > size - (pos + 8))
+      break;
+    pos += 8 + subChunkSize + (subChunkSize & 1);
+  }
+}
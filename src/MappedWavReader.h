@@ -0,0 +1,107 @@
+/*
+ * MappedWavReader.h is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+#ifndef MAPPEDWAVREADER_H
+#define MAPPEDWAVREADER_H
+
+#include <wx/wx.h>
+#include "sndfile.hh"
+#include "AudioStore.h"
+#include <map>
+#include <string>
+
+/*
+ * MappedWavReader reads plain PCM and float WAV files by mapping them into
+ * memory and parsing the chunks directly. The audio data is used in place
+ * from the mapped data chunk and only the header pages are touched when just
+ * the metadata (smpl, cue and LIST INFO chunks) is asked for. Files that
+ * can't be handled this way (other containers, compressed data, big endian
+ * hosts etc.) are transparently read with libsndfile instead, so the results
+ * are the same as what SndfileHandle would give.
+ */
+class MappedWavReader : public AudioPageSource {
+public:
+  MappedWavReader();
+  ~MappedWavReader();
+
+  bool Open(wxString filePath);
+  void Close();
+  bool IsOpen();
+
+  int GetFormat();
+  int GetChannels();
+  int GetSampleRate();
+  unsigned GetFrames();
+
+  // Same content as SFC_GET_INSTRUMENT and SFC_GET_CUE would give
+  bool GetInstrument(SF_INSTRUMENT &instr);
+  bool GetCues(SF_CUES &cues);
+  // Same as SndfileHandle::getString, NULL if the string doesn't exist
+  const char *GetString(int strType);
+
+  // Decode all frames into the (already allocated) audio store
+  unsigned ReadFrames(AudioStore *audio);
+  // Decode a range of frames on demand for a paged audio store
+  unsigned ReadPage(unsigned firstFrame, unsigned nbrFrames, double *out);
+
+private:
+  SndfileHandle m_sfHandle;
+  bool m_isMapped;
+  bool m_isOpen;
+
+  void *m_mapping;
+  size_t m_mappingSize;
+#ifdef _WIN32
+  void *m_fileHandle;
+  void *m_mappingHandle;
+#else
+  int m_fileDescriptor;
+#endif
+
+  int m_format;
+  int m_channels;
+  int m_sampleRate;
+  unsigned m_frames;
+  unsigned m_bytesPerSample;
+  const unsigned char *m_data;
+  const unsigned char *m_smpl;
+  unsigned m_smplSize;
+  const unsigned char *m_cue;
+  unsigned m_cueSize;
+  std::map<int, std::string> m_strings;
+
+  bool MapFile(wxString filePath);
+  void UnmapFile();
+  bool ParseChunks();
+  bool ParseFormatChunk(const unsigned char *chunk, unsigned size);
+  void ParseInfoList(const unsigned char *chunk, unsigned size);
+  void AdviseDataRange(unsigned firstFrame, unsigned nbrFrames, bool sequential);
+
+  template <typename T>
+  unsigned DecodeBlocks(AudioStore *audio, void (*convert)(const unsigned char*, T*, unsigned));
+  template <typename T>
+  unsigned ReadSndfileBlocks(AudioStore *audio);
+  template <typename T>
+  unsigned DecodePage(unsigned firstFrame, unsigned nbrFrames, double *out, void (*convert)(const unsigned char*, T*, unsigned));
+  template <typename T>
+  unsigned ReadSndfilePage(unsigned nbrFrames, double *out);
+};
+
+#endif
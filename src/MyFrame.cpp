@@ -27,7 +27,9 @@
 #include <wx/aboutdlg.h>
 #include "LoopParametersDialog.h"
 #include <climits>
+#include <algorithm>
 #include "PitchDialog.h"
+#include "MappedWavReader.h"
 #include "LoopOverlay.h"
 #include <wx/busyinfo.h>
 #include "sndfile.hh"
@@ -40,6 +42,9 @@
 bool MyFrame::loopPlay = true; // default to loop play
 int MyFrame::volumeMultiplier = 1; // default value
 
+// Samples copied from the playback buffer at a time by the audio callback
+static const unsigned PLAYBACK_BLOCK_SAMPLES = 4096;
+
 // Event table
 BEGIN_EVENT_TABLE(MyFrame, wxFrame)
   EVT_CLOSE(MyFrame::OnClose)
@@ -132,6 +137,7 @@ void MyFrame::OnClose(wxCloseEvent& WXUNUSED(event)) {
   config->Write(wxT("General/FrameWidth"), m_frameWidth);
   config->Write(wxT("General/FrameHeight"), m_frameHeight);
   config->Write(wxT("General/FrameMaximized"), m_frameMaximized);
+  config->Write(wxT("General/AudioMemoryBudget"), (int) AudioStore::GetMemoryBudget());
   config->Write(wxT("BatchProcess/LastSource"), m_batchProcess->GetLastSource());
   config->Write(wxT("BatchProcess/LastTarget"), m_batchProcess->GetLastTarget());
   config->Write(wxT("LoopSettings/AutoSearchSustain"), m_autoloopSettings->GetAutosearch());
@@ -145,6 +151,9 @@ void MyFrame::OnClose(wxCloseEvent& WXUNUSED(event)) {
   config->Write(wxT("LoopSettings/Candidates"), m_autoloopSettings->GetCandidates());
   config->Write(wxT("LoopSettings/LoopsToReturn"), m_autoloopSettings->GetNrLoops());
   config->Write(wxT("LoopSettings/LoopPoolMultiple"), m_autoloopSettings->GetMultiple());
+  config->Write(wxT("LoopSettings/ScoreByCorrelation"), m_autoloopSettings->GetCorrelation());
+  config->Write(wxT("LoopSettings/CorrelationWindow"), m_autoloopSettings->GetCorrelationWindow());
+  config->Write(wxT("LoopSettings/CoarseSearch"), m_autoloopSettings->GetCoarseSearch());
   config->Write(wxT("Audio/Api"), m_sound->GetApi());
   config->Write(wxT("Audio/Device"), m_sound->GetDevice());
   config->Write(wxT("Pitch/PitchMethod"), m_pitchMethod);
@@ -231,6 +240,7 @@ void MyFrame::OpenAudioFile() {
     m_panel->SetFileNameLabel(fullFilePath, m_audiofile->GetInfoString());
 
     SetStatusText(wxString::Format(wxT("Zoom level: x %i"), m_waveform->GetAmplitudeZoomLevel()), 1);
+    SetStatusText(wxString::Format(wxT("Audio data decoded in %li ms"), m_audiofile->GetDecodeTime()), 0);
     SetTitle(fileToOpen + " - " + appName + wxT(" ") + wxT(MY_APP_VERSION));
 
     UpdateLoopsAndCuesDisplay();
@@ -277,13 +287,9 @@ void MyFrame::OpenAudioFile() {
     if (m_sound->StreamNeedsResampling()) {
       // initialize samplerate converter
       m_resampler = new MyResampler(m_audiofile->m_channels);
-      // fill resample data struct with values
-      double src_ratio = (1.0 * m_sound->GetSampleRateToUse()) / (1.0 * m_audiofile->GetSampleRate());
-      m_resampler->SetDataEndOfInput(0); // Set this later
-      m_resampler->SetDataInputFrames(m_audiofile->ArrayLength / m_audiofile->m_channels);
-      m_resampler->SetDataIn(m_audiofile->floatAudioData);
-      m_resampler->SetDataSrcRatio(src_ratio);
-      m_resampler->SimpleResample(m_audiofile->m_channels);
+      // the audio is resampled a block at a time while playing
+      m_resampler->SetSampleRates(m_audiofile->GetSampleRate(), m_sound->GetSampleRateToUse());
+      m_resampler->SetSource(m_audiofile->m_audio);
     }
   } else {
     // libsndfile couldn't open the file or no audio data in file
@@ -633,6 +639,10 @@ void MyFrame::OnStartPlay(wxCommandEvent& WXUNUSED(event)) {
     toolBar->EnableTool(wxID_STOP, true);
     transportMenu->Enable(START_PLAYBACK, false);
     transportMenu->Enable(wxID_STOP, true);
+    if (m_sound->StreamNeedsResampling())
+      m_playback->Start(m_audiofile->m_audio, m_resampler, m_sound->pos);
+    else
+      m_playback->Start(m_audiofile->m_audio, NULL, m_sound->pos);
     m_sound->StartAudioStream();
   } else {
     toolBar->EnableTool(START_PLAYBACK, false);
@@ -656,6 +666,7 @@ void MyFrame::OnStopPlay(wxCommandEvent& WXUNUSED(event)) {
 void MyFrame::DoStopPlay() {
   m_timer.Stop();
   m_sound->StopAudioStream();
+  m_playback->Stop();
 
   toolBar->EnableTool(wxID_STOP, false);
   toolBar->EnableTool(START_PLAYBACK, true);
@@ -674,6 +685,7 @@ MyFrame::MyFrame(const wxString& title) : wxFrame(NULL, wxID_ANY, title), m_time
   m_audiofile = NULL;
   m_waveform = NULL;
   m_resampler = NULL;
+  m_playback = new PlaybackBuffer();
   m_autoloopSettings = new AutoLoopDialog(this);
   m_autoloop = new AutoLooping();
   m_crossfades = new CrossfadeDialog(this);
@@ -935,6 +947,12 @@ MyFrame::MyFrame(const wxString& title) : wxFrame(NULL, wxID_ANY, title), m_time
     volumeMultiplier = (int) (pow(2, (double) readInt));
   }
 
+  // files needing more memory than this (in MB) are paged in from disk
+  if (config->Read(wxT("General/AudioMemoryBudget"), &readInt)) {
+    if (readInt > 0)
+      AudioStore::SetMemoryBudget(readInt);
+  }
+
   bool b;
   if (config->Read(wxT("General/LoopOnlyPlayback"), &b)) {
     m_loopOnly = b;
@@ -1026,6 +1044,23 @@ MyFrame::MyFrame(const wxString& title) : wxFrame(NULL, wxID_ANY, title), m_time
     m_autoloop->SetMultiple(readInt);
   }
 
+  if (config->Read(wxT("LoopSettings/ScoreByCorrelation"), &b)) {
+    m_autoloopSettings->SetCorrelation(b);
+    m_autoloop->SetCorrelation(b);
+  }
+
+  if (config->Read(wxT("LoopSettings/CorrelationWindow"), &dbl)) {
+    if (dbl <= 0.05 && dbl >= 0.01) {
+      m_autoloopSettings->SetCorrelationWindow(dbl);
+      m_autoloop->SetCorrelationWindow(dbl);
+    }
+  }
+
+  if (config->Read(wxT("LoopSettings/CoarseSearch"), &b)) {
+    m_autoloopSettings->SetCoarseSearch(b);
+    m_autoloop->SetCoarseSearch(b);
+  }
+
   if (config->Read(wxT("Pitch/PitchMethod"), &readInt)) {
     SetPitchMethod(readInt);
   } else {
@@ -1062,6 +1097,10 @@ MyFrame::MyFrame(const wxString& title) : wxFrame(NULL, wxID_ANY, title), m_time
 MyFrame::~MyFrame() {
   delete config;
 
+  if (m_sound)
+    m_sound->StopAudioStream();
+  delete m_playback;
+
   if (m_resampler) {
     delete m_resampler;
     m_resampler = 0;
@@ -1151,66 +1190,61 @@ int MyFrame::AudioCallback(void *outputBuffer,
   // keep track of position, see pos in MySound.h
   unsigned *position = (unsigned *) userData;
 
+  // the audio data is copied a block at a time from the playback buffer,
+  // which never waits for the audio store. If the audio stream uses the
+  // resampled audio data the positions are in it, except for the loop
+  // positions which are converted here
+  PlaybackBuffer *playback = ::wxGetApp().frame->m_playback;
+  unsigned long dataLength = ::wxGetApp().frame->m_audiofile->ArrayLength;
+  unsigned loopStart = position[1];
+  unsigned loopEnd = position[2];
   if (::wxGetApp().frame->m_sound->StreamNeedsResampling()) {
-    // audio stream uses the resampled audio data
-    if (position[0] < ::wxGetApp().frame->m_resampler->m_resampledDataLength) {
-      for (unsigned i = 0; i < nBufferFrames; i++) {
-        for (unsigned j = 0; j < useChannels; j++) {
-          *buffer++ = ::wxGetApp().frame->m_resampler->resampledAudioData[(position[0])] * volumeMultiplier;
-          position[0] += 1;
-        }
-
-        if (excessChannels)
-          position[0] += excessChannels;
-
-        if (loopPlay) {
-          // Check to control loop playback, see MySound.h pos member and MyFrame.h loopPlay member
-          if (position[0] > lround(position[2] / nChannels * ::wxGetApp().frame->m_resampler->GetRatioUsed()) * nChannels )
-            position[0] = lround(position[1] / nChannels * ::wxGetApp().frame->m_resampler->GetRatioUsed()) * nChannels;
-        }
-
-        // stop if end of file data is reached and reset current position to start of the cue
-        if (position[0] > ::wxGetApp().frame->m_resampler->m_resampledDataLength - 1) {
-          wxCommandEvent evt(wxEVT_COMMAND_TOOL_CLICKED, wxID_STOP);
-          ::wxGetApp().frame->AddPendingEvent(evt);
-
-          return 0;
+    double ratio = ::wxGetApp().frame->m_resampler->GetRatioUsed();
+    dataLength = ::wxGetApp().frame->m_resampler->m_resampledDataLength;
+    loopStart = lround(position[1] / nChannels * ratio) * nChannels;
+    loopEnd = lround(position[2] / nChannels * ratio) * nChannels;
+  }
+
+  float playbackBlock[PLAYBACK_BLOCK_SAMPLES];
+  unsigned long blockStart = 0;
+  unsigned long blockEnd = 0;
+  if (position[0] < dataLength) {
+    for (unsigned i = 0; i < nBufferFrames; i++) {
+      for (unsigned j = 0; j < useChannels; j++) {
+        if (position[0] < blockStart || position[0] >= blockEnd) {
+          blockStart = position[0];
+          blockEnd = blockStart + playback->Read(blockStart, PLAYBACK_BLOCK_SAMPLES, playbackBlock);
+          if (blockEnd == blockStart) {
+            // the feeder hasn't copied this part yet, the rest of the
+            // buffer is silent rather than waiting for it
+            std::fill(buffer, static_cast<float*>(outputBuffer) + nBufferFrames * useChannels, 0.0f);
+            return 0;
+          }
         }
+        *buffer++ = playbackBlock[(position[0] - blockStart)] * volumeMultiplier;
+        position[0] += 1;
       }
-    } else {
-      // we end up here until buffer is drained?
-    }
-  } else {
-    // Loop that feeds the outputBuffer with data when no resampling is needed
-    if (position[0] < ::wxGetApp().frame->m_audiofile->ArrayLength) {
-      for (unsigned i = 0; i < nBufferFrames; i++) {
-        for (unsigned j = 0; j < useChannels; j++) {
-          *buffer++ = ::wxGetApp().frame->m_audiofile->floatAudioData[(position[0])] * volumeMultiplier;
-          position[0] += 1;
-        }
 
-        if (excessChannels)
-          position[0] += excessChannels;
+      if (excessChannels)
+        position[0] += excessChannels;
 
-        if (loopPlay) {
-          // Check to control loop playback, see MySound.h pos member and MyFrame.h loopPlay member
-          if (position[0] > position[2])
-            position[0] = position[1];
-        }
+      if (loopPlay) {
+        // Check to control loop playback, see MySound.h pos member and MyFrame.h loopPlay member
+        if (position[0] > loopEnd)
+          position[0] = loopStart;
+      }
 
-        // stop if end of file data is reached and reset current position to start of the cue
-        if (position[0] > ::wxGetApp().frame->m_audiofile->ArrayLength - 1) {
-          wxCommandEvent evt(wxEVT_COMMAND_TOOL_CLICKED, wxID_STOP);
-          ::wxGetApp().frame->AddPendingEvent(evt);
+      // stop if end of file data is reached and reset current position to start of the cue
+      if (position[0] > dataLength - 1) {
+        wxCommandEvent evt(wxEVT_COMMAND_TOOL_CLICKED, wxID_STOP);
+        ::wxGetApp().frame->AddPendingEvent(evt);
 
-          return 0;
-        }
+        return 0;
       }
-    } else {
-      // we end up here until buffer is drained?
     }
+  } else {
+    // we end up here until buffer is drained?
   }
-
   return 0;
 
 }
@@ -1223,7 +1257,7 @@ void MyFrame::SetLoopPlayback(bool looping) {
 }
 
 void MyFrame::SetPitchMethod(int method) {
-  if (method >= 0 && method < 5)
+  if (method >= 0 && method < 7)
     m_pitchMethod = method;
   else
     m_pitchMethod = 0;
@@ -1291,18 +1325,23 @@ void MyFrame::OnAddLoop(wxCommandEvent& WXUNUSED(event)) {
   std::pair<unsigned, unsigned> currentSustain = m_audiofile->GetSustainsection();
   unsigned start = currentSustain.first;
   unsigned end = currentSustain.second;
-  // get audio data to analyze
-  unsigned nbrOfSmpls = m_audiofile->ArrayLength / m_audiofile->m_channels;
-  double *audioData = new double[nbrOfSmpls];
-  m_audiofile->SeparateStrongestChannel(audioData);
+  unsigned nbrFrames = m_audiofile->ArrayLength / m_audiofile->m_channels;
+  if (nbrFrames && end >= nbrFrames)
+    end = nbrFrames - 1;
+  if (start > end)
+    start = end;
+  // get audio data of the sustain section to analyze, audioData[i - start]
+  // is frame i
+  std::vector<double> audioData(end - start + 1);
+  m_audiofile->ReadStrongestChannel(start, audioData.size(), &audioData[0]);
   // adjust to reasonable loop points
   // search for closest (going towards positive) zero crossing
   unsigned startIdx = start;
   for (unsigned i = start; i < end; i++) {
-    if (signbit(audioData[i])) {
-      if (!signbit(audioData[i + 1]) != !signbit(audioData[i])) {
+    if (signbit(audioData[i - start])) {
+      if (!signbit(audioData[i + 1 - start]) != !signbit(audioData[i - start])) {
         // which is closer to zero
-        if (fabs(audioData[i]) < fabs(audioData[i + 1])) {
+        if (fabs(audioData[i - start]) < fabs(audioData[i + 1 - start])) {
           startIdx = i;
           break;
         } else {
@@ -1315,15 +1354,13 @@ void MyFrame::OnAddLoop(wxCommandEvent& WXUNUSED(event)) {
   // find a suitable match from end
   unsigned endIdx = end;
   for (unsigned i = end; i > startIdx; i--) {
-    if (!signbit(audioData[i])) {
-      if (signbit(audioData[i - 1]) != signbit(audioData[i])) {
+    if (!signbit(audioData[i - start])) {
+      if (signbit(audioData[i - 1 - start]) != signbit(audioData[i - start])) {
         endIdx = i - 1;
           break;
       }
     }
   }
-  // clean up
-  delete[] audioData;
   LoopParametersDialog loopDialog(startIdx, endIdx, m_audiofile->ArrayLength / m_audiofile->m_channels, this);
 
   if (loopDialog.ShowModal() == wxID_OK) {
@@ -1530,6 +1567,9 @@ void MyFrame::OnAutoLoopSettings(wxCommandEvent& WXUNUSED(event)) {
     m_autoloop->SetLoops(m_autoloopSettings->GetNrLoops());
     m_autoloop->SetMultiple(m_autoloopSettings->GetMultiple());
     m_autoloop->SetBruteForce(m_autoloopSettings->GetBruteForce());
+    m_autoloop->SetCorrelation(m_autoloopSettings->GetCorrelation());
+    m_autoloop->SetCorrelationWindow(m_autoloopSettings->GetCorrelationWindow());
+    m_autoloop->SetCoarseSearch(m_autoloopSettings->GetCoarseSearch());
     
     // Only update audiofile if it exist! It should be updated when loaded anyway!
     if (m_audiofile) {
@@ -1554,6 +1594,9 @@ void MyFrame::OnAutoLoopSettings(wxCommandEvent& WXUNUSED(event)) {
     m_autoloopSettings->SetStart(oldStart);
     m_autoloopSettings->SetEnd(oldEnd);
     m_autoloopSettings->SetBruteForce(m_autoloop->GetBruteForce());
+    m_autoloopSettings->SetCorrelation(m_autoloop->GetCorrelation());
+    m_autoloopSettings->SetCorrelationWindow(m_autoloop->GetCorrelationWindow());
+    m_autoloopSettings->SetCoarseSearch(m_autoloop->GetCoarseSearch());
     m_autoloopSettings->UpdateLabels();
   }
 }
@@ -1619,18 +1662,6 @@ void MyFrame::OnCrossfade(wxCommandEvent& WXUNUSED(event)) {
 
     // perform crossfading on the first selected loop with selected method
     m_audiofile->PerformCrossfade(firstSelected, crossfadeTime, crossfadetype);
-    
-    // if resampled audio is used it must be updated too!
-    if (m_sound->StreamNeedsResampling()) {
-      m_resampler->ResetState();
-      // fill resample data struct with values
-      double src_ratio = (1.0 * m_sound->GetSampleRateToUse()) / (1.0 * m_audiofile->GetSampleRate());
-      m_resampler->SetDataEndOfInput(0); // Set this later
-      m_resampler->SetDataInputFrames(m_audiofile->ArrayLength / m_audiofile->m_channels);
-      m_resampler->SetDataIn(m_audiofile->floatAudioData);
-      m_resampler->SetDataSrcRatio(src_ratio);
-      m_resampler->SimpleResample(m_audiofile->m_channels);
-    }
 
     // Enable save icon and menu
     SetModified();
@@ -1734,7 +1765,10 @@ void MyFrame::OnCutFade(wxCommandEvent& WXUNUSED(event)) {
     // update values
     m_cutNFade->TransferDataFromWindow();
 
-    // make eventual cuts of audio data
+    // make eventual cuts of audio data, playback can't continue on data
+    // that's being moved around
+    if ((m_cutNFade->GetCutStart() > 0 || m_cutNFade->GetCutEnd() > 0) && m_sound->IsStreamActive())
+      DoStopPlay();
 
     // from beginning
     if (m_cutNFade->GetCutStart() > 0) {
@@ -1780,17 +1814,9 @@ void MyFrame::OnCutFade(wxCommandEvent& WXUNUSED(event)) {
 
     UpdateLoopsAndCuesDisplay();
 
-    // if resampled audio is used it must be updated too!
-    if (m_sound->StreamNeedsResampling()) {
-      m_resampler->ResetState();
-      // fill resample data struct with values
-      double src_ratio = (1.0 * m_sound->GetSampleRateToUse()) / (1.0 * m_audiofile->GetSampleRate());
-      m_resampler->SetDataEndOfInput(0); // Set this later
-      m_resampler->SetDataInputFrames(m_audiofile->ArrayLength / m_audiofile->m_channels);
-      m_resampler->SetDataIn(m_audiofile->floatAudioData);
-      m_resampler->SetDataSrcRatio(src_ratio);
-      m_resampler->SimpleResample(m_audiofile->m_channels);
-    }
+    // if resampled audio is used its length must follow the cuts
+    if (m_sound->StreamNeedsResampling())
+      m_resampler->SetSource(m_audiofile->m_audio);
 
     // then we should make sure to update the views
     UpdateAllViews();
@@ -2239,15 +2265,15 @@ void MyFrame::PopulateListCtrl() {
 
       SF_INSTRUMENT instr;
       SF_CUES cues;
-      SndfileHandle sfh;
+      MappedWavReader wavReader;
       wxString filePath;
       filePath = workingDir;
       filePath += wxFILE_SEP_PATH;
       filePath += fileNames[i];
-      sfh = SndfileHandle(((const char*)filePath.mb_str()));
 
-      if (sfh) {
-        if (sfh.command(4304, &instr, sizeof(instr)) == SF_TRUE) {
+      // only the metadata chunks are needed so the audio data is never read
+      if (wavReader.Open(filePath)) {
+        if (wavReader.GetInstrument(instr)) {
           wxString loopNbr = wxString::Format(wxT("%i"), instr.loop_count);
           m_fileListCtrl->SetItem(i, 1, loopNbr);
 
@@ -2264,7 +2290,7 @@ void MyFrame::PopulateListCtrl() {
           m_fileListCtrl->SetItem(i, 4, wxT("0"));
         }
 
-        if (sfh.command(4302, &cues, sizeof(cues)) == SF_TRUE) {
+        if (wavReader.GetCues(cues)) {
           wxString cueNbr = wxString::Format(wxT("%i"), cues.cue_count);
           m_fileListCtrl->SetItem(i, 2, cueNbr);
         } else {
@@ -35,6 +35,7 @@
 #include "BatchProcessDialog.h"
 #include <wx/fileconf.h>
 #include "MyResampler.h"
+#include "PlaybackBuffer.h"
 
 class MyFrame : public wxFrame {
 public:
@@ -139,6 +140,7 @@ private:
   int m_frameHeight;
   bool m_frameMaximized;
   MyResampler *m_resampler;
+  PlaybackBuffer *m_playback;
   int m_pitchMethod;
   int m_spectrumFftSize;
   int m_spectrumWindow;
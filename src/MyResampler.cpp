@@ -19,24 +19,30 @@
  */
 
 #include "MyResampler.h"
-#include <vector>
+#include <algorithm>
+#include <cmath>
 
-MyResampler::MyResampler(int channels) : resampledAudioData(NULL), m_resampledDataLength(0) {
+// Input frames converted and thrown away before each part so that the
+// filter has settled when the part starts (more when downsampling)
+static const unsigned SETTLE_FRAMES = 1024;
+
+// Parts start anywhere if the sample rates need more input frames than
+// this to line up with an output frame
+static const unsigned MAX_ALIGN_FRAMES = 4096;
+
+// Samples converted by each call of the converter
+static const unsigned RESAMPLE_BLOCK_SAMPLES = 4096;
+
+MyResampler::MyResampler(int channels) : m_resampledDataLength(0), m_channels(channels), m_audio(NULL), m_alignFrames(1) {
   // initialize samplerate converter
   src_state = src_new(SRC_SINC_MEDIUM_QUALITY, channels, &src_error);
+  src_data.src_ratio = 1.0;
 }
 
 MyResampler::~MyResampler() {
   // Cleanup samplerate converter
   if (src_state)
     src_delete(src_state);
-
-  delete[] resampledAudioData;
-}
-
-void MyResampler::ResetState() {
-  src_reset(src_state);
-  delete[] resampledAudioData;
 }
 
 wxString MyResampler::GetErrorString() {
@@ -55,48 +61,77 @@ bool MyResampler::HasError() {
     return false;
 }
 
-void MyResampler::SetDataIn(float *in) {
-  src_data.data_in = in;
-}
-
-void MyResampler::SetDataInputFrames(long inFrames) {
-  src_data.input_frames = inFrames;
-}
+void MyResampler::SetSampleRates(unsigned inputRate, unsigned outputRate) {
+  src_data.src_ratio = (1.0 * outputRate) / (1.0 * inputRate);
 
-void MyResampler::SetDataEndOfInput(int end) {
-  src_data.end_of_input = end;
+  unsigned a = inputRate;
+  unsigned b = outputRate;
+  while (b != 0) {
+    unsigned rest = a % b;
+    a = b;
+    b = rest;
+  }
+  m_alignFrames = inputRate / a;
+  if (m_alignFrames > MAX_ALIGN_FRAMES)
+    m_alignFrames = 1;
 }
 
-void MyResampler::SetDataSrcRatio(double ratio) {
-  src_data.src_ratio = ratio;
+void MyResampler::SetSource(AudioStore *audio) {
+  m_audio = audio;
+  m_resampledDataLength = (unsigned long) (audio->GetFrames() * src_data.src_ratio) * m_channels;
 }
 
-void MyResampler::SimpleResample(int channels) {
-  float output[4096];
+unsigned long MyResampler::ReadResampled(unsigned long firstSample, unsigned long nbrSamples, float *out) {
+  if (m_audio == NULL || src_state == NULL || firstSample >= m_resampledDataLength)
+    return 0;
+  unsigned long endSample = firstSample + std::min(nbrSamples, m_resampledDataLength - firstSample);
+
+  // the conversion starts at an input frame that lines up with an output
+  // frame, so that the parts fit together as if all was resampled at once
+  double ratio = src_data.src_ratio;
+  unsigned long settleFrames = SETTLE_FRAMES / std::min(ratio, 1.0);
+  unsigned long inputFrame = (firstSample / m_channels) / ratio;
+  inputFrame = inputFrame > settleFrames ? inputFrame - settleFrames : 0;
+  inputFrame -= inputFrame % m_alignFrames;
+  unsigned long outputFrame = lround(inputFrame * ratio);
+
+  float input[RESAMPLE_BLOCK_SAMPLES];
+  float output[RESAMPLE_BLOCK_SAMPLES];
+  src_reset(src_state);
+  src_data.data_in = input;
   src_data.data_out = output;
-  src_data.output_frames = 4096 / channels;
-  std::vector<float> tempData;
-  
-  while (1) {
-    if (src_data.input_frames < 4096 / channels)
+  src_data.output_frames = RESAMPLE_BLOCK_SAMPLES / m_channels;
+  src_data.end_of_input = 0;
+  unsigned long inputLength = m_audio->GetFrames();
+  unsigned long written = 0;
+
+  while (outputFrame * m_channels < endSample) {
+    unsigned long inputSamples = m_audio->ReadPlayback(inputFrame * m_channels, (RESAMPLE_BLOCK_SAMPLES / m_channels) * m_channels, input);
+    src_data.input_frames = inputSamples / m_channels;
+    if (inputFrame + src_data.input_frames >= inputLength)
       src_data.end_of_input = 1;
 
-    src_process(src_state, &src_data);
-    for (long int i = 0; i < src_data.output_frames_gen * channels; i++) {
-      tempData.push_back(output[i]);
+    src_error = src_process(src_state, &src_data);
+    if (src_error)
+      break;
+
+    // only the converted samples within the part are kept
+    unsigned long convertedStart = outputFrame * m_channels;
+    unsigned long convertedEnd = convertedStart + src_data.output_frames_gen * m_channels;
+    unsigned long copyStart = std::max(convertedStart, firstSample);
+    unsigned long copyEnd = std::min(convertedEnd, endSample);
+    if (copyStart < copyEnd) {
+      std::copy(output + (copyStart - convertedStart), output + (copyEnd - convertedStart), out + (copyStart - firstSample));
+      written = copyEnd - firstSample;
     }
-    
+
     /* Terminate if done. */
     if (src_data.end_of_input && src_data.output_frames_gen == 0)
-      break ;
-			
-    src_data.data_in += src_data.input_frames_used * channels;
-    src_data.input_frames -= src_data.input_frames_used;
+      break;
+
+    outputFrame += src_data.output_frames_gen;
+    inputFrame += src_data.input_frames_used;
   }
-  
-  m_resampledDataLength = tempData.size();
-  resampledAudioData = new float[m_resampledDataLength];
-  for (unsigned long int i = 0; i < m_resampledDataLength; i++)
-    resampledAudioData[i] = tempData[i];
-}
 
+  return written;
+}
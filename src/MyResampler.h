@@ -23,29 +23,36 @@
 
 #include <samplerate.h>
 #include <wx/wx.h>
+#include "AudioStore.h"
 
 class MyResampler {
 public:
   MyResampler(int channels);
   ~MyResampler();
 
-  void ResetState();
   wxString GetErrorString();
   double GetRatioUsed();
   bool HasError();
-  void SetDataIn(float *in);
-  void SetDataInputFrames(long inFrames);
-  void SetDataEndOfInput(int end);
-  void SetDataSrcRatio(double ratio);
-  void SimpleResample(int channels);
-  
-  float *resampledAudioData;
+  void SetSampleRates(unsigned inputRate, unsigned outputRate);
+  // The audio to resample, set again when its length has changed
+  void SetSource(AudioStore *audio);
+  // Resample up to nbrSamples from firstSample on (counted as in the
+  // interleaved resampled data) to out, returns the number written. Only
+  // the input a little before the part is read, so that any part can be
+  // resampled without keeping a resampled copy of everything
+  unsigned long ReadResampled(unsigned long firstSample, unsigned long nbrSamples, float *out);
+
   unsigned long int m_resampledDataLength;
 
 private:
   SRC_STATE *src_state;
   SRC_DATA src_data;
   int src_error;
+  int m_channels;
+  AudioStore *m_audio;
+  // parts start at a multiple of these input frames, which line up with a
+  // whole output frame
+  unsigned m_alignFrames;
 
 };
 
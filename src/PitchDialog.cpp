@@ -55,12 +55,15 @@ void PitchDialog::Init(FileHandling *audioFile) {
   double hps_midi_note_pitch;
   double fft_midi_note_pitch;
   double td_midi_note_pitch;
+  double zoom_midi_note_pitch;
+  double pv_midi_note_pitch;
 
-  double fftPitches[3];
-  for (int i = 0; i < 3; i++)
+  double fftPitches[4];
+  for (int i = 0; i < 4; i++)
     fftPitches[i] = 0;
   bool got_fftpitch = m_audioFile->GetFFTPitch(fftPitches);
   m_TDdetectedPitch = m_audioFile->GetTDPitch();
+  m_zoomPitch = m_audioFile->GetZoomPitch();
   m_fileMIDIUnityNote = (int) m_audioFile->m_loops->GetMIDIUnityNote();
   m_fileMIDIPitchFraction = (double) m_audioFile->m_loops->GetMIDIPitchFraction() / (double)UINT_MAX * 100.0;
 
@@ -113,18 +116,49 @@ void PitchDialog::Init(FileHandling *audioFile) {
     m_actualTdMIDIPitchFraction = 0;
   }
 
+  m_pvPitch = fftPitches[3];
+  if (m_pvPitch != 0) {
+    // Phase vocoder detection
+    m_pvMIDIUnityNote = (69 + 12 * (log10(m_pvPitch / 440.0) / log10(2)));
+    pv_midi_note_pitch = 440.0 * pow(2, ((double)(m_pvMIDIUnityNote - 69) / 12.0));
+    m_pvMIDIPitchFraction = 1200 * (log10(m_pvPitch / pv_midi_note_pitch) / log10(2));
+    m_actualPvMIDIPitchFraction = ((double)UINT_MAX * (m_pvMIDIPitchFraction / 100.0));
+  } else {
+    m_pvMIDIUnityNote = 0;
+    pv_midi_note_pitch = 0;
+    m_pvMIDIPitchFraction = 0;
+    m_actualPvMIDIPitchFraction = 0;
+  }
+
+  if (m_zoomPitch != 0) {
+    // Zoomed FFT detection
+    m_zoomMIDIUnityNote = (69 + 12 * (log10(m_zoomPitch / 440.0) / log10(2)));
+    zoom_midi_note_pitch = 440.0 * pow(2, ((double)(m_zoomMIDIUnityNote - 69) / 12.0));
+    m_zoomMIDIPitchFraction = 1200 * (log10(m_zoomPitch / zoom_midi_note_pitch) / log10(2));
+    m_actualZoomMIDIPitchFraction = ((double)UINT_MAX * (m_zoomMIDIPitchFraction / 100.0));
+  } else {
+    m_zoomMIDIUnityNote = 0;
+    zoom_midi_note_pitch = 0;
+    m_zoomMIDIPitchFraction = 0;
+    m_actualZoomMIDIPitchFraction = 0;
+  }
+
   CalculatingResultingPitch();
   m_useFFTDetection = true;
   m_useHpsFFTDetection = false;
   m_useFftPeakDetection = false;
   m_useTDDetection = false;
   m_useManual = false;
+  m_useZoomDetection = false;
+  m_usePvDetection = false;
 
   pitchMethods.Add(wxT("FFT pitch"));
   pitchMethods.Add(wxT("HPS pitch"));
   pitchMethods.Add(wxT("Strongest peak"));
   pitchMethods.Add(wxT("Timedomain pitch"));
   pitchMethods.Add(wxT("Existing/manual pitch"));
+  pitchMethods.Add(wxT("Zoomed FFT pitch"));
+  pitchMethods.Add(wxT("Phase vocoder pitch"));
 
   for (int i = 0; i < 128; i++)
     m_notenumbers.Add(wxString::Format(wxT("%d"), i));
@@ -317,6 +351,86 @@ void PitchDialog::CreateControls() {
   peakPitchFractionLabel->SetLabel(wxString::Format(wxT("PitchFraction: %.2f cent"), m_fftPeakMIDIPitchFraction));
   peakPitchContainer->Add(peakPitchFractionLabel, 1, wxLEFT|wxRIGHT|wxTOP, 2);
 
+  // Vertical sizer for fourth fft pitch subsections
+  wxBoxSizer *zoomPitchContainer = new wxBoxSizer(wxVERTICAL);
+  fftPitchContainer->Add(zoomPitchContainer, 1, wxGROW|wxALL, 5);
+
+  // Label for the zoomed pitch frequency
+  wxStaticText *zoomPitchLabel = new wxStaticText (
+    this,
+    wxID_STATIC,
+    wxEmptyString,
+    wxDefaultPosition,
+    wxDefaultSize,
+    0
+  );
+  zoomPitchLabel->SetLabel(wxString::Format(wxT("Zoomed pitch: %.3f Hz"), m_zoomPitch));
+  zoomPitchContainer->Add(zoomPitchLabel, 1, wxLEFT|wxRIGHT|wxTOP, 2);
+
+  // Label for the calculated MIDIUnityNote
+  wxStaticText *zoomMidiNoteLabel = new wxStaticText (
+    this,
+    wxID_STATIC,
+    wxEmptyString,
+    wxDefaultPosition,
+    wxDefaultSize,
+    0
+  );
+  zoomMidiNoteLabel->SetLabel(wxString::Format(wxT("MIDIUnityNote: %d"), m_zoomMIDIUnityNote));
+  zoomPitchContainer->Add(zoomMidiNoteLabel, 1, wxLEFT|wxRIGHT|wxTOP, 2);
+
+  // Label for the calculated MIDIPitchFraction
+  wxStaticText *zoomPitchFractionLabel = new wxStaticText (
+    this,
+    wxID_STATIC,
+    wxEmptyString,
+    wxDefaultPosition,
+    wxDefaultSize,
+    0
+  );
+  zoomPitchFractionLabel->SetLabel(wxString::Format(wxT("PitchFraction: %.2f cent"), m_zoomMIDIPitchFraction));
+  zoomPitchContainer->Add(zoomPitchFractionLabel, 1, wxLEFT|wxRIGHT|wxTOP, 2);
+
+  // Vertical sizer for fifth fft pitch subsections
+  wxBoxSizer *pvPitchContainer = new wxBoxSizer(wxVERTICAL);
+  fftPitchContainer->Add(pvPitchContainer, 1, wxGROW|wxALL, 5);
+
+  // Label for the phase vocoder pitch frequency
+  wxStaticText *pvPitchLabel = new wxStaticText (
+    this,
+    wxID_STATIC,
+    wxEmptyString,
+    wxDefaultPosition,
+    wxDefaultSize,
+    0
+  );
+  pvPitchLabel->SetLabel(wxString::Format(wxT("Phase vocoder pitch: %.3f Hz"), m_pvPitch));
+  pvPitchContainer->Add(pvPitchLabel, 1, wxLEFT|wxRIGHT|wxTOP, 2);
+
+  // Label for the calculated MIDIUnityNote
+  wxStaticText *pvMidiNoteLabel = new wxStaticText (
+    this,
+    wxID_STATIC,
+    wxEmptyString,
+    wxDefaultPosition,
+    wxDefaultSize,
+    0
+  );
+  pvMidiNoteLabel->SetLabel(wxString::Format(wxT("MIDIUnityNote: %d"), m_pvMIDIUnityNote));
+  pvPitchContainer->Add(pvMidiNoteLabel, 1, wxLEFT|wxRIGHT|wxTOP, 2);
+
+  // Label for the calculated MIDIPitchFraction
+  wxStaticText *pvPitchFractionLabel = new wxStaticText (
+    this,
+    wxID_STATIC,
+    wxEmptyString,
+    wxDefaultPosition,
+    wxDefaultSize,
+    0
+  );
+  pvPitchFractionLabel->SetLabel(wxString::Format(wxT("PitchFraction: %.2f cent"), m_pvMIDIPitchFraction));
+  pvPitchContainer->Add(pvPitchFractionLabel, 1, wxLEFT|wxRIGHT|wxTOP, 2);
+
   // Grouping of TimeDomain pitch detection information
   wxStaticBox *TDPitchBox = new wxStaticBox(
     this,
@@ -588,6 +702,12 @@ void PitchDialog::TransferSelectedPitchToFile() {
     } else if (selectedMethod == 4) {
       m_audioFile->m_loops->SetMIDIUnityNote((char) GetMIDINote());
       m_audioFile->m_loops->SetMIDIPitchFraction((unsigned)((double)UINT_MAX * (GetPitchFraction() / 100.0)));
+    } else if (selectedMethod == 5) {
+      m_audioFile->m_loops->SetMIDIUnityNote((char) m_zoomMIDIUnityNote);
+      m_audioFile->m_loops->SetMIDIPitchFraction(m_actualZoomMIDIPitchFraction);
+    } else if (selectedMethod == 6) {
+      m_audioFile->m_loops->SetMIDIUnityNote((char) m_pvMIDIUnityNote);
+      m_audioFile->m_loops->SetMIDIPitchFraction(m_actualPvMIDIPitchFraction);
     }
 }
 
@@ -602,6 +722,10 @@ int PitchDialog::GetMethodUsed() {
     return 3;
   if (m_useManual)
     return 4;
+  if (m_useZoomDetection)
+    return 5;
+  if (m_usePvDetection)
+    return 6;
   else 
     return 0;
 }
@@ -618,6 +742,8 @@ void PitchDialog::OnAutoDetectionCheck(wxCommandEvent& WXUNUSED(event)) {
     m_useFftPeakDetection = false;
     m_useTDDetection = false;
     m_useManual = false;
+    m_useZoomDetection = false;
+    m_usePvDetection = false;
     midinote->Enable(false);
     pitchFract->Enable(false);
   } else if (radioBox->GetSelection() == 1) {
@@ -627,6 +753,8 @@ void PitchDialog::OnAutoDetectionCheck(wxCommandEvent& WXUNUSED(event)) {
     m_useFftPeakDetection = false;
     m_useTDDetection = false;
     m_useManual = false;
+    m_useZoomDetection = false;
+    m_usePvDetection = false;
     midinote->Enable(false);
     pitchFract->Enable(false);
   } else if (radioBox->GetSelection() == 2) {
@@ -636,6 +764,8 @@ void PitchDialog::OnAutoDetectionCheck(wxCommandEvent& WXUNUSED(event)) {
     m_useFftPeakDetection = true;
     m_useTDDetection = false;
     m_useManual = false;
+    m_useZoomDetection = false;
+    m_usePvDetection = false;
     midinote->Enable(false);
     pitchFract->Enable(false);
   } else if (radioBox->GetSelection() == 3) {
@@ -645,6 +775,30 @@ void PitchDialog::OnAutoDetectionCheck(wxCommandEvent& WXUNUSED(event)) {
     m_useFftPeakDetection = false;
     m_useTDDetection = true;
     m_useManual = false;
+    m_useZoomDetection = false;
+    m_usePvDetection = false;
+    midinote->Enable(false);
+    pitchFract->Enable(false);
+  } else if (radioBox->GetSelection() == 5) {
+    // Zoomed FFT method chosen
+    m_useFFTDetection = false;
+    m_useHpsFFTDetection = false;
+    m_useFftPeakDetection = false;
+    m_useTDDetection = false;
+    m_useManual = false;
+    m_useZoomDetection = true;
+    m_usePvDetection = false;
+    midinote->Enable(false);
+    pitchFract->Enable(false);
+  } else if (radioBox->GetSelection() == 6) {
+    // Phase vocoder method chosen
+    m_useFFTDetection = false;
+    m_useHpsFFTDetection = false;
+    m_useFftPeakDetection = false;
+    m_useTDDetection = false;
+    m_useManual = false;
+    m_useZoomDetection = false;
+    m_usePvDetection = true;
     midinote->Enable(false);
     pitchFract->Enable(false);
   } else {
@@ -654,6 +808,8 @@ void PitchDialog::OnAutoDetectionCheck(wxCommandEvent& WXUNUSED(event)) {
     m_useFftPeakDetection = false;
     m_useTDDetection = false;
     m_useManual = true;
+    m_useZoomDetection = false;
+    m_usePvDetection = false;
     midinote->Enable(true);
     pitchFract->Enable(true);
   }
@@ -734,6 +890,8 @@ void PitchDialog::SetPreferredPitchMethod(int method) {
       m_useFftPeakDetection = false;
       m_useTDDetection = false;
       m_useManual = false;
+      m_useZoomDetection = false;
+      m_usePvDetection = false;
       midinote->Enable(false);
       pitchFract->Enable(false);
       break;
@@ -744,6 +902,8 @@ void PitchDialog::SetPreferredPitchMethod(int method) {
       m_useFftPeakDetection = false;
       m_useTDDetection = false;
       m_useManual = false;
+      m_useZoomDetection = false;
+      m_usePvDetection = false;
       midinote->Enable(false);
       pitchFract->Enable(false);
       break;
@@ -754,6 +914,8 @@ void PitchDialog::SetPreferredPitchMethod(int method) {
       m_useFftPeakDetection = true;
       m_useTDDetection = false;
       m_useManual = false;
+      m_useZoomDetection = false;
+      m_usePvDetection = false;
       midinote->Enable(false);
       pitchFract->Enable(false);
       break;
@@ -764,6 +926,8 @@ void PitchDialog::SetPreferredPitchMethod(int method) {
       m_useFftPeakDetection = false;
       m_useTDDetection = true;
       m_useManual = false;
+      m_useZoomDetection = false;
+      m_usePvDetection = false;
       midinote->Enable(false);
       pitchFract->Enable(false);
       break;
@@ -774,9 +938,35 @@ void PitchDialog::SetPreferredPitchMethod(int method) {
       m_useFftPeakDetection = false;
       m_useTDDetection = false;
       m_useManual = true;
+      m_useZoomDetection = false;
+      m_usePvDetection = false;
       midinote->Enable(true);
       pitchFract->Enable(true);
       break;
+    case 5:
+      radioBox->SetSelection(5);
+      m_useFFTDetection = false;
+      m_useHpsFFTDetection = false;
+      m_useFftPeakDetection = false;
+      m_useTDDetection = false;
+      m_useManual = false;
+      m_useZoomDetection = true;
+      m_usePvDetection = false;
+      midinote->Enable(false);
+      pitchFract->Enable(false);
+      break;
+    case 6:
+      radioBox->SetSelection(6);
+      m_useFFTDetection = false;
+      m_useHpsFFTDetection = false;
+      m_useFftPeakDetection = false;
+      m_useTDDetection = false;
+      m_useManual = false;
+      m_useZoomDetection = false;
+      m_usePvDetection = true;
+      midinote->Enable(false);
+      pitchFract->Enable(false);
+      break;
   }
 }
 
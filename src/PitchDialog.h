@@ -107,6 +107,16 @@ private:
   double m_fftPeakMIDIPitchFraction;
   unsigned m_actualFftPeakMIDIPitchFraction;
 
+  double m_zoomPitch;
+  int m_zoomMIDIUnityNote;
+  double m_zoomMIDIPitchFraction;
+  unsigned m_actualZoomMIDIPitchFraction;
+
+  double m_pvPitch;
+  int m_pvMIDIUnityNote;
+  double m_pvMIDIPitchFraction;
+  unsigned m_actualPvMIDIPitchFraction;
+
   int m_fileMIDIUnityNote;
   double m_fileMIDIPitchFraction;
   bool m_useFFTDetection;
@@ -114,6 +124,8 @@ private:
   bool m_useFftPeakDetection;
   bool m_useTDDetection;
   bool m_useManual;
+  bool m_useZoomDetection;
+  bool m_usePvDetection;
   double m_resultingPitch;
   int m_TDdetectedMIDIUnityNote;
   double m_TDdetectedMIDIPitchFraction;
@@ -0,0 +1,172 @@
+/*
+ * PlaybackBuffer.cpp is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+#include "PlaybackBuffer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// Interleaved samples of each block, a stereo file at 44.1 kHz plays a block
+// in about 0.37 seconds which is the time the feeder has to copy the next one
+static const unsigned long BLOCK_SAMPLES = 32768;
+
+// The block playing, the one after it and the first two of the loop are
+// wanted at the same time, the rest are free for the feeder to fill
+static const unsigned NBR_WANTED_BLOCKS = 4;
+static const unsigned NBR_BLOCKS = 6;
+
+// How often the feeder checks the playback position
+static const unsigned FEEDER_INTERVAL_MS = 5;
+
+PlaybackBuffer::PlaybackBuffer() : m_audio(NULL), m_resampler(NULL), m_position(NULL), m_changeCount(0), m_stop(false) {
+  m_blocks = new Block[NBR_BLOCKS];
+  for (unsigned i = 0; i < NBR_BLOCKS; i++) {
+    m_blocks[i].index = -1;
+    m_blocks[i].readers = 0;
+    m_blocks[i].length = 0;
+    m_blocks[i].samples.resize(BLOCK_SAMPLES);
+  }
+}
+
+PlaybackBuffer::~PlaybackBuffer() {
+  Stop();
+  delete[] m_blocks;
+}
+
+void PlaybackBuffer::Start(AudioStore *audio, MyResampler *resampler, const unsigned *position) {
+  Stop();
+
+  m_audio = audio;
+  m_resampler = resampler;
+  m_position = position;
+  m_changeCount = m_audio->GetChangeCount();
+  Update();
+
+  m_stop = false;
+  m_feeder = std::thread(&PlaybackBuffer::FeederLoop, this);
+}
+
+void PlaybackBuffer::Stop() {
+  if (m_feeder.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_wakeUp.notify_all();
+    m_feeder.join();
+  }
+
+  for (unsigned i = 0; i < NBR_BLOCKS; i++)
+    m_blocks[i].index = -1;
+  m_audio = NULL;
+  m_resampler = NULL;
+  m_position = NULL;
+}
+
+unsigned long PlaybackBuffer::Read(unsigned long firstSample, unsigned long nbrSamples, float *out) {
+  long index = firstSample / BLOCK_SAMPLES;
+  unsigned long offset = firstSample % BLOCK_SAMPLES;
+  for (unsigned i = 0; i < NBR_BLOCKS; i++) {
+    Block &block = m_blocks[i];
+    if (block.index != index)
+      continue;
+
+    // the block is only read if it still holds index once it's marked as
+    // being read, otherwise the feeder may already be filling it again
+    unsigned long copied = 0;
+    block.readers++;
+    if (block.index == index && offset < block.length) {
+      copied = std::min(nbrSamples, block.length - offset);
+      std::copy(block.samples.begin() + offset, block.samples.begin() + offset + copied, out);
+    }
+    block.readers--;
+    return copied;
+  }
+  return 0;
+}
+
+void PlaybackBuffer::FeederLoop() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_stop) {
+    lock.unlock();
+    Update();
+    lock.lock();
+    m_wakeUp.wait_for(lock, std::chrono::milliseconds(FEEDER_INTERVAL_MS));
+  }
+}
+
+void PlaybackBuffer::Update() {
+  // an edit while playing makes every block outdated
+  unsigned long changeCount = m_audio->GetChangeCount();
+  if (changeCount != m_changeCount) {
+    for (unsigned i = 0; i < NBR_BLOCKS; i++)
+      m_blocks[i].index = -1;
+    m_changeCount = changeCount;
+  }
+
+  // the loop positions are always those of the audio, but the playback
+  // position is in the resampled audio when it's resampled
+  unsigned long length = m_audio->GetLength();
+  unsigned long loopStartSample = m_position[1];
+  if (m_resampler) {
+    int channels = m_audio->GetChannels();
+    length = m_resampler->m_resampledDataLength;
+    loopStartSample = lround(m_position[1] / channels * m_resampler->GetRatioUsed()) * channels;
+  }
+  long current = m_position[0] / BLOCK_SAMPLES;
+  long loopStart = loopStartSample / BLOCK_SAMPLES;
+  long wanted[NBR_WANTED_BLOCKS] = { current, current + 1, loopStart, loopStart + 1 };
+  long nbrBlocks = (length + BLOCK_SAMPLES - 1) / BLOCK_SAMPLES;
+
+  for (unsigned i = 0; i < NBR_WANTED_BLOCKS; i++) {
+    if (wanted[i] >= nbrBlocks)
+      continue;
+
+    bool isReady = false;
+    for (unsigned j = 0; j < NBR_BLOCKS && !isReady; j++)
+      isReady = m_blocks[j].index == wanted[i];
+    if (isReady)
+      continue;
+
+    // use the first block that isn't wanted, at least two of them are free
+    for (unsigned j = 0; j < NBR_BLOCKS; j++) {
+      long index = m_blocks[j].index;
+      if (std::find(wanted, wanted + NBR_WANTED_BLOCKS, index) != wanted + NBR_WANTED_BLOCKS)
+        continue;
+      if (FillBlock(m_blocks[j], wanted[i]))
+        break;
+    }
+  }
+}
+
+bool PlaybackBuffer::FillBlock(Block &block, long index) {
+  // once the block is marked as empty no new reader will use it, but one
+  // that started before must be done before it can be overwritten
+  block.index = -1;
+  if (block.readers != 0)
+    return false;
+
+  if (m_resampler)
+    block.length = m_resampler->ReadResampled(index * BLOCK_SAMPLES, BLOCK_SAMPLES, &block.samples[0]);
+  else
+    block.length = m_audio->ReadPlayback(index * BLOCK_SAMPLES, BLOCK_SAMPLES, &block.samples[0]);
+  block.index = index;
+  return true;
+}
@@ -0,0 +1,87 @@
+/*
+ * PlaybackBuffer.h is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+#ifndef PLAYBACKBUFFER_H
+#define PLAYBACKBUFFER_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "AudioStore.h"
+#include "MyResampler.h"
+
+/*
+ * PlaybackBuffer keeps the interleaved floats around the playback position
+ * ready for the audio callback, so that it never has to wait for the lock
+ * of the audio store or for a page to be loaded from disk. A feeder thread
+ * copies the block that is playing, the one after it and the first two of
+ * the loop from the store. The callback only reads blocks that are already
+ * there, it neither locks nor allocates anything. When the audio has to be
+ * resampled for the device the blocks hold the resampled audio.
+ */
+class PlaybackBuffer {
+public:
+  PlaybackBuffer();
+  ~PlaybackBuffer();
+
+  // Start feeding the blocks of audio around the positions of position (see
+  // pos in MySound.h), resampled by resampler unless it's NULL. The blocks
+  // wanted at the start are copied before this returns, so that playback
+  // doesn't begin with an underrun
+  void Start(AudioStore *audio, MyResampler *resampler, const unsigned *position);
+  // Stop the feeder and forget the blocks, the audio callback must not read
+  // while this is called
+  void Stop();
+  // For the audio callback, copy up to nbrSamples from firstSample on to out
+  // if they are in a block that is ready. Returns the number copied, which
+  // is 0 if the block isn't ready (or after the end of the audio)
+  unsigned long Read(unsigned long firstSample, unsigned long nbrSamples, float *out);
+
+private:
+  struct Block {
+    // index of the block of the audio that samples holds, -1 while empty
+    // or being filled
+    std::atomic<long> index;
+    // number of audio callbacks reading samples, the feeder doesn't fill a
+    // block that is being read
+    std::atomic<int> readers;
+    unsigned long length;
+    std::vector<float> samples;
+  };
+
+  Block *m_blocks;
+  AudioStore *m_audio;
+  MyResampler *m_resampler;
+  const unsigned *m_position;
+  unsigned long m_changeCount;
+  std::thread m_feeder;
+  std::mutex m_mutex;
+  std::condition_variable m_wakeUp;
+  bool m_stop;
+
+  void FeederLoop();
+  // Copy the blocks wanted for the current positions that are missing
+  void Update();
+  bool FillBlock(Block &block, long index);
+};
+
+#endif
@@ -0,0 +1,378 @@
+/*
+ * RiffChunkWriter.cpp is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+#include "RiffChunkWriter.h"
+#include <wx/filename.h>
+#include <cstring>
+#include <algorithm>
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+// Size of the buffer used when the data can't be copied by the kernel
+static const size_t COPY_BLOCK_BYTES = 1024 * 1024;
+
+static unsigned ReadLE32(const unsigned char *p) {
+  return (unsigned) p[0] | ((unsigned) p[1] << 8) | ((unsigned) p[2] << 16) | ((unsigned) p[3] << 24);
+}
+
+static void AppendLE32(std::vector<unsigned char> &v, unsigned value) {
+  v.push_back(value & 0xFF);
+  v.push_back((value >> 8) & 0xFF);
+  v.push_back((value >> 16) & 0xFF);
+  v.push_back((value >> 24) & 0xFF);
+}
+
+static void AppendId(std::vector<unsigned char> &v, const char *id) {
+  v.insert(v.end(), id, id + 4);
+}
+
+static bool IsChunk(const char *id, const char *other) {
+  return memcmp(id, other, 4) == 0;
+}
+
+RiffChunkWriter::RiffChunkWriter() {
+}
+
+RiffChunkWriter::~RiffChunkWriter() {
+  Close();
+}
+
+bool RiffChunkWriter::Open(wxString sourcePath) {
+  Close();
+  if (!m_source.Open(sourcePath, wxFile::read))
+    return false;
+
+  if (!ReadChunkHeaders()) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void RiffChunkWriter::Close() {
+  if (m_source.IsOpened())
+    m_source.Close();
+  m_chunks.clear();
+}
+
+void RiffChunkWriter::SetInstrument(const SF_INSTRUMENT &instr, int sampleRate) {
+  // Same layout as libsndfile writes, the loop end is written as given
+  m_smpl.clear();
+  AppendLE32(m_smpl, 0); // manufacturer
+  AppendLE32(m_smpl, 0); // product
+  AppendLE32(m_smpl, (unsigned) (1.0e9 / sampleRate)); // sample period in ns
+  AppendLE32(m_smpl, instr.basenote);
+  AppendLE32(m_smpl, instr.dwMIDIPitchFraction);
+  AppendLE32(m_smpl, 0); // SMPTE format
+  AppendLE32(m_smpl, 0); // SMPTE offset
+  AppendLE32(m_smpl, instr.loop_count);
+  AppendLE32(m_smpl, 0); // sampler data
+  for (int i = 0; i < instr.loop_count; i++) {
+    unsigned type;
+    switch (instr.loops[i].mode) {
+      case SF_LOOP_FORWARD:
+        type = 0;
+        break;
+      case SF_LOOP_ALTERNATING:
+        type = 1;
+        break;
+      case SF_LOOP_BACKWARD:
+        type = 2;
+        break;
+      default:
+        type = 32;
+        break;
+    }
+    AppendLE32(m_smpl, i); // cue point id
+    AppendLE32(m_smpl, type);
+    AppendLE32(m_smpl, instr.loops[i].start);
+    AppendLE32(m_smpl, instr.loops[i].end);
+    AppendLE32(m_smpl, 0); // fraction
+    AppendLE32(m_smpl, instr.loops[i].count);
+  }
+}
+
+void RiffChunkWriter::SetCues(const SF_CUES &cues) {
+  m_cue.clear();
+  AppendLE32(m_cue, cues.cue_count);
+  for (unsigned i = 0; i < cues.cue_count; i++) {
+    AppendLE32(m_cue, cues.cue_points[i].indx);
+    AppendLE32(m_cue, cues.cue_points[i].position);
+    AppendLE32(m_cue, cues.cue_points[i].fcc_chunk);
+    AppendLE32(m_cue, cues.cue_points[i].chunk_start);
+    AppendLE32(m_cue, cues.cue_points[i].block_start);
+    AppendLE32(m_cue, cues.cue_points[i].sample_offset);
+  }
+}
+
+void RiffChunkWriter::SetString(int strType, const char *str) {
+  const char *id;
+  switch (strType) {
+    case SF_STR_TITLE:
+      id = "INAM";
+      break;
+    case SF_STR_COPYRIGHT:
+      id = "ICOP";
+      break;
+    case SF_STR_SOFTWARE:
+      id = "ISFT";
+      break;
+    case SF_STR_ARTIST:
+      id = "IART";
+      break;
+    case SF_STR_COMMENT:
+      id = "ICMT";
+      break;
+    case SF_STR_DATE:
+      id = "ICRD";
+      break;
+    default:
+      return;
+  }
+
+  for (unsigned i = 0; i < m_strings.size(); i++) {
+    if (m_strings[i].first == id) {
+      m_strings[i].second = str;
+      return;
+    }
+  }
+  m_strings.push_back(std::make_pair(std::string(id), std::string(str)));
+}
+
+bool RiffChunkWriter::Write(wxString targetPath) {
+  if (!m_source.IsOpened())
+    return false;
+
+  wxFile target;
+  if (!target.Create(targetPath, true))
+    return false;
+
+  std::vector<unsigned char> header;
+  AppendId(header, "RIFF");
+  AppendLE32(header, 0); // updated when the size is known
+  AppendId(header, "WAVE");
+  bool success = target.Write(&header[0], header.size()) == header.size();
+
+  // The new metadata takes the place of the first old metadata chunk, or is
+  // put before the data chunk like libsndfile does if there was none
+  std::vector<unsigned char> infoList;
+  BuildInfoList(infoList);
+  bool metadataWritten = false;
+  for (unsigned i = 0; success && i < m_chunks.size(); i++) {
+    const RiffChunk &chunk = m_chunks[i];
+    bool isMetadata = IsChunk(chunk.id, "smpl") || IsChunk(chunk.id, "cue ") || chunk.isInfoList || chunk.isCueLabelList;
+    if (!metadataWritten && (isMetadata || IsChunk(chunk.id, "data"))) {
+      success = WriteChunk(target, "cue ", m_cue) && WriteChunk(target, "smpl", m_smpl);
+      if (success && !infoList.empty())
+        success = WriteChunk(target, "LIST", infoList);
+      metadataWritten = true;
+    }
+    if (success && !isMetadata)
+      success = CopyChunk(target, chunk);
+  }
+
+  if (success) {
+    wxFileOffset riffSize = target.Tell() - 8;
+    if (riffSize > (wxFileOffset) 0xFFFFFFFFU) {
+      success = false;
+    } else {
+      std::vector<unsigned char> size;
+      AppendLE32(size, (unsigned) riffSize);
+      success = target.Seek(4) == 4 && target.Write(&size[0], 4) == 4;
+    }
+  }
+
+  // Flush also syncs the file to disk so that the rename that follows can't
+  // leave an incomplete file behind
+  if (success)
+    success = target.Flush();
+  target.Close();
+  return success;
+}
+
+bool RiffChunkWriter::ReplaceFile(wxString tempPath, wxString targetPath, wxString modelPath) {
+#ifndef _WIN32
+  // the temporary file is only readable by the user until it gets the mode
+  // of the file it replaces, the owner is changed first as that can clear
+  // the set user/group id bits. Changing the owner is only allowed for root
+  // (or the group for its members) so a failure to do it is ignored
+  struct stat info;
+  bool hasModel = stat(targetPath.mb_str(), &info) == 0 || stat(modelPath.mb_str(), &info) == 0;
+  int fileDescriptor = open(tempPath.mb_str(), O_RDONLY);
+  if (fileDescriptor < 0)
+    return false;
+  if (hasModel) {
+    if (fchown(fileDescriptor, info.st_uid, info.st_gid) != 0 && fchown(fileDescriptor, (uid_t) -1, info.st_gid) != 0) {
+      // keep the owner and group of the user that saves
+    }
+    fchmod(fileDescriptor, info.st_mode & 07777);
+  }
+  // libsndfile doesn't sync what it writes
+  bool synced = fsync(fileDescriptor) == 0;
+  close(fileDescriptor);
+  if (!synced)
+    return false;
+#endif
+
+  if (!wxRenameFile(tempPath, targetPath, true))
+    return false;
+
+#ifndef _WIN32
+  // the new directory entry is only durable once the directory is synced
+  wxString directory = wxFileName(targetPath).GetPath();
+  if (directory.IsEmpty())
+    directory = wxT(".");
+  int directoryDescriptor = open(directory.mb_str(), O_RDONLY);
+  if (directoryDescriptor >= 0) {
+    fsync(directoryDescriptor);
+    close(directoryDescriptor);
+  }
+#endif
+  return true;
+}
+
+bool RiffChunkWriter::ReadChunkHeaders() {
+  unsigned char header[12];
+  if (m_source.Read(header, 12) != 12)
+    return false;
+  if (memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0)
+    return false;
+
+  wxFileOffset fileLength = m_source.Length();
+  wxFileOffset pos = 12;
+  bool hasFormat = false;
+  bool hasData = false;
+  while (pos + 8 <= fileLength) {
+    RiffChunk chunk;
+    if (m_source.Seek(pos) != pos || m_source.Read(header, 8) != 8)
+      return false;
+    memcpy(chunk.id, header, 4);
+    chunk.size = ReadLE32(header + 4);
+    chunk.offset = pos + 8;
+    // everything is copied verbatim so a truncated file can't be used
+    if (chunk.offset + chunk.size > fileLength)
+      return false;
+
+    chunk.isInfoList = false;
+    chunk.isCueLabelList = false;
+    if (IsChunk(chunk.id, "LIST") && chunk.size >= 4) {
+      if (m_source.Read(header, 4) != 4)
+        return false;
+      chunk.isInfoList = memcmp(header, "INFO", 4) == 0;
+      chunk.isCueLabelList = memcmp(header, "adtl", 4) == 0;
+    }
+    if (IsChunk(chunk.id, "fmt "))
+      hasFormat = true;
+    else if (IsChunk(chunk.id, "data"))
+      hasData = true;
+
+    m_chunks.push_back(chunk);
+    // chunks are word aligned
+    pos = chunk.offset + chunk.size + (chunk.size & 1);
+  }
+  return hasFormat && hasData;
+}
+
+void RiffChunkWriter::BuildInfoList(std::vector<unsigned char> &list) {
+  list.clear();
+  if (m_strings.empty())
+    return;
+
+  AppendId(list, "INFO");
+  for (unsigned i = 0; i < m_strings.size(); i++) {
+    // same as libsndfile, the size includes the terminator and padding
+    unsigned size = m_strings[i].second.size() + 1;
+    size += size & 1;
+    AppendId(list, m_strings[i].first.c_str());
+    AppendLE32(list, size);
+    list.insert(list.end(), m_strings[i].second.begin(), m_strings[i].second.end());
+    list.resize(list.size() + size - m_strings[i].second.size(), 0);
+  }
+}
+
+bool RiffChunkWriter::WriteChunk(wxFile &target, const char *id, const std::vector<unsigned char> &data) {
+  std::vector<unsigned char> header;
+  AppendId(header, id);
+  AppendLE32(header, data.size());
+  if (target.Write(&header[0], 8) != 8)
+    return false;
+  if (!data.empty() && target.Write(&data[0], data.size()) != data.size())
+    return false;
+  if (data.size() & 1) {
+    unsigned char pad = 0;
+    return target.Write(&pad, 1) == 1;
+  }
+  return true;
+}
+
+bool RiffChunkWriter::CopyChunk(wxFile &target, const RiffChunk &chunk) {
+  if (!CopyRange(target, chunk.offset - 8, (wxFileOffset) chunk.size + 8))
+    return false;
+  // the pad byte of the last chunk is sometimes missing in the source
+  if (chunk.size & 1) {
+    unsigned char pad = 0;
+    return target.Write(&pad, 1) == 1;
+  }
+  return true;
+}
+
+bool RiffChunkWriter::CopyRange(wxFile &target, wxFileOffset offset, wxFileOffset length) {
+#ifdef __linux__
+  // Let the kernel copy (or on some file systems just share) the data
+  // without passing it through user space
+  loff_t inOffset = offset;
+  while (length > 0) {
+    ssize_t copied = copy_file_range(m_source.fd(), &inOffset, target.fd(), NULL, (size_t) length, 0);
+    if (copied <= 0)
+      break;
+    length -= copied;
+  }
+  while (length > 0) {
+    off_t sendOffset = inOffset;
+    ssize_t copied = sendfile(target.fd(), m_source.fd(), &sendOffset, (size_t) std::min(length, (wxFileOffset) 0x7FFFF000));
+    if (copied <= 0)
+      break;
+    inOffset = sendOffset;
+    length -= copied;
+  }
+  offset = inOffset;
+  if (length == 0)
+    return true;
+#endif
+
+  if (m_source.Seek(offset) != offset)
+    return false;
+  std::vector<unsigned char> buffer((size_t) std::min(length, (wxFileOffset) COPY_BLOCK_BYTES));
+  while (length > 0) {
+    size_t block = (size_t) std::min(length, (wxFileOffset) buffer.size());
+    if (m_source.Read(&buffer[0], block) != (ssize_t) block)
+      return false;
+    if (target.Write(&buffer[0], block) != block)
+      return false;
+    length -= block;
+  }
+  return true;
+}
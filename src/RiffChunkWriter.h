@@ -0,0 +1,85 @@
+/*
+ * RiffChunkWriter.h is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+#ifndef RIFFCHUNKWRITER_H
+#define RIFFCHUNKWRITER_H
+
+#include <wx/wx.h>
+#include <wx/file.h>
+#include "sndfile.hh"
+#include <vector>
+#include <string>
+
+/*
+ * RiffChunkWriter creates a copy of an existing WAV file where only the
+ * metadata chunks (smpl, cue and LIST INFO) are replaced. The cue labels
+ * (LIST adtl) are dropped like libsndfile does. All other chunks,
+ * including the audio data, are copied byte for byte without being decoded,
+ * with copy_file_range/sendfile where the system supports it. The chunk
+ * contents are the same as what libsndfile writes for the corresponding
+ * SF_INSTRUMENT, SF_CUES and string settings.
+ */
+class RiffChunkWriter {
+public:
+  RiffChunkWriter();
+  ~RiffChunkWriter();
+
+  // Read the chunk layout of the file that the copy is based on
+  bool Open(wxString sourcePath);
+  void Close();
+
+  void SetInstrument(const SF_INSTRUMENT &instr, int sampleRate);
+  void SetCues(const SF_CUES &cues);
+  void SetString(int strType, const char *str);
+
+  // Write the new file, it should be a temporary file that then replaces
+  // the real target as the file is complete (and synced) only on success
+  bool Write(wxString targetPath);
+
+  // Move a completely written temporary file over targetPath. It gets the
+  // permissions and owner of the file it replaces, or of modelPath if
+  // there's none, and both the file and the rename are synced to disk
+  static bool ReplaceFile(wxString tempPath, wxString targetPath, wxString modelPath);
+
+private:
+  struct RiffChunk {
+    char id[4];
+    wxFileOffset offset; // start of the chunk data in the source
+    unsigned size;
+    bool isInfoList;
+    // LIST adtl holds the labels of the cues by their ids, that don't match
+    // the new cue chunk
+    bool isCueLabelList;
+  };
+
+  wxFile m_source;
+  std::vector<RiffChunk> m_chunks;
+  std::vector<unsigned char> m_smpl;
+  std::vector<unsigned char> m_cue;
+  std::vector<std::pair<std::string, std::string> > m_strings;
+
+  bool ReadChunkHeaders();
+  void BuildInfoList(std::vector<unsigned char> &list);
+  bool WriteChunk(wxFile &target, const char *id, const std::vector<unsigned char> &data);
+  bool CopyChunk(wxFile &target, const RiffChunk &chunk);
+  bool CopyRange(wxFile &target, wxFileOffset offset, wxFileOffset length);
+};
+
+#endif
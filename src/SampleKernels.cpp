@@ -0,0 +1,224 @@
+/*
+ * SampleKernels.cpp is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+#include "SampleKernels.h"
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Conversion of one normalized sample to the target format
+static inline void StoreSample(double value, double scale, short &out) {
+  value *= scale;
+  if (value > scale - 1.0)
+    value = scale - 1.0;
+  else if (value < -scale)
+    value = -scale;
+  out = (short) lrint(value);
+}
+
+static inline void StoreSample(double value, double scale, int &out) {
+  value *= scale;
+  if (value > scale - 1.0)
+    value = scale - 1.0;
+  else if (value < -scale)
+    value = -scale;
+  out = (int) lrint(value);
+}
+
+static inline void StoreSample(double value, double, float &out) {
+  out = (float) value;
+}
+
+static inline void StoreSample(double value, double, double &out) {
+  out = value;
+}
+
+template <typename T, typename U>
+static void DeinterleaveMono(const T *in, unsigned nbrFrames, U *out, double factor) {
+  for (unsigned i = 0; i < nbrFrames; i++)
+    out[i] = (U) (in[i] * factor);
+}
+
+template <typename T, typename U>
+static void DeinterleaveStereo(const T *in, unsigned nbrFrames, U *left, U *right, double factor) {
+  for (unsigned i = 0; i < nbrFrames; i++) {
+    left[i] = (U) (in[2 * i] * factor);
+    right[i] = (U) (in[2 * i + 1] * factor);
+  }
+}
+
+template <typename U, typename T>
+static void InterleaveMono(const U *in, unsigned nbrFrames, T *out, double scale) {
+  for (unsigned i = 0; i < nbrFrames; i++)
+    StoreSample(in[i], scale, out[i]);
+}
+
+template <typename U, typename T>
+static void InterleaveStereo(const U *left, const U *right, unsigned nbrFrames, T *out, double scale) {
+  for (unsigned i = 0; i < nbrFrames; i++) {
+    StoreSample(left[i], scale, *out++);
+    StoreSample(right[i], scale, *out++);
+  }
+}
+
+#ifdef __SSE2__
+// With the factor being a power of two it makes no difference if the
+// scaling is done in single or double precision, the result is the same
+
+static void DeinterleaveStereo(const float *in, unsigned nbrFrames, float *left, float *right, double factor) {
+  __m128 f = _mm_set1_ps((float) factor);
+  unsigned i = 0;
+  for (; i + 4 <= nbrFrames; i += 4) {
+    __m128 a = _mm_loadu_ps(in + 2 * i);
+    __m128 b = _mm_loadu_ps(in + 2 * i + 4);
+    _mm_storeu_ps(left + i, _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), f));
+    _mm_storeu_ps(right + i, _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)), f));
+  }
+  DeinterleaveStereo<float, float>(in + 2 * i, nbrFrames - i, left + i, right + i, factor);
+}
+
+static void DeinterleaveStereo(const int *in, unsigned nbrFrames, float *left, float *right, double factor) {
+  __m128 f = _mm_set1_ps((float) factor);
+  unsigned i = 0;
+  for (; i + 4 <= nbrFrames; i += 4) {
+    __m128 a = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*) (in + 2 * i)));
+    __m128 b = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*) (in + 2 * i + 4)));
+    _mm_storeu_ps(left + i, _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), f));
+    _mm_storeu_ps(right + i, _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)), f));
+  }
+  DeinterleaveStereo<int, float>(in + 2 * i, nbrFrames - i, left + i, right + i, factor);
+}
+
+static void DeinterleaveStereo(const short *in, unsigned nbrFrames, float *left, float *right, double factor) {
+  __m128 f = _mm_set1_ps((float) factor);
+  unsigned i = 0;
+  for (; i + 4 <= nbrFrames; i += 4) {
+    // sign extend the four frames to 32 bit integers
+    __m128i x = _mm_loadu_si128((const __m128i*) (in + 2 * i));
+    __m128 a = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+    __m128 b = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+    _mm_storeu_ps(left + i, _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), f));
+    _mm_storeu_ps(right + i, _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)), f));
+  }
+  DeinterleaveStereo<short, float>(in + 2 * i, nbrFrames - i, left + i, right + i, factor);
+}
+
+static void InterleaveStereo(const float *left, const float *right, unsigned nbrFrames, short *out, double scale) {
+  // the conversion rounds to nearest even just like lrint does
+  __m128 s = _mm_set1_ps((float) scale);
+  __m128 maxValue = _mm_set1_ps((float) (scale - 1.0));
+  __m128 minValue = _mm_set1_ps((float) -scale);
+  unsigned i = 0;
+  for (; i + 4 <= nbrFrames; i += 4) {
+    __m128 l = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(left + i), s), maxValue), minValue);
+    __m128 r = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(right + i), s), maxValue), minValue);
+    __m128i li = _mm_cvtps_epi32(l);
+    __m128i ri = _mm_cvtps_epi32(r);
+    __m128i packed = _mm_packs_epi32(_mm_unpacklo_epi32(li, ri), _mm_unpackhi_epi32(li, ri));
+    _mm_storeu_si128((__m128i*) (out + 2 * i), packed);
+  }
+  InterleaveStereo<float, short>(left + i, right + i, nbrFrames - i, out + 2 * i, scale);
+}
+#endif
+
+template <typename T, typename U>
+void DeinterleaveSamples(const T *in, unsigned nbrFrames, int channels, U *out, unsigned long outStride, double factor) {
+  if (channels == 1) {
+    DeinterleaveMono(in, nbrFrames, out, factor);
+  } else if (channels == 2) {
+    DeinterleaveStereo(in, nbrFrames, out, out + outStride, factor);
+  } else {
+    for (unsigned i = 0; i < nbrFrames; i++) {
+      U *dst = out + i;
+      for (int ch = 0; ch < channels; ch++, dst += outStride)
+        *dst = (U) (*in++ * factor);
+    }
+  }
+}
+
+template <typename U, typename T>
+void InterleaveSamples(const U *in, unsigned long inStride, unsigned nbrFrames, int channels, T *out, double scale) {
+  if (channels == 1) {
+    InterleaveMono(in, nbrFrames, out, scale);
+  } else if (channels == 2) {
+    InterleaveStereo(in, in + inStride, nbrFrames, out, scale);
+  } else {
+    for (unsigned i = 0; i < nbrFrames; i++) {
+      const U *src = in + i;
+      for (int ch = 0; ch < channels; ch++, src += inStride)
+        StoreSample(*src, scale, *out++);
+    }
+  }
+}
+
+template <typename U>
+void ScaleTrack(U *track, const double *gain, unsigned count) {
+  for (unsigned i = 0; i < count; i++)
+    track[i] = (U) (track[i] * gain[i]);
+}
+
+template <typename U>
+void MixTrack(U *target, const U *source, const double *targetGain, const double *sourceGain, unsigned count) {
+  for (unsigned i = 0; i < count; i++)
+    target[i] = (U) (target[i] * targetGain[i] + source[i] * sourceGain[i]);
+}
+
+double LoopQuality(const double *tracks, unsigned long trackStride, int channels, unsigned start, unsigned end, double limit) {
+  const double *before = tracks + start - LOOP_QUALITY_FRAMES;
+  const double *atEnd = tracks + end + 1 - LOOP_QUALITY_FRAMES;
+  double worst = 0;
+  for (int c = 0; c < channels; c++) {
+    const double *channelBefore = before + c * trackStride;
+    const double *channelAtEnd = atEnd + c * trackStride;
+    double sum = 0;
+    for (unsigned j = 0; j < LOOP_QUALITY_FRAMES; j++)
+      sum += fabs(channelBefore[j] - channelAtEnd[j]);
+    if (sum > worst)
+      worst = sum;
+    if (worst > limit)
+      return worst;
+  }
+  return worst;
+}
+
+template void DeinterleaveSamples(const short*, unsigned, int, float*, unsigned long, double);
+template void DeinterleaveSamples(const int*, unsigned, int, float*, unsigned long, double);
+template void DeinterleaveSamples(const float*, unsigned, int, float*, unsigned long, double);
+template void DeinterleaveSamples(const double*, unsigned, int, float*, unsigned long, double);
+template void DeinterleaveSamples(const short*, unsigned, int, double*, unsigned long, double);
+template void DeinterleaveSamples(const int*, unsigned, int, double*, unsigned long, double);
+template void DeinterleaveSamples(const float*, unsigned, int, double*, unsigned long, double);
+template void DeinterleaveSamples(const double*, unsigned, int, double*, unsigned long, double);
+
+template void InterleaveSamples(const float*, unsigned long, unsigned, int, short*, double);
+template void InterleaveSamples(const float*, unsigned long, unsigned, int, int*, double);
+template void InterleaveSamples(const float*, unsigned long, unsigned, int, float*, double);
+template void InterleaveSamples(const float*, unsigned long, unsigned, int, double*, double);
+template void InterleaveSamples(const double*, unsigned long, unsigned, int, short*, double);
+template void InterleaveSamples(const double*, unsigned long, unsigned, int, int*, double);
+template void InterleaveSamples(const double*, unsigned long, unsigned, int, float*, double);
+template void InterleaveSamples(const double*, unsigned long, unsigned, int, double*, double);
+
+template void ScaleTrack(float*, const double*, unsigned);
+template void ScaleTrack(double*, const double*, unsigned);
+
+template void MixTrack(float*, const float*, const double*, const double*, unsigned);
+template void MixTrack(double*, const double*, const double*, const double*, unsigned);
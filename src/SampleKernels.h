@@ -0,0 +1,71 @@
+/*
+ * SampleKernels.h is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+#ifndef SAMPLEKERNELS_H
+#define SAMPLEKERNELS_H
+
+/*
+ * Conversions between interleaved sample data in the native file formats
+ * (short, int, float and double) and planar float or double tracks. The
+ * tracks of the planar data start outStride/inStride samples apart. Mono
+ * and stereo data have their own loops, which use SSE2 where available for
+ * reading into float tracks and for writing them as shorts, and any other
+ * channel count reads the interleaved data strictly in order.
+ *
+ * Deinterleaving multiplies every sample with factor. Interleaving to the
+ * integer formats multiplies with scale, rounds to the nearest integer and
+ * clips to the range of -scale to scale - 1, the floating point formats are
+ * just copied. Both are expected to be powers of two (like AudioStore uses)
+ * which makes all the paths give exactly the same results.
+ */
+
+template <typename T, typename U>
+void DeinterleaveSamples(const T *in, unsigned nbrFrames, int channels, U *out, unsigned long outStride, double factor);
+
+template <typename U, typename T>
+void InterleaveSamples(const U *in, unsigned long inStride, unsigned nbrFrames, int channels, T *out, double scale);
+
+/*
+ * Edits of a single planar track in place. ScaleTrack multiplies each sample
+ * with its own gain, MixTrack replaces each target sample with the gain
+ * weighted sum of it and the corresponding source sample. The samples are
+ * processed in order so the source may overlap the target at an earlier
+ * position.
+ */
+
+template <typename U>
+void ScaleTrack(U *track, const double *gain, unsigned count);
+
+template <typename U>
+void MixTrack(U *target, const U *source, const double *targetGain, const double *sourceGain, unsigned count);
+
+/*
+ * Quality of a loop from start to end in planar double tracks: the sum of
+ * the absolute differences between the LOOP_QUALITY_FRAMES frames before
+ * start and the same number of frames up to and including end, for the
+ * channel where it's greatest. As soon as a channel is worse than limit
+ * that channel's sum is returned.
+ */
+
+static const unsigned LOOP_QUALITY_FRAMES = 5;
+
+double LoopQuality(const double *tracks, unsigned long trackStride, int channels, unsigned start, unsigned end, double limit);
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ * ThreadPool.cpp is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+#include "ThreadPool.h"
+
+// Set for threads that are working on tasks of a pool, a nested Run
+// must not wait for the pool that its own thread belongs to
+static thread_local bool s_isWorking = false;
+
+ThreadPool::ThreadPool(unsigned nbrThreads) : m_task(NULL), m_nbrTasks(0), m_nextTask(0), m_busyThreads(0), m_generation(0), m_stop(false) {
+  for (unsigned i = 0; i < nbrThreads; i++)
+    m_threads.push_back(std::thread(&ThreadPool::WorkerLoop, this, i + 1));
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wakeUp.notify_all();
+  for (unsigned i = 0; i < m_threads.size(); i++)
+    m_threads[i].join();
+}
+
+ThreadPool *ThreadPool::GetShared() {
+  static ThreadPool pool(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0);
+  return &pool;
+}
+
+unsigned ThreadPool::GetWorkerCount() {
+  return m_threads.size() + 1;
+}
+
+void ThreadPool::Run(unsigned nbrTasks, const std::function<void(unsigned, unsigned)> &task) {
+  std::unique_lock<std::mutex> runLock(m_runMutex, std::defer_lock);
+  if (nbrTasks < 2 || m_threads.empty() || s_isWorking || !runLock.try_lock()) {
+    for (unsigned i = 0; i < nbrTasks; i++)
+      task(i, 0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_task = &task;
+    m_nbrTasks = nbrTasks;
+    m_nextTask = 0;
+    m_busyThreads = m_threads.size();
+    m_generation++;
+  }
+  m_wakeUp.notify_all();
+
+  s_isWorking = true;
+  RunTasks(0);
+  s_isWorking = false;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (m_busyThreads > 0)
+    m_finished.wait(lock);
+  m_task = NULL;
+}
+
+void ThreadPool::WorkerLoop(unsigned worker) {
+  s_isWorking = true;
+  unsigned long generation = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (!m_stop && m_generation == generation)
+        m_wakeUp.wait(lock);
+      if (m_stop)
+        return;
+      generation = m_generation;
+    }
+
+    RunTasks(worker);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (--m_busyThreads == 0)
+      m_finished.notify_one();
+  }
+}
+
+void ThreadPool::RunTasks(unsigned worker) {
+  for (;;) {
+    unsigned i = m_nextTask++;
+    if (i >= m_nbrTasks)
+      break;
+    (*m_task)(i, worker);
+  }
+}
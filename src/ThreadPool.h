@@ -0,0 +1,72 @@
+/*
+ * ThreadPool.h is a part of LoopAuditioneer software
+ * Copyright (C) 2026 Lars Palo and contributors (see AUTHORS file)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * You can contact the author on larspalo(at)yahoo.se
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+/*
+ * ThreadPool runs a number of independent tasks on a fixed set of threads
+ * and waits for all of them to finish. The calling thread works on the
+ * tasks too, as worker 0, so the workers are numbered from 0 to
+ * GetWorkerCount() - 1 which can be used to give each worker its own
+ * scratch data. The tasks are started in order but may finish in any order.
+ *
+ * If the pool is already busy (like when Run is called from inside a task,
+ * or from another thread at the same time) the tasks are simply run in
+ * order by the calling thread, as worker 0.
+ */
+class ThreadPool {
+public:
+  // A pool with nbrThreads threads besides the calling thread
+  ThreadPool(unsigned nbrThreads);
+  ~ThreadPool();
+
+  // The pool shared by the whole program, using all processor cores
+  static ThreadPool *GetShared();
+
+  unsigned GetWorkerCount();
+  // Call task(taskIndex, workerIndex) for every taskIndex below nbrTasks
+  void Run(unsigned nbrTasks, const std::function<void(unsigned, unsigned)> &task);
+
+private:
+  std::vector<std::thread> m_threads;
+  std::mutex m_runMutex;
+  std::mutex m_mutex;
+  std::condition_variable m_wakeUp;
+  std::condition_variable m_finished;
+  const std::function<void(unsigned, unsigned)> *m_task;
+  unsigned m_nbrTasks;
+  std::atomic<unsigned> m_nextTask;
+  unsigned m_busyThreads;
+  unsigned long m_generation;
+  bool m_stop;
+
+  void WorkerLoop(unsigned worker);
+  void RunTasks(unsigned worker);
+};
+
+#endif
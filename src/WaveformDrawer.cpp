@@ -22,11 +22,15 @@
 #include "PlayPositionMarker.xpm"
 #include <cmath>
 #include <cfloat>
+#include <algorithm>
 #include "LoopAuditioneer.h"
 #include "LoopAuditioneerDef.h"
 #include <wx/image.h>
 #include <wx/bitmap.h>
 
+// Frames of each group of the waveform summary
+static const unsigned SUMMARY_FRAMES = 128;
+
 BEGIN_EVENT_TABLE(WaveformDrawer, wxPanel)
   EVT_PAINT(WaveformDrawer::paintEvent)
   EVT_RIGHT_DOWN(WaveformDrawer::OnRightClick)
@@ -79,6 +83,9 @@ WaveformDrawer::WaveformDrawer(wxFrame *parent, FileHandling *fh) : wxPanel(pare
   m_prev_y = 0;
   m_leftBorderX = 0;
   m_rightBorderX = 0;
+  m_summaryIsValid = false;
+  m_summaryChangeCount = 0;
+  m_summaryGroups = 0;
 
   // create the popup menu for the waveform
   m_popupMenu = new wxMenu();
@@ -147,8 +154,8 @@ void WaveformDrawer::OnPaint(wxDC& dc) {
       }
     }
 
-    if (m_fileReference->waveTracks[0].waveData.size() > 0) {
-      int nrOfSamples = m_fileReference->waveTracks[0].waveData.size();
+    if (m_fileReference->m_audio->GetFrames() > 0) {
+      int nrOfSamples = m_fileReference->m_audio->GetFrames();
       int samplesPerPixel;
     
       if (nrOfSamples % trackWidth == 0)
@@ -156,46 +163,50 @@ void WaveformDrawer::OnPaint(wxDC& dc) {
       else
         samplesPerPixel = (nrOfSamples / trackWidth) + 1;
 
-      double maxValue = 0, minValue = 0;
-      int lineToDraw = 0;
-      for (unsigned j = 0; j < m_fileReference->waveTracks.size(); j++) {
-        for (unsigned i = 0; i < m_fileReference->waveTracks[0].waveData.size(); i++) {
-          if (i % samplesPerPixel == 0 && i > 0) {
-            // we should write the line representing the audio data and start a new count
-            // but first we adjust max and min values with the m_amplitudeZoomLevel
-            maxValue *= m_amplitudeZoomLevel;
-            minValue *= m_amplitudeZoomLevel;
-            if (maxValue > 1)
-              maxValue = 1;
-            if (minValue < -1)
-              minValue = -1;
-
-            // calculate coordinates
-            wxCoord x1 = leftMargin + lineToDraw, y1 = topMargin + trackHeight * j + j * marginBetweenTracks + (trackHeight / 2) - (maxValue * trackHeight / 2);
-            wxCoord x2 = leftMargin + lineToDraw, y2 = topMargin + trackHeight * j + j * marginBetweenTracks + (trackHeight / 2) - (minValue * trackHeight / 2);
-
-            dc.SetPen(wxPen(blue, 1, wxPENSTYLE_SOLID));
-            dc.DrawLine(x1, y1, x2, y2);
-
-            // proceed with next frame
-            maxValue = m_fileReference->waveTracks[j].waveData[i];
-            minValue = m_fileReference->waveTracks[j].waveData[i];
-            lineToDraw++;
+      // the minimum and maximum of each group of frames are only found once
+      // for each change of the audio data, and each line is drawn from the
+      // groups within it. When there are fewer frames than a group for each
+      // pixel the few frames of a line are read directly instead
+      std::vector<double> frames;
+      if ((unsigned) samplesPerPixel < SUMMARY_FRAMES)
+        frames.resize(samplesPerPixel);
+      else
+        UpdateSummary();
+      for (int j = 0; j < m_fileReference->m_audio->GetChannels(); j++) {
+        int lineToDraw = 0;
+        for (unsigned i = 0; i < (unsigned) nrOfSamples; i += samplesPerPixel) {
+          unsigned lineEnd = std::min(i + samplesPerPixel, (unsigned) nrOfSamples);
+          double maxValue = 0, minValue = 0;
+          if (frames.empty()) {
+            unsigned firstGroup = j * m_summaryGroups + i / SUMMARY_FRAMES;
+            unsigned lastGroup = j * m_summaryGroups + (lineEnd - 1) / SUMMARY_FRAMES;
+            maxValue = *std::max_element(m_summaryMax.begin() + firstGroup, m_summaryMax.begin() + lastGroup + 1);
+            minValue = *std::min_element(m_summaryMin.begin() + firstGroup, m_summaryMin.begin() + lastGroup + 1);
           } else {
-            if (m_fileReference->waveTracks[j].waveData[i] > maxValue)
-              maxValue = m_fileReference->waveTracks[j].waveData[i];
-            else if (m_fileReference->waveTracks[j].waveData[i] < minValue)
-              minValue = m_fileReference->waveTracks[j].waveData[i];
+            m_fileReference->m_audio->ReadTrack(j, i, lineEnd - i, &frames[0]);
+            maxValue = *std::max_element(frames.begin(), frames.begin() + (lineEnd - i));
+            minValue = *std::min_element(frames.begin(), frames.begin() + (lineEnd - i));
           }
+
+          // adjust max and min values with the m_amplitudeZoomLevel
+          maxValue *= m_amplitudeZoomLevel;
+          minValue *= m_amplitudeZoomLevel;
+          if (maxValue > 1)
+            maxValue = 1;
+          if (minValue < -1)
+            minValue = -1;
+
+          // calculate coordinates
+          wxCoord x1 = leftMargin + lineToDraw, y1 = topMargin + trackHeight * j + j * marginBetweenTracks + (trackHeight / 2) - (maxValue * trackHeight / 2);
+          wxCoord x2 = leftMargin + lineToDraw, y2 = topMargin + trackHeight * j + j * marginBetweenTracks + (trackHeight / 2) - (minValue * trackHeight / 2);
+
+          dc.SetPen(wxPen(blue, 1, wxPENSTYLE_SOLID));
+          dc.DrawLine(x1, y1, x2, y2);
+          lineToDraw++;
         }
         // draw the 0 indicating line
         dc.SetPen(wxPen(blue, 1, wxPENSTYLE_SOLID));
         dc.DrawLine((leftMargin + 1), topMargin + trackHeight * j + j * marginBetweenTracks + (trackHeight / 2), size.x - (rightMargin + 1), topMargin + trackHeight * j + j * marginBetweenTracks + (trackHeight / 2));
-
-        // reset the wave pixel position for the next track
-        lineToDraw = 0;
-        maxValue = 0;
-        minValue = 0;
       }
       // draw in eventual metadata (loops and cues)
       dc.SetFont(wxFont(8, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
@@ -207,7 +218,7 @@ void WaveformDrawer::OnPaint(wxDC& dc) {
           // the positions from dwSampleOffset is in sample frames so it has to be re-calculated into pixels
           int xPosition = cueSampleOffset[i] / samplesPerPixel + leftMargin;
           int yPositionHigh = topMargin + 1;
-          int yPositionLow = topMargin + trackHeight * m_fileReference->waveTracks.size() + (marginBetweenTracks * (m_fileReference->waveTracks.size() - 1) - 1);
+          int yPositionLow = topMargin + trackHeight * m_fileReference->m_audio->GetChannels() + (marginBetweenTracks * (m_fileReference->m_audio->GetChannels() - 1) - 1);
           if (hasCueSelection && i == (unsigned) cueIndexSelection) {
             dc.SetPen(wxPen(green, 1, wxPENSTYLE_SOLID));
           } else {
@@ -225,7 +236,7 @@ void WaveformDrawer::OnPaint(wxDC& dc) {
         // here we draw the loops from the vector
         int overlap = 0;
         int yPositionHigh = topMargin + 1;
-        int yPositionLow = topMargin + trackHeight * m_fileReference->waveTracks.size() + (marginBetweenTracks * (m_fileReference->waveTracks.size() - 1) - 1);
+        int yPositionLow = topMargin + trackHeight * m_fileReference->m_audio->GetChannels() + (marginBetweenTracks * (m_fileReference->m_audio->GetChannels() - 1) - 1);
 
         for (unsigned i = 0; i < loopPositions.size(); i++) {
           // the loop start value (in samples) is in loopPositions[i].first
@@ -312,7 +323,7 @@ void WaveformDrawer::OnPaint(wxDC& dc) {
 
 void WaveformDrawer::SetPlayPosition(unsigned int pPos) {
   // In comes a sample value and the playPosition is calculated in pixels from (leftMargin - 4) to (trackWidth - 4)
-  int nrOfSamples = m_fileReference->waveTracks[0].waveData.size();
+  int nrOfSamples = m_fileReference->m_audio->GetFrames();
   int samplesPerPixel;
 
   if (trackWidth > 0) {
@@ -418,7 +429,7 @@ void WaveformDrawer::CalculateLayout() {
   }
 
   // And now it's the cue markers turn but first we get the samplesPerPixel value
-  int nrOfSamples = m_fileReference->waveTracks[0].waveData.size();
+  int nrOfSamples = m_fileReference->m_audio->GetFrames();
   int samplesPerPixel;
   int equalTo24px;
 
@@ -509,7 +520,7 @@ void WaveformDrawer::OnLeftClick(wxMouseEvent& event) {
 
   if (m_x > leftMargin && m_x < (leftMargin + trackWidth) && m_y > topMargin && m_y <= (topMargin + trackHeight * m_fileReference->m_channels + marginBetweenTracks * m_fileReference->m_channels)) {
     // user have clicked on the track area
-    int nrOfSamples = m_fileReference->waveTracks[0].waveData.size();
+    int nrOfSamples = m_fileReference->m_audio->GetFrames();
     int samplesPerPixel;
 
     if (nrOfSamples % trackWidth == 0)
@@ -547,16 +558,16 @@ void WaveformDrawer::OnLeftClick(wxMouseEvent& event) {
       if (earliestSampleToConsider < 0)
         earliestSampleToConsider = 0;
 
-      if (lastSampleToConsider > m_fileReference->waveTracks[0].waveData.size())
-        lastSampleToConsider = m_fileReference->waveTracks[0].waveData.size() - 1;
+      if (lastSampleToConsider >= m_fileReference->m_audio->GetFrames())
+        lastSampleToConsider = m_fileReference->m_audio->GetFrames() - 1;
 
       unsigned int bestSample = 0;
       double lowestRMSPower = DBL_MAX;
       double currentRMSPower = 0;
-      // the sample values are in waveTracks[0].waveData
+      // the sample values are in the audio store
       for (unsigned i = earliestSampleToConsider; i <= lastSampleToConsider; i++) {
-        for (unsigned j = 0; j < m_fileReference->waveTracks.size(); j++)
-          currentRMSPower += pow(m_fileReference->waveTracks[j].waveData[i], 2);
+        for (int j = 0; j < m_fileReference->m_audio->GetChannels(); j++)
+          currentRMSPower += pow(m_fileReference->m_audio->GetSample(j, i), 2);
 
         if (currentRMSPower < lowestRMSPower) {
           lowestRMSPower = currentRMSPower;
@@ -643,7 +654,7 @@ void WaveformDrawer::OnRightClick(wxMouseEvent& event) {
     // draw an indication line approximately where cue will be inserted
     wxClientDC dc(this);
     int yPositionHigh = topMargin + 1;
-    int yPositionLow = topMargin + trackHeight * m_fileReference->waveTracks.size() + (marginBetweenTracks * (m_fileReference->waveTracks.size() - 1) - 1);
+    int yPositionLow = topMargin + trackHeight * m_fileReference->m_audio->GetChannels() + (marginBetweenTracks * (m_fileReference->m_audio->GetChannels() - 1) - 1);
     dc.SetPen(wxPen(green, 1, wxPENSTYLE_DOT));
     dc.DrawLine(m_x, yPositionLow, m_x, yPositionHigh);
 
@@ -820,7 +831,7 @@ void WaveformDrawer::DrawSustainIndication(wxDC &dc) {
 }
 
 void WaveformDrawer::CalculateSustainIndication() {
-  int nrOfSamples = m_fileReference->waveTracks[0].waveData.size();
+  int nrOfSamples = m_fileReference->m_audio->GetFrames();
   int samplesPerPixel;
     
   if (nrOfSamples % trackWidth == 0)
@@ -829,7 +840,7 @@ void WaveformDrawer::CalculateSustainIndication() {
     samplesPerPixel = (nrOfSamples / trackWidth) + 1;
   std::pair<unsigned, unsigned> currentSustain = m_fileReference->GetSustainsection();
   int yPosHigh = topMargin + 1;
-  int yExtent = topMargin + trackHeight * m_fileReference->waveTracks.size() + (marginBetweenTracks * (m_fileReference->waveTracks.size() - 1) - 1) - yPosHigh;
+  int yExtent = topMargin + trackHeight * m_fileReference->m_audio->GetChannels() + (marginBetweenTracks * (m_fileReference->m_audio->GetChannels() - 1) - 1) - yPosHigh;
   int xPosLeft = currentSustain.first / samplesPerPixel + leftMargin;
   int xExtent = ((currentSustain.second - currentSustain.first + 1) / samplesPerPixel) + 1.5;
   m_sustainsection_rect.yPosHigh = yPosHigh;
@@ -842,7 +853,7 @@ void WaveformDrawer::CalculateSustainIndication() {
 void WaveformDrawer::OnClickAddCue(wxCommandEvent& WXUNUSED(event)) {
   // we should now calculate what sample have lowest RMS power around current position
   // so that a good dwSampleOffset value can be sent to the new cue
-  int nrOfSamples = m_fileReference->waveTracks[0].waveData.size();
+  int nrOfSamples = m_fileReference->m_audio->GetFrames();
   int samplesPerPixel;
 
   if (nrOfSamples % trackWidth == 0)
@@ -857,16 +868,16 @@ void WaveformDrawer::OnClickAddCue(wxCommandEvent& WXUNUSED(event)) {
   if (earliestSampleToConsider < 0)
     earliestSampleToConsider = 0;
 
-  if (lastSampleToConsider > m_fileReference->waveTracks[0].waveData.size())
-    lastSampleToConsider = m_fileReference->waveTracks[0].waveData.size() - 1;
+  if (lastSampleToConsider >= m_fileReference->m_audio->GetFrames())
+    lastSampleToConsider = m_fileReference->m_audio->GetFrames() - 1;
 
   unsigned int bestSample = 0;
   double lowestRMSPower = DBL_MAX;
   double currentRMSPower = 0;
-  // the sample values are in waveTracks[0].waveData
+  // the sample values are in the audio store
   for (unsigned i = earliestSampleToConsider; i <= lastSampleToConsider; i++) {
-    for (unsigned j = 0; j < m_fileReference->waveTracks.size(); j++)
-      currentRMSPower += pow(m_fileReference->waveTracks[j].waveData[i], 2);
+    for (int j = 0; j < m_fileReference->m_audio->GetChannels(); j++)
+      currentRMSPower += pow(m_fileReference->m_audio->GetSample(j, i), 2);
 
     if (currentRMSPower < lowestRMSPower) {
       lowestRMSPower = currentRMSPower;
@@ -878,6 +889,38 @@ void WaveformDrawer::OnClickAddCue(wxCommandEvent& WXUNUSED(event)) {
   ::wxGetApp().frame->AddNewCue(bestSample); // send offset value for the new cue creation
 }
 
+void WaveformDrawer::UpdateSummary() {
+  AudioStore *audio = m_fileReference->m_audio;
+  if (m_summaryIsValid && m_summaryChangeCount == audio->GetChangeCount())
+    return;
+
+  unsigned nbrFrames = audio->GetFrames();
+  int channels = audio->GetChannels();
+  m_summaryGroups = (nbrFrames + SUMMARY_FRAMES - 1) / SUMMARY_FRAMES;
+  m_summaryMin.assign(m_summaryGroups * channels, 0.0f);
+  m_summaryMax.assign(m_summaryGroups * channels, 0.0f);
+
+  // the audio data is read a block at a time so that only the needed
+  // pages of a paged audio store have to be in memory at once
+  const unsigned blockSize = 128 * SUMMARY_FRAMES;
+  std::vector<double> block(std::min(blockSize, nbrFrames));
+  for (int j = 0; j < channels; j++) {
+    for (unsigned i = 0; i < nbrFrames; i += blockSize) {
+      unsigned framesInBlock = std::min(blockSize, nbrFrames - i);
+      audio->ReadTrack(j, i, framesInBlock, &block[0]);
+      for (unsigned k = 0; k < framesInBlock; k += SUMMARY_FRAMES) {
+        unsigned framesInGroup = std::min(SUMMARY_FRAMES, framesInBlock - k);
+        unsigned group = j * m_summaryGroups + (i + k) / SUMMARY_FRAMES;
+        m_summaryMin[group] = *std::min_element(block.begin() + k, block.begin() + k + framesInGroup);
+        m_summaryMax[group] = *std::max_element(block.begin() + k, block.begin() + k + framesInGroup);
+      }
+    }
+  }
+
+  m_summaryChangeCount = audio->GetChangeCount();
+  m_summaryIsValid = true;
+}
+
 void WaveformDrawer::ChangeLoopPositions(unsigned int start, unsigned int end, int idx) {
   loopPositions[idx].first = start;
   loopPositions[idx].second = end;
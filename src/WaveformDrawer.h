@@ -128,8 +128,17 @@ private:
   bool hasLoopSelection;
   int cueIndexSelection; // -1 when loop is selected otherwise index
   bool hasCueSelection;
+  // Minimum and maximum of each group of SUMMARY_FRAMES frames of all
+  // channels, one channel after another, valid while the change count of
+  // the audio data is m_summaryChangeCount
+  std::vector<float> m_summaryMin;
+  std::vector<float> m_summaryMax;
+  unsigned m_summaryGroups;
+  unsigned long m_summaryChangeCount;
+  bool m_summaryIsValid;
 
   void OnClickAddCue(wxCommandEvent& event);
+  void UpdateSummary();
 
   // This class handles events
   DECLARE_EVENT_TABLE()